@@ -37,6 +37,8 @@
 #include <string.h>
 #include "esp_task_wdt.h"
 
+#include "epd_convert.h"
+#include "epd_dither.h"
 #include "epd_highlevel.h"
 #include "epdiy.h"
 
@@ -130,42 +132,14 @@ static void obtain_time(void) {
 // Return the minimum of two values a and b
 #define minimum(a, b) (((a) < (b)) ? (a) : (b))
 
-uint8_t find_closest_palette_color(uint8_t oldpixel) {
-    return oldpixel & 0xF0;
-}
-
 //====================================================================================
-//   Decode and paint onto the Epaper screen
+//   Dither and paint onto the Epaper screen
 //====================================================================================
 void jpegRender(int xpos, int ypos, int width, int height) {
-    uint16_t ep_width = epd_width();
-    uint16_t ep_height = epd_height();
 #if JPG_DITHERING
-    unsigned long pixel = 0;
-    for (uint16_t by = 0; by < ep_height; by++) {
-        for (uint16_t bx = 0; bx < ep_width; bx++) {
-            int oldpixel = decoded_image[pixel];
-            int newpixel = find_closest_palette_color(oldpixel);
-            int quant_error = oldpixel - newpixel;
-            decoded_image[pixel] = newpixel;
-            if (bx < (ep_width - 1))
-                decoded_image[pixel + 1]
-                    = minimum(255, decoded_image[pixel + 1] + quant_error * 7 / 16);
-
-            if (by < (ep_height - 1)) {
-                if (bx > 0)
-                    decoded_image[pixel + ep_width - 1]
-                        = minimum(255, decoded_image[pixel + ep_width - 1] + quant_error * 3 / 16);
-
-                decoded_image[pixel + ep_width]
-                    = minimum(255, decoded_image[pixel + ep_width] + quant_error * 5 / 16);
-                if (bx < (ep_width - 1))
-                    decoded_image[pixel + ep_width + 1]
-                        = minimum(255, decoded_image[pixel + ep_width + 1] + quant_error * 1 / 16);
-            }
-            pixel++;
-        }
-    }
+    enum EpdDitherMethod dither_method = EPD_DITHER_FLOYD_STEINBERG;
+#else
+    enum EpdDitherMethod dither_method = EPD_DITHER_NONE;
 #endif
 
     // Write to display
@@ -175,11 +149,30 @@ void jpegRender(int xpos, int ypos, int width, int height) {
 
     ESP_LOGI("Padding", "x:%" PRIu32 " y:%" PRIu32 "", padding_x, padding_y);
 
-    for (uint32_t by = 0; by < height - 1; by++) {
-        for (uint32_t bx = 0; bx < width; bx++) {
-            epd_draw_pixel(bx + padding_x, by + padding_y, decoded_image[by * width + bx], fb);
-        }
+    // The image is dithered row by row into a 4 bit per pixel row
+    EpdDither* dither = epd_dither_create(width, 4, dither_method);
+    uint8_t* row = malloc(width / 2 + 1);
+    if (dither == NULL || row == NULL) {
+        ESP_LOGE(TAG, "could not allocate the dithering buffers");
+        epd_dither_free(dither);
+        free(row);
+        return;
+    }
+
+    for (uint32_t by = 0; by < height; by++) {
+        epd_dither_row(dither, &decoded_image[by * width], row);
+        EpdRect row_area = {
+            .x = padding_x,
+            .y = padding_y + by,
+            .width = width,
+            .height = 1,
+        };
+        epd_draw_rotated_image(row_area, row, fb);
     }
+
+    epd_dither_free(dither);
+    free(row);
+
     // calculate how long it took to draw the image
     time_render = (esp_timer_get_time() - drawTime) / 1000;
     ESP_LOGI("render", "%" PRIu32 " ms - jpeg draw", time_render);
@@ -221,27 +214,24 @@ static unsigned int tjd_output(
     uint32_t image_width = jd->width;
     uint8_t* bitmap_ptr = (uint8_t*)bitmap;
 
-    for (uint32_t i = 0; i < w * h; i++) {
-        uint8_t r = *(bitmap_ptr++);
-        uint8_t g = *(bitmap_ptr++);
-        uint8_t b = *(bitmap_ptr++);
-
-        // Calculate weighted grayscale
-        // uint32_t val = ((r * 30 + g * 59 + b * 11) / 100); // original formula
-        uint32_t val = (r * 38 + g * 75 + b * 15) >> 7;  // @vroland recommended formula
+    if (rect->left >= image_width) {
+        return 1;
+    }
+    uint32_t row_width = minimum(w, image_width - rect->left);
 
-        int xx = rect->left + i % w;
-        if (xx < 0 || xx >= image_width) {
-            continue;
-        }
-        int yy = rect->top + i / w;
-        if (yy < 0 || yy >= jd->height) {
-            continue;
+    for (uint32_t row = 0; row < h; row++) {
+        uint32_t yy = rect->top + row;
+        if (yy >= jd->height) {
+            break;
         }
-
-        /* Optimization note: If we manage to apply here the epd_draw_pixel directly
-           then it will be no need to keep a huge raw buffer (But will loose dither) */
-        decoded_image[yy * image_width + xx] = gamme_curve[val];
+        // Weighted grayscale with the gamma curve applied
+        epd_convert_to_gray8(
+            &bitmap_ptr[row * w * 3],
+            EPD_PIXEL_RGB888,
+            row_width,
+            gamme_curve,
+            &decoded_image[yy * image_width + rect->left]
+        );
     }
 
     return 1;
@@ -534,9 +524,7 @@ void app_main() {
     }
     memset(decoded_image, 255, epd_width() * epd_height());
 
-    double gammaCorrection = 1.0 / gamma_value;
-    for (int gray_value = 0; gray_value < 256; gray_value++)
-        gamme_curve[gray_value] = round(255 * pow(gray_value / 255.0, gammaCorrection));
+    epd_tone_curve(gamme_curve, gamma_value, 0, 255, false);
 
     // Initialize NVS
     esp_err_t ret = nvs_flash_init();
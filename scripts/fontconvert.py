@@ -37,6 +37,7 @@ try:
 except ImportError as error:
     sys.exit("To run this script the freetype module needs to be installed.\nThis can be done using:\npip install freetype-py")
 import zlib
+import struct
 import sys
 import re
 import math
@@ -46,10 +47,12 @@ from collections import namedtuple
 parser = argparse.ArgumentParser(description="Generate a header file from a font to be used with epdiy.")
 parser.add_argument("name", action="store", help="name of the font.")
 parser.add_argument("size", type=int, help="font size to use.")
-parser.add_argument("fontstack", action="store", nargs='+', help="list of font files, ordered by descending priority. This is not actually implemented please just use one file for now.")
-parser.add_argument("--compress", dest="compress", action="store_true", help="compress glyph bitmaps.")
+parser.add_argument("fontstack", action="store", nargs='+', help="list of font files, ordered by descending priority. Combining files is not fully supported, convert fonts separately and combine them at runtime with epd_font_stack_create().")
+parser.add_argument("--compress", dest="compress", nargs="?", const="zlib", choices=["zlib", "rle"], help="compress glyph bitmaps with zlib (the default), or run-length encode them, which decodes faster.")
 parser.add_argument("--additional-intervals", dest="additional_intervals", action="append", help="Additional code point intervals to export as min,max. This argument can be repeated.")
 parser.add_argument("--string", action="store", help="A string of all required characters. intervals are made up of this" )
+parser.add_argument("--bpp", type=int, choices=[1, 2, 4], default=4, help="bits per glyph pixel, fewer make smaller and faster fonts with less anti-aliasing.")
+parser.add_argument("--binary", dest="binary", action="store_true", help="write a binary font file for epd_font_file.h instead of a header.")
 
 args = parser.parse_args()
 command_line = ""
@@ -69,6 +72,9 @@ font_files =  args.fontstack
 face_index = 0
 font_file =  font_files[face_index]
 compress = args.compress
+# EpdGlyphCompression of the glyphs
+compression = {None: 0, "zlib": 1, "rle": 2}[compress]
+bpp = args.bpp
 size = args.size
 font_name = args.name
 
@@ -156,6 +162,30 @@ ascender = 0
 descender = 100
 f_height = 0
 
+def rle_encode(values, bpp):
+    """Run-length encode glyph pixel values, see EPD_COMPRESSION_RLE in epd_internals.h."""
+    max_value = (1 << bpp) - 1
+    def starts_run(i):
+        return i + 1 < len(values) and values[i] == values[i + 1] and values[i] in (0, max_value)
+    out = bytearray()
+    i = 0
+    while i < len(values):
+        count = 1
+        if starts_run(i):
+            while i + count < len(values) and count < 64 and values[i + count] == values[i]:
+                count += 1
+            out.append((0x40 if values[i] else 0x00) | (count - 1))
+        else:
+            while i + count < len(values) and count < 64 and not starts_run(i + count):
+                count += 1
+            out.append(0x80 | (count - 1))
+            literal = 0
+            for k in range(count):
+                literal |= values[i + k] << (k * bpp)
+            out.extend(literal.to_bytes((count * bpp + 7) // 8, "little"))
+        i += count
+    return bytes(out)
+
 def load_glyph(code_point):
     global face_index
     face_index = 0
@@ -195,26 +225,28 @@ for i_start, i_end in intervals:
         face = load_glyph(code_point)
         bitmap = face.glyph.bitmap
         pixels = []
+        values = []
         px = 0
+        pixels_per_byte = 8 // bpp
         for i, v in enumerate(bitmap.buffer):
-            y = i / bitmap.width
             x = i % bitmap.width
-            if x % 2 == 0:
-                px = (v >> 4)
-            else:
-                px = px | (v & 0xF0)
-                pixels.append(px);
-                px = 0
-            # eol
-            if x == bitmap.width - 1 and bitmap.width % 2 > 0:
+            values.append(v >> (8 - bpp))
+            if x == bitmap.width - 1:
+                values.extend([0] * (-bitmap.width % pixels_per_byte))
+            # the first pixel of a byte goes into its lowest bits
+            px = px | ((v >> (8 - bpp)) << (x % pixels_per_byte * bpp))
+            # rows start at a byte boundary
+            if x % pixels_per_byte == pixels_per_byte - 1 or x == bitmap.width - 1:
                 pixels.append(px)
                 px = 0
 
         packed = bytes(pixels);
         total_packed += len(packed)
         compressed = packed
-        if compress:
+        if compress == "zlib":
             compressed = zlib.compress(packed)
+        elif compress == "rle":
+            compressed = rle_encode(values, bpp)
 
         glyph = GlyphProps(
             width = bitmap.width,
@@ -245,6 +277,46 @@ print(f"Original font file {font_file} as {font_name} using {total_chars} charac
 print("total", total_packed, file=sys.stderr)
 print("compressed", total_size, file=sys.stderr)
 
+# glyph indices of the first 256 code points, for direct lookup
+direct_index = [0xFFFF] * 256
+offset = 0
+for i_start, i_end in intervals:
+    for code_point in range(i_start, min(i_end, 255) + 1):
+        if direct_index[code_point] == 0xFFFF:
+            direct_index[code_point] = offset + code_point - i_start
+    offset += i_end - i_start + 1
+
+def align4(data):
+    data.extend(bytes(-len(data) % 4))
+
+if args.binary:
+    # layout described in src/epd_font_file.h
+    header_size = 44
+    body = bytearray()
+    intervals_offset = header_size
+    offset = 0
+    for i_start, i_end in intervals:
+        body.extend(struct.pack("<III", i_start, i_end, offset))
+        offset += i_end - i_start + 1
+    glyphs_offset = header_size + len(body)
+    for g in glyph_props:
+        body.extend(struct.pack("<HHHhhxxII", *g[:-1]))
+    direct_index_offset = header_size + len(body)
+    body.extend(struct.pack("<256H", *direct_index))
+    bitmap_offset = header_size + len(body)
+    body.extend(glyph_data)
+    align4(body)
+    header = struct.pack(
+        "<4sHHHhhHIIIIIII",
+        b"EPDF", 1, compression,
+        norm_ceil(f_height), norm_ceil(ascender), norm_floor(descender), bpp,
+        len(intervals), len(glyph_props),
+        intervals_offset, glyphs_offset, direct_index_offset,
+        bitmap_offset, len(glyph_data),
+    )
+    sys.stdout.buffer.write(header + body)
+    sys.exit(0)
+
 print("#pragma once")
 print("#include \"epdiy.h\"")
 
@@ -277,15 +349,22 @@ for i_start, i_end in intervals:
     offset += i_end - i_start + 1
 print ("};");
 
+print(f"const uint16_t {font_name}_DirectIndex[256] = {{")
+for c in chunks(direct_index, 16):
+    print ("    " + " ".join(f"0x{i:04X}," for i in c))
+print ("};");
+
 print(f"const EpdFont {font_name} = {{")
 print(f"    {font_name}_Bitmaps, // (*bitmap) Glyph bitmap pointer, all concatenated together")
 print(f"    {font_name}_Glyphs, // glyphs Glyph array")
 print(f"    {font_name}_Intervals, // intervals Valid unicode intervals for this font")
 print(f"    {len(intervals)},   // interval_count Number of unicode intervals.intervals")
-print(f"    {1 if compress else 0}, // compressed Does this font use compressed glyph bitmaps?")
+print(f"    {compression}, // compressed Glyph compression: 0 none, 1 zlib, 2 run-length encoded")
 print(f"    {norm_ceil(f_height)}, // advance_y Newline distance (y axis)")
 print(f"    {norm_ceil(ascender)}, // ascender Maximal height of a glyph above the base line")
 print(f"    {norm_floor(descender)}, // descender Maximal height of a glyph below the base line")
+print(f"    {font_name}_DirectIndex, // direct_index Glyph index of each code point below 256")
+print(f"    {bpp}, // bits_per_pixel Bits per glyph pixel")
 print("};")
 print("/*")
 print("Included intervals")
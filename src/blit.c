@@ -0,0 +1,289 @@
+/**
+ * Raster operation block transfers between packed pixel buffers.
+ *
+ * Lines of 4bpp and 1bpp buffers are treated as LSB-first bit streams:
+ * The first pixel of a byte is in its lower nibble or least significant bit.
+ * This way, both depths share the same line kernel, which works on
+ * 32-bit words where possible and only masks partial bytes at the edges.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "epdiy.h"
+
+static inline int min(int x, int y) {
+    return x < y ? x : y;
+}
+static inline int max(int x, int y) {
+    return x > y ? x : y;
+}
+
+static inline uint32_t load32(const uint8_t* ptr) {
+    uint32_t value;
+    memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+static inline void store32(uint8_t* ptr, uint32_t value) {
+    memcpy(ptr, &value, sizeof(value));
+}
+
+/// Read 32 bits of a line, starting at bit `pos`.
+static inline uint32_t fetch32(const uint8_t* line, int pos) {
+    int shift = pos % 8;
+    const uint8_t* ptr = line + pos / 8;
+    if (shift == 0) {
+        return load32(ptr);
+    }
+    return (load32(ptr) >> shift) | ((uint32_t)ptr[4] << (32 - shift));
+}
+
+/// Read `n` <= 8 bits of a line, starting at bit `pos`.
+static inline uint8_t fetch8(const uint8_t* line, int pos, int n) {
+    int shift = pos % 8;
+    const uint8_t* ptr = line + pos / 8;
+    uint8_t value = ptr[0] >> shift;
+    if (shift + n > 8) {
+        value |= ptr[1] << (8 - shift);
+    }
+    return value;
+}
+
+/**
+ * Combine destination and source pixels of a word according to the raster operation.
+ * Pixels are 4 bits wide for `bpp == 4` and single bits otherwise.
+ */
+static inline __attribute__((always_inline)) uint32_t
+raster_op(uint32_t d, uint32_t s, enum EpdRasterOp op, int bpp, uint8_t param) {
+    switch (op) {
+        case EPD_ROP_COPY:
+            return s;
+        case EPD_ROP_AND:
+            return d & s;
+        case EPD_ROP_OR:
+            return d | s;
+        case EPD_ROP_XOR:
+            return d ^ s;
+        case EPD_ROP_INVERT:
+            return ~d;
+        case EPD_ROP_TRANSPARENT: {
+            uint32_t differs;
+            if (bpp == 4) {
+                // set all bits of nibbles which differ from the key
+                uint32_t x = s ^ (param * 0x11111111u);
+                x |= x >> 1;
+                x |= x >> 2;
+                differs = (x & 0x11111111u) * 0xF;
+            } else {
+                differs = param ? ~s : s;
+            }
+            return (s & differs) | (d & ~differs);
+        }
+        case EPD_ROP_ALPHA: {
+            if (bpp != 4) {
+                return param >= 8 ? s : d;
+            }
+            // Blend even and odd nibbles in separate byte lanes.
+            // Each lane holds at most 15 * 15 + 7 before the division by 15,
+            // which is exact for this range as (x + x / 16 + 1) / 16.
+            uint32_t result = 0;
+            for (int odd = 0; odd < 2; odd++) {
+                uint32_t sl = (s >> (4 * odd)) & 0x0F0F0F0Fu;
+                uint32_t dl = (d >> (4 * odd)) & 0x0F0F0F0Fu;
+                uint32_t x = sl * param + dl * (15 - param) + 0x07070707u;
+                x = x + ((x >> 4) & 0x0F0F0F0Fu) + 0x01010101u;
+                result |= ((x >> 4) & 0x0F0F0F0Fu) << (4 * odd);
+            }
+            return result;
+        }
+    }
+    return d;
+}
+
+/**
+ * Apply a raster operation to a line of `bits` bits.
+ * Inlined for each operation and depth, so the switch in `raster_op` is resolved at compile time.
+ */
+static inline __attribute__((always_inline)) void blit_line(
+    uint8_t* dst,
+    int dst_pos,
+    const uint8_t* src,
+    int src_pos,
+    int bits,
+    enum EpdRasterOp op,
+    int bpp,
+    uint8_t param
+) {
+    // leading partial byte
+    if (dst_pos % 8) {
+        int n = min(8 - dst_pos % 8, bits);
+        uint8_t mask = ((1 << n) - 1) << (dst_pos % 8);
+        uint8_t* ptr = dst + dst_pos / 8;
+        uint8_t s = fetch8(src, src_pos, n) << (dst_pos % 8);
+        *ptr = (*ptr & ~mask) | (raster_op(*ptr, s, op, bpp, param) & mask);
+        dst_pos += n;
+        src_pos += n;
+        bits -= n;
+    }
+
+    uint8_t* ptr = dst + dst_pos / 8;
+    if (op == EPD_ROP_COPY && src_pos % 8 == 0) {
+        memcpy(ptr, src + src_pos / 8, bits / 8);
+        ptr += bits / 8;
+        src_pos += bits / 8 * 8;
+        bits %= 8;
+    }
+
+    for (; bits >= 32; bits -= 32) {
+        store32(ptr, raster_op(load32(ptr), fetch32(src, src_pos), op, bpp, param));
+        ptr += 4;
+        src_pos += 32;
+    }
+
+    for (; bits >= 8; bits -= 8) {
+        *ptr = raster_op(*ptr, fetch8(src, src_pos, 8), op, bpp, param);
+        ptr++;
+        src_pos += 8;
+    }
+
+    // trailing partial byte
+    if (bits > 0) {
+        uint8_t mask = (1 << bits) - 1;
+        uint8_t s = fetch8(src, src_pos, bits);
+        *ptr = (*ptr & ~mask) | (raster_op(*ptr, s, op, bpp, param) & mask);
+    }
+}
+
+/// Blit all lines of a clipped area with a fixed raster operation and depth.
+static inline __attribute__((always_inline)) void blit_lines(
+    const EpdBitmap* dst,
+    int dst_x,
+    int dst_y,
+    const EpdBitmap* src,
+    int src_x,
+    int src_y,
+    int width,
+    int height,
+    enum EpdRasterOp op,
+    int bpp,
+    uint8_t param
+) {
+    for (int y = 0; y < height; y++) {
+        uint8_t* dst_line = dst->data + (dst_y + y) * dst->stride;
+        // the source is not read by EPD_ROP_INVERT, so any line is fine
+        const uint8_t* src_line = src->data + (src_y + y) * src->stride;
+        blit_line(dst_line, dst_x * bpp, src_line, src_x * bpp, width * bpp, op, bpp, param);
+    }
+}
+
+#define BLIT_WITH_OP(op, bpp)                                                                 \
+    blit_lines(dst, dst_x, dst_y, src, src_rect.x, src_rect.y, width, height, op, bpp, param)
+
+enum EpdDrawError epd_blit(
+    const EpdBitmap* dst,
+    int dst_x,
+    int dst_y,
+    const EpdBitmap* src,
+    EpdRect src_rect,
+    enum EpdRasterOp op,
+    uint8_t param
+) {
+    assert(dst != NULL && dst->data != NULL);
+
+    // the invert operation does not need a source, use the destination instead
+    if (op == EPD_ROP_INVERT && src == NULL) {
+        src = dst;
+    }
+    assert(src != NULL && src->data != NULL);
+
+    if (src->bpp != dst->bpp || (dst->bpp != 4 && dst->bpp != 1)) {
+        return EPD_DRAW_INVALID_PACKING_MODE;
+    }
+    if (op == EPD_ROP_TRANSPARENT) {
+        param &= dst->bpp == 4 ? 0xF : 0x1;
+    } else if (op == EPD_ROP_ALPHA) {
+        param = min(param, 15);
+    }
+
+    // clip to the source buffer
+    if (src_rect.x < 0) {
+        dst_x -= src_rect.x;
+        src_rect.width += src_rect.x;
+        src_rect.x = 0;
+    }
+    if (src_rect.y < 0) {
+        dst_y -= src_rect.y;
+        src_rect.height += src_rect.y;
+        src_rect.y = 0;
+    }
+    src_rect.width = min(src_rect.width, src->width - src_rect.x);
+    src_rect.height = min(src_rect.height, src->height - src_rect.y);
+
+    // clip to the destination buffer
+    int skip_x = max(0, -dst_x);
+    int skip_y = max(0, -dst_y);
+    src_rect.x += skip_x;
+    src_rect.y += skip_y;
+    dst_x += skip_x;
+    dst_y += skip_y;
+    int width = min(src_rect.width - skip_x, dst->width - dst_x);
+    int height = min(src_rect.height - skip_y, dst->height - dst_y);
+
+    if (width <= 0 || height <= 0) {
+        return EPD_DRAW_SUCCESS;
+    }
+
+    if (dst->bpp == 4) {
+        switch (op) {
+            case EPD_ROP_COPY:
+                BLIT_WITH_OP(EPD_ROP_COPY, 4);
+                break;
+            case EPD_ROP_AND:
+                BLIT_WITH_OP(EPD_ROP_AND, 4);
+                break;
+            case EPD_ROP_OR:
+                BLIT_WITH_OP(EPD_ROP_OR, 4);
+                break;
+            case EPD_ROP_XOR:
+                BLIT_WITH_OP(EPD_ROP_XOR, 4);
+                break;
+            case EPD_ROP_INVERT:
+                BLIT_WITH_OP(EPD_ROP_INVERT, 4);
+                break;
+            case EPD_ROP_TRANSPARENT:
+                BLIT_WITH_OP(EPD_ROP_TRANSPARENT, 4);
+                break;
+            case EPD_ROP_ALPHA:
+                BLIT_WITH_OP(EPD_ROP_ALPHA, 4);
+                break;
+        }
+    } else {
+        switch (op) {
+            case EPD_ROP_COPY:
+                BLIT_WITH_OP(EPD_ROP_COPY, 1);
+                break;
+            case EPD_ROP_AND:
+                BLIT_WITH_OP(EPD_ROP_AND, 1);
+                break;
+            case EPD_ROP_OR:
+                BLIT_WITH_OP(EPD_ROP_OR, 1);
+                break;
+            case EPD_ROP_XOR:
+                BLIT_WITH_OP(EPD_ROP_XOR, 1);
+                break;
+            case EPD_ROP_INVERT:
+                BLIT_WITH_OP(EPD_ROP_INVERT, 1);
+                break;
+            case EPD_ROP_TRANSPARENT:
+                BLIT_WITH_OP(EPD_ROP_TRANSPARENT, 1);
+                break;
+            case EPD_ROP_ALPHA:
+                BLIT_WITH_OP(EPD_ROP_ALPHA, 1);
+                break;
+        }
+    }
+    return EPD_DRAW_SUCCESS;
+}
@@ -10,6 +10,9 @@
 #include "pca9555.h"
 #include "tps65185.h"
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
 // Make this compile on the S3 to avoid long ifdefs
 #ifndef CONFIG_IDF_TARGET_ESP32
 #define GPIO_NUM_22 0
@@ -72,10 +75,14 @@ static i2s_bus_config i2s_config = {
 /** The VCOM voltage to use. */
 static int vcom = 1600;
 
-static bool interrupt_done = false;
+/// Given on every interrupt of the port expander, which signals input changes like power good.
+static SemaphoreHandle_t interrupt_smphr = NULL;
 
 static void IRAM_ATTR interrupt_handler(void* arg) {
-    interrupt_done = true;
+    BaseType_t task_awoken = pdFALSE;
+    xSemaphoreGiveFromISR(interrupt_smphr, &task_awoken);
+
+    portYIELD_FROM_ISR();
 }
 
 static epd_config_register_t config_reg;
@@ -103,6 +110,8 @@ static void epd_board_init(uint32_t epd_row_width) {
         config_reg.others[i] = false;
     }
 
+    interrupt_smphr = xSemaphoreCreateBinary();
+
     gpio_set_direction(CFG_INTR, GPIO_MODE_INPUT);
     gpio_set_intr_type(CFG_INTR, GPIO_INTR_NEGEDGE);
 
@@ -151,6 +160,7 @@ static void epd_board_deinit() {
     i2c_driver_delete(EPDIY_I2C_PORT);
     gpio_isr_handler_remove(CFG_INTR);
     gpio_uninstall_isr_service();
+    vSemaphoreDelete(interrupt_smphr);
     gpio_reset_pin(CFG_INTR);
     gpio_reset_pin(V4_LATCH_ENABLE);
 }
@@ -187,12 +197,17 @@ static void epd_board_set_ctrl(epd_ctrl_state_t* state, const epd_ctrl_state_t*
     }
 }
 
-static void epd_board_poweron(epd_ctrl_state_t* state) {
+static void epd_board_poweron_start(epd_ctrl_state_t* state) {
     i2s_gpio_attach(&i2s_config);
 
     epd_ctrl_state_t mask = {
         .ep_stv = true,
     };
+    // clear stale interrupts, reading the inputs re-arms the port expander interrupt
+    pca9555_read_input(config_reg.port, 0);
+    pca9555_read_input(config_reg.port, 1);
+    xSemaphoreTake(interrupt_smphr, 0);
+
     state->ep_stv = true;
     config_reg.wakeup = true;
     epd_board_set_ctrl(state, &mask);
@@ -200,10 +215,10 @@ static void epd_board_poweron(epd_ctrl_state_t* state) {
     epd_board_set_ctrl(state, &mask);
     config_reg.vcom_ctrl = true;
     epd_board_set_ctrl(state, &mask);
+}
 
-    // give the IC time to powerup and set lines
-    vTaskDelay(1);
-
+static bool epd_board_poweron_finish(epd_ctrl_state_t* state) {
+    // wake up on the power good interrupt, polling every tick in case an edge was missed
     int tries = 0;
     while (!(pca9555_read_input(config_reg.port, 1) & CFG_PIN_PWRGOOD)) {
         if (tries >= 500) {
@@ -213,10 +228,10 @@ static void epd_board_poweron(epd_ctrl_state_t* state) {
                 tps_read_register(config_reg.port, TPS_REG_INT1),
                 tps_read_register(config_reg.port, TPS_REG_INT2)
             );
-            return;
+            return false;
         }
         tries++;
-        vTaskDelay(1);
+        xSemaphoreTake(interrupt_smphr, 1);
     }
 
     ESP_ERROR_CHECK(tps_write_register(config_reg.port, TPS_REG_ENABLE, 0x3F));
@@ -224,7 +239,7 @@ static void epd_board_poweron(epd_ctrl_state_t* state) {
     tps_set_vcom(config_reg.port, vcom);
 
     state->ep_sth = true;
-    mask = (const epd_ctrl_state_t){
+    epd_ctrl_state_t mask = {
         .ep_sth = true,
     };
     epd_board_set_ctrl(state, &mask);
@@ -236,11 +251,17 @@ static void epd_board_poweron(epd_ctrl_state_t* state) {
                 "Power enable failed! PG status: %X",
                 tps_read_register(config_reg.port, TPS_REG_PG)
             );
-            return;
+            return false;
         }
         tries++;
         vTaskDelay(1);
     }
+    return true;
+}
+
+static void epd_board_poweron(epd_ctrl_state_t* state) {
+    epd_board_poweron_start(state);
+    epd_board_poweron_finish(state);
 }
 
 static void epd_board_measure_vcom(epd_ctrl_state_t* state) {
@@ -348,6 +369,8 @@ const EpdBoardDefinition epd_board_v6 = {
     .deinit = epd_board_deinit,
     .set_ctrl = epd_board_set_ctrl,
     .poweron = epd_board_poweron,
+    .poweron_start = epd_board_poweron_start,
+    .poweron_finish = epd_board_poweron_finish,
     .poweroff = epd_board_poweroff,
     .measure_vcom = epd_board_measure_vcom,
     .get_temperature = epd_board_ambient_temperature,
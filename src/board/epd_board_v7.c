@@ -10,6 +10,8 @@
 
 #include <driver/gpio.h>
 #include <driver/i2c.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include <sdkconfig.h>
 
 // Make this compile von the ESP32 without ifdefing the whole file
@@ -79,10 +81,14 @@ static int vcom = 1600;
 
 static epd_config_register_t config_reg;
 
-static bool interrupt_done = false;
+/// Given on every interrupt of the port expander, which signals input changes like power good.
+static SemaphoreHandle_t interrupt_smphr = NULL;
 
 static void IRAM_ATTR interrupt_handler(void* arg) {
-    interrupt_done = true;
+    BaseType_t task_awoken = pdFALSE;
+    xSemaphoreGiveFromISR(interrupt_smphr, &task_awoken);
+
+    portYIELD_FROM_ISR();
 }
 
 static lcd_bus_config_t lcd_config = {
@@ -132,6 +138,8 @@ static void epd_board_init(uint32_t epd_row_width) {
         config_reg.others[i] = false;
     }
 
+    interrupt_smphr = xSemaphoreCreateBinary();
+
     gpio_set_direction(CFG_INTR, GPIO_MODE_INPUT);
     gpio_set_intr_type(CFG_INTR, GPIO_INTR_NEGEDGE);
 
@@ -180,6 +188,7 @@ static void epd_board_deinit() {
     i2c_driver_delete(EPDIY_I2C_PORT);
 
     gpio_uninstall_isr_service();
+    vSemaphoreDelete(interrupt_smphr);
 }
 
 static void epd_board_set_ctrl(epd_ctrl_state_t* state, const epd_ctrl_state_t* const mask) {
@@ -201,12 +210,17 @@ static void epd_board_set_ctrl(epd_ctrl_state_t* state, const epd_ctrl_state_t*
     }
 }
 
-static void epd_board_poweron(epd_ctrl_state_t* state) {
+static void epd_board_poweron_start(epd_ctrl_state_t* state) {
     epd_ctrl_state_t mask = {
         .ep_output_enable = true,
         .ep_mode = true,
         .ep_stv = true,
     };
+    // clear stale interrupts, reading the inputs re-arms the port expander interrupt
+    pca9555_read_input(config_reg.port, 0);
+    pca9555_read_input(config_reg.port, 1);
+    xSemaphoreTake(interrupt_smphr, 0);
+
     state->ep_stv = true;
     state->ep_mode = false;
     state->ep_output_enable = true;
@@ -216,11 +230,23 @@ static void epd_board_poweron(epd_ctrl_state_t* state) {
     epd_board_set_ctrl(state, &mask);
     config_reg.vcom_ctrl = true;
     epd_board_set_ctrl(state, &mask);
+}
 
-    // give the IC time to powerup and set lines
-    vTaskDelay(1);
-
+static bool epd_board_poweron_finish(epd_ctrl_state_t* state) {
+    // wake up on the power good interrupt, polling every tick in case an edge was missed
+    int tries = 0;
     while (!(pca9555_read_input(config_reg.port, 1) & CFG_PIN_PWRGOOD)) {
+        if (tries >= 500) {
+            ESP_LOGE(
+                "epdiy",
+                "Power enable failed! INT status: 0x%X 0x%X",
+                tps_read_register(config_reg.port, TPS_REG_INT1),
+                tps_read_register(config_reg.port, TPS_REG_INT2)
+            );
+            return false;
+        }
+        tries++;
+        xSemaphoreTake(interrupt_smphr, 1);
     }
 
     ESP_ERROR_CHECK(tps_write_register(config_reg.port, TPS_REG_ENABLE, 0x3F));
@@ -228,12 +254,12 @@ static void epd_board_poweron(epd_ctrl_state_t* state) {
     tps_set_vcom(config_reg.port, vcom);
 
     state->ep_sth = true;
-    mask = (const epd_ctrl_state_t){
+    epd_ctrl_state_t mask = {
         .ep_sth = true,
     };
     epd_board_set_ctrl(state, &mask);
 
-    int tries = 0;
+    tries = 0;
     while (!((tps_read_register(config_reg.port, TPS_REG_PG) & 0xFA) == 0xFA)) {
         if (tries >= 500) {
             ESP_LOGE(
@@ -241,11 +267,17 @@ static void epd_board_poweron(epd_ctrl_state_t* state) {
                 "Power enable failed! PG status: %X",
                 tps_read_register(config_reg.port, TPS_REG_PG)
             );
-            return;
+            return false;
         }
         tries++;
         vTaskDelay(1);
     }
+    return true;
+}
+
+static void epd_board_poweron(epd_ctrl_state_t* state) {
+    epd_board_poweron_start(state);
+    epd_board_poweron_finish(state);
 }
 
 static void epd_board_measure_vcom(epd_ctrl_state_t* state) {
@@ -325,6 +357,8 @@ const EpdBoardDefinition epd_board_v7 = {
     .deinit = epd_board_deinit,
     .set_ctrl = epd_board_set_ctrl,
     .poweron = epd_board_poweron,
+    .poweron_start = epd_board_poweron_start,
+    .poweron_finish = epd_board_poweron_finish,
     .poweroff = epd_board_poweroff,
 
     .measure_vcom = epd_board_measure_vcom,
@@ -0,0 +1,177 @@
+/**
+ * Pixel format conversion of image rows.
+ *
+ * The kernels are written for 32-bit words holding several pixels (SWAR):
+ * Luma is computed for two pixels at a time in 16-bit lanes, where all
+ * intermediate sums stay below 2^16, and 4 bit packing handles four gray values per word.
+ * Tone curves are applied by table lookup between both steps.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "epd_convert.h"
+
+/// Pixels converted at once by `epd_convert_to_4bpp()`, must be even.
+#define CHUNK_PIXELS 64
+
+static inline uint32_t load32(const uint8_t* ptr) {
+    uint32_t value;
+    memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+static inline void store32(uint8_t* ptr, uint32_t value) {
+    memcpy(ptr, &value, sizeof(value));
+}
+
+void epd_tone_curve(
+    uint8_t* curve, float gamma, uint8_t black_level, uint8_t white_level, bool invert
+) {
+    float exponent = gamma > 0 ? 1.0f / gamma : 1.0f;
+    for (int v = 0; v < 256; v++) {
+        float t;
+        if (white_level > black_level) {
+            t = (float)(v - black_level) / (white_level - black_level);
+            t = t < 0 ? 0 : (t > 1 ? 1 : t);
+        } else {
+            t = v >= white_level ? 1 : 0;
+        }
+        uint8_t value = 255 * powf(t, exponent) + 0.5f;
+        curve[v] = invert ? 255 - value : value;
+    }
+}
+
+/// Luma of two RGB565 pixels in 16-bit lanes, with channels expanded to 8 bits as for RGB888.
+static inline uint32_t rgb565_luma2(uint32_t pixels) {
+    uint32_t r = (pixels >> 11) & 0x001F001F;
+    uint32_t g = (pixels >> 5) & 0x003F003F;
+    uint32_t b = pixels & 0x001F001F;
+    r = (r << 3) | ((r >> 2) & 0x00070007);
+    g = (g << 2) | ((g >> 4) & 0x00030003);
+    b = (b << 3) | ((b >> 2) & 0x00070007);
+    // at most 128 * 255 per lane
+    return ((r * 38 + g * 75 + b * 15) >> 7) & 0x00FF00FF;
+}
+
+static void rgb565_to_luma(const uint8_t* input, int width, bool big_endian, uint8_t* output) {
+    int x = 0;
+    for (; x + 2 <= width; x += 2) {
+        uint32_t pixels = load32(input + 2 * x);
+        if (big_endian) {
+            pixels = ((pixels >> 8) & 0x00FF00FF) | ((pixels << 8) & 0xFF00FF00);
+        }
+        uint32_t luma = rgb565_luma2(pixels);
+        output[x] = luma;
+        output[x + 1] = luma >> 16;
+    }
+    if (x < width) {
+        uint32_t pixel = big_endian ? (input[2 * x] << 8) | input[2 * x + 1]
+                                    : input[2 * x] | (input[2 * x + 1] << 8);
+        output[x] = rgb565_luma2(pixel);
+    }
+}
+
+static void rgb888_to_luma(const uint8_t* input, int width, uint8_t* output) {
+    int x = 0;
+    for (; x + 2 <= width; x += 2, input += 6) {
+        uint32_t r = input[0] | (input[3] << 16);
+        uint32_t g = input[1] | (input[4] << 16);
+        uint32_t b = input[2] | (input[5] << 16);
+        // at most 128 * 255 per lane
+        uint32_t luma = ((r * 38 + g * 75 + b * 15) >> 7) & 0x00FF00FF;
+        output[x] = luma;
+        output[x + 1] = luma >> 16;
+    }
+    if (x < width) {
+        output[x] = (input[0] * 38 + input[1] * 75 + input[2] * 15) >> 7;
+    }
+}
+
+/// Apply a tone curve to gray values, `input` may be `output`.
+static void
+apply_tone_curve(const uint8_t* input, int width, const uint8_t* curve, uint8_t* output) {
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        uint32_t v = load32(input + x);
+        store32(
+            output + x,
+            curve[v & 0xFF] | (curve[(v >> 8) & 0xFF] << 8) | (curve[(v >> 16) & 0xFF] << 16)
+                | ((uint32_t)curve[v >> 24] << 24)
+        );
+    }
+    for (; x < width; x++) {
+        output[x] = curve[input[x]];
+    }
+}
+
+void epd_convert_to_gray8(
+    const uint8_t* input,
+    enum EpdPixelFormat format,
+    int width,
+    const uint8_t* tone_curve,
+    uint8_t* output
+) {
+    switch (format) {
+        case EPD_PIXEL_GRAY8:
+            if (tone_curve != NULL) {
+                apply_tone_curve(input, width, tone_curve, output);
+            } else if (input != output) {
+                memcpy(output, input, width);
+            }
+            return;
+        case EPD_PIXEL_RGB888:
+            rgb888_to_luma(input, width, output);
+            break;
+        case EPD_PIXEL_RGB565:
+        case EPD_PIXEL_RGB565_BE:
+            rgb565_to_luma(input, width, format == EPD_PIXEL_RGB565_BE, output);
+            break;
+    }
+    if (tone_curve != NULL) {
+        apply_tone_curve(output, width, tone_curve, output);
+    }
+}
+
+/// Pack gray values to 4 bits per pixel, eight pixels per output word.
+static void pack_4bpp(const uint8_t* gray, int width, uint8_t* output) {
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        uint32_t a = (load32(gray + x) >> 4) & 0x0F0F0F0F;
+        uint32_t b = (load32(gray + x + 4) >> 4) & 0x0F0F0F0F;
+        // bytes 0 and 2 now hold two pixels each
+        a |= a >> 4;
+        b |= b >> 4;
+        store32(
+            output + x / 2,
+            (a & 0xFF) | ((a >> 8) & 0xFF00) | ((b & 0xFF) << 16) | ((b << 8) & 0xFF000000)
+        );
+    }
+    for (; x + 2 <= width; x += 2) {
+        output[x / 2] = (gray[x] >> 4) | (gray[x + 1] & 0xF0);
+    }
+    if (x < width) {
+        output[x / 2] = gray[x] >> 4;
+    }
+}
+
+void epd_convert_to_4bpp(
+    const uint8_t* input,
+    enum EpdPixelFormat format,
+    int width,
+    const uint8_t* tone_curve,
+    uint8_t* output
+) {
+    if (format == EPD_PIXEL_GRAY8 && tone_curve == NULL) {
+        pack_4bpp(input, width, output);
+        return;
+    }
+
+    int bytes_per_pixel = format == EPD_PIXEL_RGB888 ? 3 : (format == EPD_PIXEL_GRAY8 ? 1 : 2);
+    uint8_t gray[CHUNK_PIXELS];
+    for (int x = 0; x < width; x += CHUNK_PIXELS) {
+        int n = width - x < CHUNK_PIXELS ? width - x : CHUNK_PIXELS;
+        epd_convert_to_gray8(input + x * bytes_per_pixel, format, n, tone_curve, gray);
+        pack_4bpp(gray, n, output + x / 2);
+    }
+}
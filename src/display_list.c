@@ -0,0 +1,692 @@
+/**
+ * Display lists, rasterized band by band while drawing.
+ *
+ * During a draw, the render threads request input lines through a line source.
+ * Bands of `BAND_HEIGHT` lines are rasterized into a small ring of band slots on demand.
+ * A thread which needs a band that is being rasterized by the other thread
+ * rasterizes the following band meanwhile, so both threads work in parallel.
+ * Since all bands are rasterized again for every frame, the band keys include the frame.
+ */
+
+#include <assert.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "display_list.h"
+#include "epd_display_list.h"
+#include "epdiy.h"
+#include "glyph_cache.h"
+
+/// Number of lines rasterized at once.
+#define BAND_HEIGHT 16
+/// Number of rasterized bands held at once.
+#define NUM_BAND_SLOTS 3
+
+static inline int min(int x, int y) {
+    return x < y ? x : y;
+}
+static inline int max(int x, int y) {
+    return x > y ? x : y;
+}
+
+enum DisplayListOpType {
+    DL_FILL,
+    DL_IMAGE,
+    DL_GLYPH,
+};
+
+typedef struct {
+    /// Covered area in display coordinates.
+    int16_t x;
+    int16_t y;
+    int16_t width;
+    int16_t height;
+    uint8_t type;
+    union {
+        /// Fill color in the lower nibble.
+        uint8_t color;
+        struct {
+            const uint8_t* data;
+            int16_t stride;
+            uint8_t op;
+            uint8_t param;
+        } image;
+        struct {
+            const uint8_t* bitmap;
+            uint8_t fg_color : 4;
+            uint8_t bg_color : 4;
+            bool background;
+            uint8_t bits_per_pixel;
+        } glyph;
+    };
+} DisplayListOp;
+
+/// Bitmap of a glyph of a compressed font, or of a font read from storage.
+typedef struct {
+    const EpdGlyph* glyph;
+    uint8_t* bitmap;
+} DecompressedGlyph;
+
+struct EpdDisplayList {
+    int width;
+    int height;
+    uint8_t background;
+
+    DisplayListOp* ops;
+    int num_ops;
+    int ops_capacity;
+
+    DecompressedGlyph* glyphs;
+    int num_glyphs;
+    int glyphs_capacity;
+};
+
+typedef struct {
+    /// Key of the band held by the slot times two, plus one if it is completely rasterized.
+    /// Negative if the slot is unused.
+    atomic_int state;
+    uint8_t* data;
+} BandSlot;
+
+struct BandRenderer {
+    const EpdDisplayList* list;
+    int num_bands;
+    /// Indices of the operations intersecting each band.
+    /// Operations of band `b` are `band_ops[band_start[b]]` to `band_ops[band_start[b + 1] - 1]`.
+    int* band_start;
+    int* band_ops;
+    BandSlot slots[NUM_BAND_SLOTS];
+    /// Key of the band each render thread currently reads from.
+    atomic_int reading[EPD_NUM_RENDER_THREADS];
+    /// Line buffers for lines of bands which are already replaced in their slot.
+    uint8_t* line_buffers[EPD_NUM_RENDER_THREADS];
+};
+
+static inline int line_bytes(const EpdDisplayList* list) {
+    return list->width / 2 + list->width % 2;
+}
+
+EpdDisplayList* epd_dl_create(int width, int height, uint8_t background) {
+    EpdDisplayList* list = calloc(1, sizeof(EpdDisplayList));
+    if (list == NULL) {
+        return NULL;
+    }
+    list->width = width;
+    list->height = height;
+    list->background = background >> 4;
+    return list;
+}
+
+void epd_dl_clear(EpdDisplayList* list) {
+    for (int i = 0; i < list->num_glyphs; i++) {
+        free(list->glyphs[i].bitmap);
+    }
+    list->num_glyphs = 0;
+    list->num_ops = 0;
+}
+
+void epd_dl_free(EpdDisplayList* list) {
+    if (list == NULL) {
+        return;
+    }
+    epd_dl_clear(list);
+    free(list->glyphs);
+    free(list->ops);
+    free(list);
+}
+
+/// Append an operation covering the given area, returns NULL if the allocation failed.
+static DisplayListOp* add_op(EpdDisplayList* list, int type, int x, int y, int width, int height) {
+    if (list->num_ops == list->ops_capacity) {
+        int capacity = max(64, list->ops_capacity * 2);
+        DisplayListOp* ops = realloc(list->ops, capacity * sizeof(DisplayListOp));
+        if (ops == NULL) {
+            ESP_LOGE("epdiy", "failed to grow display list!");
+            return NULL;
+        }
+        list->ops = ops;
+        list->ops_capacity = capacity;
+    }
+    DisplayListOp* op = &list->ops[list->num_ops++];
+    op->type = type;
+    op->x = x;
+    op->y = y;
+    op->width = width;
+    op->height = height;
+    return op;
+}
+
+enum EpdDrawError epd_dl_fill_rect(EpdDisplayList* list, EpdRect rect, uint8_t color) {
+    if (rect.width <= 0 || rect.height <= 0) {
+        return EPD_DRAW_SUCCESS;
+    }
+    DisplayListOp* op = add_op(list, DL_FILL, rect.x, rect.y, rect.width, rect.height);
+    if (op == NULL) {
+        return EPD_DRAW_FAILED_ALLOC;
+    }
+    op->color = color >> 4;
+    return EPD_DRAW_SUCCESS;
+}
+
+enum EpdDrawError epd_dl_draw_hline(EpdDisplayList* list, int x, int y, int length, uint8_t color) {
+    EpdRect rect = { .x = x, .y = y, .width = length, .height = 1 };
+    return epd_dl_fill_rect(list, rect, color);
+}
+
+enum EpdDrawError epd_dl_draw_vline(EpdDisplayList* list, int x, int y, int length, uint8_t color) {
+    EpdRect rect = { .x = x, .y = y, .width = 1, .height = length };
+    return epd_dl_fill_rect(list, rect, color);
+}
+
+enum EpdDrawError epd_dl_draw_rect(EpdDisplayList* list, EpdRect rect, uint8_t color) {
+    int x = rect.x, y = rect.y, w = rect.width, h = rect.height;
+    enum EpdDrawError err = EPD_DRAW_SUCCESS;
+    err |= epd_dl_draw_hline(list, x, y, w, color);
+    err |= epd_dl_draw_hline(list, x, y + h - 1, w, color);
+    err |= epd_dl_draw_vline(list, x, y, h, color);
+    err |= epd_dl_draw_vline(list, x + w - 1, y, h, color);
+    return err;
+}
+
+enum EpdDrawError epd_dl_draw_image(
+    EpdDisplayList* list,
+    const EpdBitmap* image,
+    int x,
+    int y,
+    enum EpdRasterOp op,
+    uint8_t param
+) {
+    if (image->bpp != 4) {
+        return EPD_DRAW_INVALID_PACKING_MODE;
+    }
+    if (image->width <= 0 || image->height <= 0) {
+        return EPD_DRAW_SUCCESS;
+    }
+    DisplayListOp* dl_op = add_op(list, DL_IMAGE, x, y, image->width, image->height);
+    if (dl_op == NULL) {
+        return EPD_DRAW_FAILED_ALLOC;
+    }
+    dl_op->image.data = image->data;
+    dl_op->image.stride = image->stride;
+    dl_op->image.op = op;
+    dl_op->image.param = param;
+    return EPD_DRAW_SUCCESS;
+}
+
+/**
+ * Get the bitmap of a glyph, loading it only once per list
+ * for compressed fonts and fonts read from storage.
+ */
+static const uint8_t* glyph_bitmap(
+    EpdDisplayList* list, const EpdFont* font, const EpdGlyph* glyph
+) {
+    if (!font->compressed && font->bitmap != NULL) {
+        return &font->bitmap[glyph->data_offset];
+    }
+    for (int i = 0; i < list->num_glyphs; i++) {
+        if (list->glyphs[i].glyph == glyph) {
+            return list->glyphs[i].bitmap;
+        }
+    }
+
+    if (list->num_glyphs == list->glyphs_capacity) {
+        int capacity = max(32, list->glyphs_capacity * 2);
+        DecompressedGlyph* glyphs = realloc(list->glyphs, capacity * sizeof(DecompressedGlyph));
+        if (glyphs == NULL) {
+            return NULL;
+        }
+        list->glyphs = glyphs;
+        list->glyphs_capacity = capacity;
+    }
+    uint8_t* bitmap = malloc(glyph_byte_width(font, glyph) * glyph->height);
+    if (bitmap == NULL) {
+        return NULL;
+    }
+    if (epd_decompress_glyph(font, glyph, bitmap) != EPD_DRAW_SUCCESS) {
+        free(bitmap);
+        return NULL;
+    }
+    list->glyphs[list->num_glyphs].glyph = glyph;
+    list->glyphs[list->num_glyphs].bitmap = bitmap;
+    list->num_glyphs++;
+    return bitmap;
+}
+
+static enum EpdDrawError write_line(
+    EpdDisplayList* list,
+    const EpdFont* font,
+    const char* string,
+    int* cursor_x,
+    int cursor_y,
+    const EpdFontProperties* props
+) {
+    if (*string == '\0') {
+        return EPD_DRAW_SUCCESS;
+    }
+
+    enum EpdFontFlags alignment_mask
+        = EPD_DRAW_ALIGN_LEFT | EPD_DRAW_ALIGN_RIGHT | EPD_DRAW_ALIGN_CENTER;
+    enum EpdFontFlags alignment = props->flags & alignment_mask;
+
+    // alignments are mutually exclusive!
+    if ((alignment & (alignment - 1)) != 0) {
+        return EPD_DRAW_INVALID_FONT_FLAGS;
+    }
+
+    int x1 = 0, y1 = 0, w = 0, h = 0;
+    int tmp_cur_x = *cursor_x;
+    int tmp_cur_y = cursor_y;
+    epd_get_text_bounds(font, string, &tmp_cur_x, &tmp_cur_y, &x1, &y1, &w, &h, props);
+
+    // no printable characters
+    if (w < 0 || h < 0) {
+        return EPD_DRAW_NO_DRAWABLE_CHARACTERS;
+    }
+
+    int x = *cursor_x;
+    if (alignment == EPD_DRAW_ALIGN_CENTER) {
+        x -= w / 2;
+    } else if (alignment == EPD_DRAW_ALIGN_RIGHT) {
+        x -= w;
+    }
+
+    enum EpdDrawError err = EPD_DRAW_SUCCESS;
+    bool background = props->flags & EPD_DRAW_BACKGROUND;
+    if (background) {
+        EpdRect line_rect = {
+            .x = x,
+            .y = cursor_y - font->ascender,
+            .width = w,
+            .height = font->ascender - font->descender,
+        };
+        err |= epd_dl_fill_rect(list, line_rect, props->bg_color << 4);
+    }
+
+    int start_x = x;
+    uint32_t c;
+    while ((c = epd_next_code_point((const uint8_t**)&string))) {
+        // glyphs of font stacks come from the fonts of the stack
+        const EpdFont* glyph_font;
+        const EpdGlyph* glyph = epd_resolve_glyph(font, c, &glyph_font);
+        if (!glyph) {
+            glyph = epd_resolve_glyph(font, props->fallback_glyph, &glyph_font);
+        }
+        if (!glyph) {
+            err |= EPD_DRAW_GLYPH_FALLBACK_FAILED;
+            continue;
+        }
+
+        if (glyph->width > 0 && glyph->height > 0) {
+            const uint8_t* bitmap = glyph_bitmap(list, glyph_font, glyph);
+            DisplayListOp* op = NULL;
+            if (bitmap != NULL) {
+                int gx = x + glyph->left;
+                int gy = cursor_y - glyph->top;
+                op = add_op(list, DL_GLYPH, gx, gy, glyph->width, glyph->height);
+            }
+            if (op == NULL) {
+                return err | EPD_DRAW_FAILED_ALLOC;
+            }
+            op->glyph.bitmap = bitmap;
+            op->glyph.fg_color = props->fg_color;
+            op->glyph.bg_color = props->bg_color;
+            op->glyph.background = background;
+            op->glyph.bits_per_pixel = glyph_bits_per_pixel(glyph_font);
+        }
+        x += glyph->advance_x;
+    }
+
+    *cursor_x += x - start_x;
+    return err;
+}
+
+enum EpdDrawError epd_dl_write_string(
+    EpdDisplayList* list,
+    const EpdFont* font,
+    const char* string,
+    int* cursor_x,
+    int* cursor_y,
+    const EpdFontProperties* properties
+) {
+    char *token, *newstring, *tofree;
+    if (string == NULL) {
+        ESP_LOGE("epdiy", "cannot draw a NULL string!");
+        return EPD_DRAW_STRING_INVALID;
+    }
+    EpdFontProperties props = epd_font_properties_default();
+    if (properties != NULL) {
+        props = *properties;
+    }
+    tofree = newstring = strdup(string);
+    if (newstring == NULL) {
+        return EPD_DRAW_FAILED_ALLOC;
+    }
+
+    enum EpdDrawError err = EPD_DRAW_SUCCESS;
+    int line_start = *cursor_x;
+    while ((token = strsep(&newstring, "\n")) != NULL) {
+        *cursor_x = line_start;
+        err |= write_line(list, font, token, cursor_x, *cursor_y, &props);
+        *cursor_y += font->advance_y;
+    }
+
+    free(tofree);
+    return err;
+}
+
+/// Fill the pixels [x0, x1) of a line with a 4 bit color.
+static void fill_span(uint8_t* line, int x0, int x1, uint8_t color) {
+    if (x0 >= x1) {
+        return;
+    }
+    if (x0 % 2) {
+        line[x0 / 2] = (line[x0 / 2] & 0x0F) | (color << 4);
+        x0++;
+    }
+    if (x1 % 2 && x1 > x0) {
+        line[x1 / 2] = (line[x1 / 2] & 0xF0) | color;
+        x1--;
+    }
+    memset(line + x0 / 2, color * 0x11, (x1 - x0) / 2);
+}
+
+static void draw_glyph_rows(
+    const EpdDisplayList* list, const DisplayListOp* op, int y0, int y1, int y, uint8_t* buffer
+) {
+    int bpp = op->glyph.bits_per_pixel;
+    int max_value = (1 << bpp) - 1;
+    uint8_t color_lut[16];
+    int color_difference = (int)op->glyph.fg_color - (int)op->glyph.bg_color;
+    for (int v = 0; v <= max_value; v++) {
+        int coverage = v * 15 / max_value;
+        color_lut[v] = max(0, min(15, op->glyph.bg_color + coverage * color_difference / 15));
+    }
+
+    int byte_width = (op->width * bpp + 7) / 8;
+    int gx_start = max(0, -op->x);
+    int gx_end = min(op->width, list->width - op->x);
+    for (int row = y0; row < y1; row++) {
+        const uint8_t* src = op->glyph.bitmap + (row - op->y) * byte_width;
+        uint8_t* line = buffer + (row - y) * line_bytes(list);
+        for (int gx = gx_start; gx < gx_end; gx++) {
+            uint8_t value = (src[gx * bpp / 8] >> (gx * bpp % 8)) & max_value;
+            if (!value && !op->glyph.background) {
+                continue;
+            }
+            int x = op->x + gx;
+            int shift = x % 2 * 4;
+            line[x / 2] = (line[x / 2] & ~(0x0F << shift)) | (color_lut[value] << shift);
+        }
+    }
+}
+
+/**
+ * Rasterize the lines [y, y + height) of a list, using the given operations in order.
+ * If `op_indices` is NULL, the first `num_ops` operations are used.
+ */
+static void rasterize(
+    const EpdDisplayList* list,
+    const int* op_indices,
+    int num_ops,
+    int y,
+    int height,
+    uint8_t* buffer
+) {
+    int stride = line_bytes(list);
+    memset(buffer, list->background * 0x11, stride * height);
+
+    EpdBitmap band = {
+        .data = buffer,
+        .width = list->width,
+        .height = height,
+        .stride = stride,
+        .bpp = 4,
+    };
+
+    for (int i = 0; i < num_ops; i++) {
+        const DisplayListOp* op = &list->ops[op_indices != NULL ? op_indices[i] : i];
+        int y0 = max(op->y, y);
+        int y1 = min(op->y + op->height, y + height);
+        if (y0 >= y1) {
+            continue;
+        }
+
+        switch (op->type) {
+            case DL_FILL: {
+                int x0 = max(op->x, 0);
+                int x1 = min(op->x + op->width, list->width);
+                for (int row = y0; row < y1; row++) {
+                    fill_span(buffer + (row - y) * stride, x0, x1, op->color);
+                }
+                break;
+            }
+            case DL_IMAGE: {
+                EpdBitmap image = {
+                    .data = (uint8_t*)op->image.data,
+                    .width = op->width,
+                    .height = op->height,
+                    .stride = op->image.stride,
+                    .bpp = 4,
+                };
+                EpdRect src_rect = {
+                    .x = 0,
+                    .y = y0 - op->y,
+                    .width = op->width,
+                    .height = y1 - y0,
+                };
+                epd_blit(&band, op->x, y0 - y, &image, src_rect, op->image.op, op->image.param);
+                break;
+            }
+            case DL_GLYPH:
+                draw_glyph_rows(list, op, y0, y1, y, buffer);
+                break;
+        }
+    }
+}
+
+void epd_dl_rasterize(const EpdDisplayList* list, int y, int height, uint8_t* buffer) {
+    rasterize(list, NULL, list->num_ops, y, height, buffer);
+}
+
+static inline void rasterize_band_lines(
+    const BandRenderer* r, int band, int y, int height, uint8_t* buffer
+) {
+    const int* ops = &r->band_ops[r->band_start[band]];
+    int num_ops = r->band_start[band + 1] - r->band_start[band];
+    rasterize(r->list, ops, num_ops, y, height, buffer);
+}
+
+/**
+ * Claim the slot of a band and rasterize it,
+ * unless the band or a later one is already held by the slot.
+ */
+static void rasterize_band(BandRenderer* r, int band, int frame, int thread_id) {
+    if (band >= r->num_bands) {
+        return;
+    }
+    int key = frame * r->num_bands + band;
+    BandSlot* slot = &r->slots[band % NUM_BAND_SLOTS];
+    int state = atomic_load(&slot->state);
+    if (state >= key * 2 || !atomic_compare_exchange_strong(&slot->state, &state, key * 2)) {
+        return;
+    }
+
+    // wait until no other thread reads the replaced band
+    if (state >= 0) {
+        for (int t = 0; t < EPD_NUM_RENDER_THREADS; t++) {
+            while (t != thread_id && atomic_load(&r->reading[t]) == state / 2) {
+            }
+        }
+    }
+
+    int y = band * BAND_HEIGHT;
+    int height = min(BAND_HEIGHT, r->list->height - y);
+    rasterize_band_lines(r, band, y, height, slot->data);
+    atomic_store(&slot->state, key * 2 + 1);
+}
+
+const uint8_t* band_line_source(int row, int frame, int thread_id, void* arg) {
+    BandRenderer* r = arg;
+    int band = row / BAND_HEIGHT;
+    int key = frame * r->num_bands + band;
+    BandSlot* slot = &r->slots[band % NUM_BAND_SLOTS];
+
+    // announce the read before inspecting the slot, so it is not replaced while in use
+    atomic_store(&r->reading[thread_id], key);
+
+    while (true) {
+        int state = atomic_load(&slot->state);
+        if (state == key * 2 + 1) {
+            return slot->data + (row % BAND_HEIGHT) * line_bytes(r->list);
+        } else if (state == key * 2) {
+            // the other thread rasterizes this band, prepare the next one meanwhile
+            rasterize_band(r, band + 1, frame, thread_id);
+        } else if (state > key * 2) {
+            // this thread fell behind and the band was already replaced
+            uint8_t* line = r->line_buffers[thread_id];
+            rasterize_band_lines(r, band, row, 1, line);
+            return line;
+        } else {
+            rasterize_band(r, band, frame, thread_id);
+        }
+    }
+}
+
+/// Sort the operations into the bands they intersect.
+static enum EpdDrawError index_bands(BandRenderer* r) {
+    const EpdDisplayList* list = r->list;
+    r->band_start = calloc(r->num_bands + 1, sizeof(int));
+    if (r->band_start == NULL) {
+        return EPD_DRAW_FAILED_ALLOC;
+    }
+
+    // count the operations of each band, then place them
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < list->num_ops; i++) {
+            const DisplayListOp* op = &list->ops[i];
+            if (op->y + op->height <= 0) {
+                continue;
+            }
+            int first = max(op->y, 0) / BAND_HEIGHT;
+            int last = min(op->y + op->height - 1, list->height - 1) / BAND_HEIGHT;
+            for (int b = first; b <= last; b++) {
+                if (pass == 0) {
+                    r->band_start[b + 1]++;
+                } else {
+                    r->band_ops[r->band_start[b]++] = i;
+                }
+            }
+        }
+
+        if (pass == 0) {
+            for (int b = 0; b < r->num_bands; b++) {
+                r->band_start[b + 1] += r->band_start[b];
+            }
+            r->band_ops = malloc(max(1, r->band_start[r->num_bands]) * sizeof(int));
+            if (r->band_ops == NULL) {
+                return EPD_DRAW_FAILED_ALLOC;
+            }
+        } else {
+            // placing the operations moved each band start to the next band
+            memmove(&r->band_start[1], &r->band_start[0], r->num_bands * sizeof(int));
+            r->band_start[0] = 0;
+        }
+    }
+    return EPD_DRAW_SUCCESS;
+}
+
+BandRenderer* band_renderer_create(const EpdDisplayList* list) {
+    BandRenderer* r = calloc(1, sizeof(BandRenderer));
+    if (r == NULL) {
+        return NULL;
+    }
+    r->list = list;
+    r->num_bands = (list->height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+
+    enum EpdDrawError err = index_bands(r);
+    int band_size = BAND_HEIGHT * line_bytes(list);
+    for (int i = 0; i < NUM_BAND_SLOTS; i++) {
+        atomic_init(&r->slots[i].state, -1);
+        r->slots[i].data = heap_caps_malloc(band_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (r->slots[i].data == NULL) {
+            err |= EPD_DRAW_FAILED_ALLOC;
+        }
+    }
+    for (int t = 0; t < EPD_NUM_RENDER_THREADS; t++) {
+        atomic_init(&r->reading[t], -1);
+        r->line_buffers[t]
+            = heap_caps_malloc(line_bytes(list), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (r->line_buffers[t] == NULL) {
+            err |= EPD_DRAW_FAILED_ALLOC;
+        }
+    }
+
+    if (err != EPD_DRAW_SUCCESS) {
+        band_renderer_free(r);
+        return NULL;
+    }
+    return r;
+}
+
+void band_renderer_free(BandRenderer* r) {
+    for (int i = 0; i < NUM_BAND_SLOTS; i++) {
+        heap_caps_free(r->slots[i].data);
+    }
+    for (int t = 0; t < EPD_NUM_RENDER_THREADS; t++) {
+        heap_caps_free(r->line_buffers[t]);
+    }
+    free(r->band_ops);
+    free(r->band_start);
+    free(r);
+}
+
+enum EpdDrawError epd_dl_draw(
+    const EpdDisplayList* list,
+    enum EpdDrawMode mode,
+    int temperature,
+    const EpdWaveform* waveform
+) {
+    assert(list != NULL);
+    if (list->width != epd_width() || list->height != epd_height()) {
+        ESP_LOGE("epdiy", "display list size does not match the display!");
+        return EPD_DRAW_INVALID_CROP;
+    }
+
+    int min_y = list->height, max_y = 0;
+    for (int i = 0; i < list->num_ops; i++) {
+        min_y = min(min_y, list->ops[i].y);
+        max_y = max(max_y, list->ops[i].y + list->ops[i].height);
+    }
+    min_y = max(min_y, 0);
+    max_y = min(max_y, list->height);
+    if (min_y >= max_y) {
+        return EPD_DRAW_SUCCESS;
+    }
+
+    BandRenderer* renderer = band_renderer_create(list);
+    if (renderer == NULL) {
+        return EPD_DRAW_FAILED_ALLOC;
+    }
+
+    EpdRect area = { .x = 0, .y = 0, .width = list->width, .height = list->height };
+    EpdRect crop_to = { .x = 0, .y = min_y, .width = list->width, .height = max_y - min_y };
+    mode &= ~(MODE_PACKING_8PPB | MODE_PACKING_1PPB_DIFFERENCE);
+    enum EpdDrawError err = epd_draw_line_source(
+        area,
+        band_line_source,
+        renderer,
+        crop_to,
+        mode | MODE_PACKING_2PPB,
+        temperature,
+        NULL,
+        NULL,
+        waveform,
+        NULL
+    );
+
+    band_renderer_free(renderer);
+    return err;
+}
@@ -0,0 +1,28 @@
+/**
+ * Band renderer of display lists, the line source used by `epd_dl_draw()`.
+ */
+
+#pragma once
+
+#include "epd_display_list.h"
+
+/// Rasterizes the bands of a display list on demand, see `display_list.c`.
+typedef struct BandRenderer BandRenderer;
+
+/**
+ * Create a band renderer for a display list.
+ * The list must not be modified while the renderer is in use.
+ * Returns NULL if memory allocation fails.
+ */
+BandRenderer* band_renderer_create(const EpdDisplayList* list);
+
+/**
+ * Free a band renderer.
+ */
+void band_renderer_free(BandRenderer* renderer);
+
+/**
+ * Line source providing the 4 bit per pixel rows of the display list of a band renderer,
+ * which is passed as `arg`. See `EpdLineSource`.
+ */
+const uint8_t* band_line_source(int row, int frame, int thread_id, void* arg);
@@ -0,0 +1,252 @@
+/**
+ * Row by row dithering to 4bpp and 1bpp.
+ *
+ * Ordered dithering adds a threshold from a 16x16 pattern to each pixel before quantization.
+ * This is independent for every pixel, so multiple pixels are processed in one 32-bit word:
+ * Two 16-bit lanes for 4bpp, and four 8-bit lanes for 1bpp, where the quantized value
+ * is just the carry of adding the threshold.
+ * Error diffusion keeps the errors for the current and the following rows in a ring of rows.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "epd_dither.h"
+
+/// Size of the ordered dithering patterns.
+#define PATTERN_SIZE 16
+/// Rows of diffused errors: The current row and the rows reached by the diffusion kernels.
+#define ERROR_ROWS 3
+/// Margin of the error rows, so the kernels need no bounds checks.
+#define ERROR_MARGIN 2
+
+struct EpdDither {
+    enum EpdDitherMethod method;
+    int width;
+    int bpp;
+    /// Index of the next row.
+    int row;
+    /// Threshold of each pattern position in [0, 254], added before quantization.
+    uint8_t thresholds[PATTERN_SIZE * PATTERN_SIZE];
+    /// Errors diffused to the current row and the following rows.
+    int16_t* errors[ERROR_ROWS];
+};
+
+/// Ranks of a 16x16 blue noise pattern, generated with the void-and-cluster method.
+static const uint8_t blue_noise_ranks[PATTERN_SIZE * PATTERN_SIZE] = {
+    234, 50,  188, 19,  58,  171, 121, 47,  163, 1,   247, 104, 22,  132, 14,  65,
+    209, 8,   118, 97,  240, 205, 23,  228, 138, 64,  123, 170, 72,  224, 99,  149,
+    85,  139, 229, 165, 78,  146, 111, 84,  176, 216, 30,  231, 153, 201, 42,  180,
+    25,  62,  195, 29,  43,  185, 7,   249, 41,  100, 191, 48,  87,  5,   128, 243,
+    221, 152, 101, 253, 130, 220, 59,  200, 156, 12,  136, 112, 255, 174, 69,  109,
+    46,  189, 0,   73,  172, 90,  142, 116, 80,  237, 210, 61,  147, 33,  206, 160,
+    81,  124, 217, 113, 208, 15,  241, 27,  168, 45,  178, 20,  193, 96,  225, 18,
+    242, 164, 60,  35,  157, 53,  181, 68,  223, 105, 125, 83,  236, 131, 55,  141,
+    197, 10,  227, 134, 246, 95,  126, 198, 148, 3,   244, 161, 71,  9,   182, 106,
+    40,  93,  179, 75,  192, 6,   218, 36,  91,  57,  202, 34,  215, 155, 233, 74,
+    252, 120, 150, 24,  110, 63,  166, 119, 232, 183, 133, 103, 49,  117, 31,  167,
+    16,  212, 51,  238, 207, 137, 254, 21,  76,  151, 13,  250, 190, 88,  203, 135,
+    102, 184, 82,  169, 38,  89,  187, 52,  204, 98,  173, 67,  129, 4,   222, 56,
+    230, 144, 2,   127, 226, 11,  154, 114, 239, 39,  219, 28,  235, 145, 175, 77,
+    196, 37,  248, 70,  107, 199, 66,  177, 17,  143, 115, 159, 86,  44,  108, 26,
+    122, 92,  158, 214, 140, 32,  245, 94,  213, 79,  194, 54,  211, 186, 251, 162,
+};
+
+static inline uint32_t load32(const uint8_t* ptr) {
+    uint32_t value;
+    memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+/// Divide `x` in [0, 65534] by 255.
+static inline uint32_t div255(uint32_t x) {
+    return (x + 1 + (x >> 8)) >> 8;
+}
+
+/// Rank of a position in the 8x8 Bayer matrix, from interleaving the bits of `x ^ y` and `y`.
+static int bayer_rank(int x, int y) {
+    int rank = 0;
+    for (int bit = 0; bit < 3; bit++) {
+        rank = (rank << 2) | (((x ^ y) >> bit) & 1) << 1 | ((y >> bit) & 1);
+    }
+    return rank;
+}
+
+/// Center the threshold of a pattern rank between the quantization steps.
+static inline uint8_t rank_threshold(int rank, int num_ranks) {
+    return (2 * rank + 1) * 255 / (2 * num_ranks);
+}
+
+EpdDither* epd_dither_create(int width, int bpp, enum EpdDitherMethod method) {
+    if (width <= 0 || (bpp != 4 && bpp != 1) || method > EPD_DITHER_ATKINSON) {
+        return NULL;
+    }
+
+    EpdDither* dither = calloc(1, sizeof(EpdDither));
+    if (dither == NULL) {
+        return NULL;
+    }
+    dither->method = method;
+    dither->width = width;
+    dither->bpp = bpp;
+
+    for (int y = 0; y < PATTERN_SIZE; y++) {
+        for (int x = 0; x < PATTERN_SIZE; x++) {
+            uint8_t* threshold = &dither->thresholds[y * PATTERN_SIZE + x];
+            if (method == EPD_DITHER_BAYER) {
+                *threshold = rank_threshold(bayer_rank(x % 8, y % 8), 64);
+            } else if (method == EPD_DITHER_BLUE_NOISE) {
+                *threshold = rank_threshold(blue_noise_ranks[y * PATTERN_SIZE + x], 256);
+            } else {
+                *threshold = 127;
+            }
+        }
+    }
+
+    if (method == EPD_DITHER_FLOYD_STEINBERG || method == EPD_DITHER_ATKINSON) {
+        for (int i = 0; i < ERROR_ROWS; i++) {
+            dither->errors[i] = calloc(width + 2 * ERROR_MARGIN, sizeof(int16_t));
+            if (dither->errors[i] == NULL) {
+                epd_dither_free(dither);
+                return NULL;
+            }
+        }
+    }
+    return dither;
+}
+
+void epd_dither_free(EpdDither* dither) {
+    if (dither == NULL) {
+        return;
+    }
+    for (int i = 0; i < ERROR_ROWS; i++) {
+        free(dither->errors[i]);
+    }
+    free(dither);
+}
+
+void epd_dither_reset(EpdDither* dither) {
+    dither->row = 0;
+    for (int i = 0; i < ERROR_ROWS; i++) {
+        if (dither->errors[i] != NULL) {
+            memset(dither->errors[i], 0, (dither->width + 2 * ERROR_MARGIN) * sizeof(int16_t));
+        }
+    }
+}
+
+/// Ordered dithering to 4bpp, two pixels at a time in 16-bit lanes.
+static void ordered_row_4bpp(const EpdDither* dither, const uint8_t* gray, uint8_t* output) {
+    const uint8_t* thresholds = dither->thresholds + (dither->row % PATTERN_SIZE) * PATTERN_SIZE;
+    int x = 0;
+    for (; x + 2 <= dither->width; x += 2) {
+        uint32_t v = gray[x] | (gray[x + 1] << 16);
+        int t = x % PATTERN_SIZE;
+        uint32_t s = v * 15 + (thresholds[t] | (thresholds[t + 1] << 16));
+        // `div255()` in both lanes, no lane exceeds 15 * 255 + 254 + 1 + 15 < 2^16
+        uint32_t q = ((s + 0x00010001 + ((s >> 8) & 0x00FF00FF)) >> 8) & 0x000F000F;
+        output[x / 2] = q | (q >> 12);
+    }
+    if (x < dither->width) {
+        output[x / 2] = div255(gray[x] * 15 + thresholds[x % PATTERN_SIZE]);
+    }
+}
+
+/// Ordered dithering to 1bpp, four pixels at a time in 8-bit lanes.
+static void ordered_row_1bpp(const EpdDither* dither, const uint8_t* gray, uint8_t* output) {
+    const uint8_t* thresholds = dither->thresholds + (dither->row % PATTERN_SIZE) * PATTERN_SIZE;
+    int width = dither->width;
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        uint8_t byte = 0;
+        for (int half = 0; half < 2; half++) {
+            // a pixel is white if `gray + threshold >= 255`, the carry of adding `threshold + 1`
+            uint32_t a = load32(gray + x + 4 * half);
+            uint32_t b = load32(thresholds + (x + 4 * half) % PATTERN_SIZE) + 0x01010101;
+            uint32_t sum = (a & 0x7F7F7F7F) + (b & 0x7F7F7F7F);
+            uint32_t carry = ((a & b) | ((a | b) & sum)) & 0x80808080;
+            uint8_t bits = ((carry >> 7) & 1) | ((carry >> 14) & 2) | ((carry >> 21) & 4)
+                           | ((carry >> 28) & 8);
+            byte |= bits << (4 * half);
+        }
+        output[x / 8] = byte;
+    }
+    if (x < width) {
+        uint8_t byte = 0;
+        for (int i = 0; x + i < width; i++) {
+            byte |= (gray[x + i] + thresholds[(x + i) % PATTERN_SIZE] >= 255) << i;
+        }
+        output[x / 8] = byte;
+    }
+}
+
+/// Error diffusion, scanning rows in alternating directions.
+static void diffuse_row(EpdDither* dither, const uint8_t* gray, uint8_t* output) {
+    int width = dither->width;
+    int levels = dither->bpp == 4 ? 15 : 1;
+    int16_t* current = dither->errors[0] + ERROR_MARGIN;
+    int16_t* next = dither->errors[1] + ERROR_MARGIN;
+    int16_t* after_next = dither->errors[2] + ERROR_MARGIN;
+    bool atkinson = dither->method == EPD_DITHER_ATKINSON;
+
+    memset(output, 0, (width * dither->bpp + 7) / 8);
+
+    int dir = dither->row % 2 ? -1 : 1;
+    int x = dir > 0 ? 0 : width - 1;
+    for (int i = 0; i < width; i++, x += dir) {
+        int value = gray[x] + current[x];
+        int clamped = value < 0 ? 0 : (value > 255 ? 255 : value);
+        int level = div255(clamped * levels + 127);
+        int error = value - level * 255 / levels;
+
+        if (dither->bpp == 4) {
+            output[x / 2] |= level << (x % 2 * 4);
+        } else {
+            output[x / 8] |= level << (x % 8);
+        }
+
+        if (atkinson) {
+            // round, since truncating the small parts would stall the diffusion in flat areas
+            int e = (error + (error < 0 ? -4 : 4)) / 8;
+            current[x + dir] += e;
+            current[x + 2 * dir] += e;
+            next[x - dir] += e;
+            next[x] += e;
+            next[x + dir] += e;
+            after_next[x] += e;
+        } else {
+            int e7 = error * 7 / 16;
+            int e3 = error * 3 / 16;
+            int e5 = error * 5 / 16;
+            current[x + dir] += e7;
+            next[x - dir] += e3;
+            next[x] += e5;
+            next[x + dir] += error - e7 - e3 - e5;
+        }
+    }
+
+    // the current row becomes the last row of the ring
+    int16_t* done = dither->errors[0];
+    memset(done, 0, (width + 2 * ERROR_MARGIN) * sizeof(int16_t));
+    for (int i = 0; i < ERROR_ROWS - 1; i++) {
+        dither->errors[i] = dither->errors[i + 1];
+    }
+    dither->errors[ERROR_ROWS - 1] = done;
+}
+
+void epd_dither_row(EpdDither* dither, const uint8_t* gray, uint8_t* output) {
+    switch (dither->method) {
+        case EPD_DITHER_FLOYD_STEINBERG:
+        case EPD_DITHER_ATKINSON:
+            diffuse_row(dither, gray, output);
+            break;
+        default:
+            if (dither->bpp == 4) {
+                ordered_row_4bpp(dither, gray, output);
+            } else {
+                ordered_row_1bpp(dither, gray, output);
+            }
+            break;
+    }
+    dither->row++;
+}
@@ -42,6 +42,16 @@ typedef struct {
      * Enable power to the display.
      */
     void (*poweron)(epd_ctrl_state_t*);
+    /**
+     * Start enabling power to the display and return without waiting for the power rails.
+     * Optional, boards without it are powered on by `poweron`.
+     */
+    void (*poweron_start)(epd_ctrl_state_t*);
+    /**
+     * Wait for the power rails after `poweron_start` and finish enabling power.
+     * Returns false if the power rails did not come up.
+     */
+    bool (*poweron_finish)(epd_ctrl_state_t*);
 
     /**
      * Measure VCOM kick-back. Only in v6 & v7 boards!
@@ -0,0 +1,95 @@
+/**
+ * @file "epd_convert.h"
+ * @brief Conversion of decoded image rows to gray values and packed 4 bit pixels.
+ *
+ * Image decoders usually produce RGB888, RGB565 or 8 bit gray pixels.
+ * These functions convert such rows to 8 bit gray values, optionally through a tone curve,
+ * which can then be dithered with `epd_dither_row()`, or directly to 4 bit per pixel rows
+ * for `epd_draw_rotated_image()` and `epd_copy_to_framebuffer()`:
+ *
+ * 		uint8_t tone_curve[256];
+ * 		epd_tone_curve(tone_curve, 0.7, 0, 255, false);
+ *
+ * 		for (int y = 0; y < image_height; y++) {
+ * 			const uint8_t* rgb_row = decoded_image + y * image_width * 3;
+ * 			epd_convert_to_4bpp(rgb_row, EPD_PIXEL_RGB888, image_width, tone_curve, packed_row);
+ * 			// draw packed_row
+ * 		}
+ *
+ * Luma is computed from RGB with the weights `(38 * r + 75 * g + 15 * b) / 128`.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Pixel formats of image rows.
+enum EpdPixelFormat {
+    /// One gray value per byte, 0 is black.
+    EPD_PIXEL_GRAY8 = 0,
+    /// Three bytes per pixel in the order red, green, blue.
+    EPD_PIXEL_RGB888 = 1,
+    /// 16 bit pixels with 5 bits red, 6 bits green and 5 bits blue, little endian.
+    EPD_PIXEL_RGB565 = 2,
+    /// Like `EPD_PIXEL_RGB565`, but big endian, as produced for many SPI displays.
+    EPD_PIXEL_RGB565_BE = 3,
+};
+
+/**
+ * Build a tone curve lookup table for the conversion functions.
+ *
+ * @param curve: The 256 byte table to fill.
+ * @param gamma: The gray values are raised to the power of `1 / gamma`,
+ *      so values below 1 darken and values above 1 lighten the mid tones.
+ * @param black_level: Input value that is mapped to black, darker values are clipped.
+ * @param white_level: Input value that is mapped to white, lighter values are clipped.
+ * @param invert: Invert the output, e.g. for negative images.
+ */
+void epd_tone_curve(
+    uint8_t* curve, float gamma, uint8_t black_level, uint8_t white_level, bool invert
+);
+
+/**
+ * Convert a row of pixels to 8 bit gray values.
+ *
+ * @param input: The input row.
+ * @param format: The pixel format of the input row.
+ * @param width: The number of pixels in the row.
+ * @param tone_curve: A tone curve from `epd_tone_curve()`, or NULL.
+ * @param output: Output buffer for `width` gray values.
+ */
+void epd_convert_to_gray8(
+    const uint8_t* input,
+    enum EpdPixelFormat format,
+    int width,
+    const uint8_t* tone_curve,
+    uint8_t* output
+);
+
+/**
+ * Convert a row of pixels to packed 4 bit gray values, like framebuffer lines:
+ * The first pixel of a byte is in its lower nibble, gray values are truncated to their
+ * upper 4 bits, as for the drawing functions. For odd widths, the last upper nibble is zero.
+ *
+ * @param input: The input row.
+ * @param format: The pixel format of the input row.
+ * @param width: The number of pixels in the row.
+ * @param tone_curve: A tone curve from `epd_tone_curve()`, or NULL.
+ * @param output: Output buffer of `(width + 1) / 2` bytes.
+ */
+void epd_convert_to_4bpp(
+    const uint8_t* input,
+    enum EpdPixelFormat format,
+    int width,
+    const uint8_t* tone_curve,
+    uint8_t* output
+);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,146 @@
+/**
+ * @file "epd_display_list.h"
+ * @brief Drawing without a framebuffer.
+ *
+ * A display list records drawing operations instead of executing them on a framebuffer.
+ * When the list is drawn, it is rasterized in bands of a few lines, which are held in
+ * small internal RAM buffers and fed to the display as they are needed.
+ * Both render threads rasterize bands in parallel where the output method allows for it.
+ * This allows to draw to large displays and on boards without PSRAM:
+ *
+ * 		EpdDisplayList* list = epd_dl_create(epd_width(), epd_height(), 0xF0);
+ *
+ * 		EpdRect some_rect = { .x = 100, .y = 100, .width = 100, .height = 100 };
+ * 		epd_dl_fill_rect(list, some_rect, 0x0);
+ *
+ * 		int cursor_x = 100;
+ * 		int cursor_y = 300;
+ * 		epd_dl_write_string(list, &FiraSans, "Hello, World!", &cursor_x, &cursor_y, NULL);
+ *
+ * 		epd_poweron();
+ * 		epd_dl_draw(list, MODE_GC16 | PREVIOUSLY_WHITE, temperature, EPD_BUILTIN_WAVEFORM);
+ * 		epd_poweroff();
+ *
+ * 		epd_dl_free(list);
+ *
+ * Since the list does not know the previous display content, it is drawn like
+ * a 2 pixel per byte image in `epd_draw_base()`, assuming a previously white or black display.
+ * Colors use the upper nibble of a byte, as for the framebuffer drawing functions.
+ * Coordinates are given in the native display orientation and must fit 16 bits.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "epdiy.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// A recorded list of drawing operations. Create with `epd_dl_create()`.
+typedef struct EpdDisplayList EpdDisplayList;
+
+/**
+ * Create an empty display list.
+ *
+ * @param width: Width of the drawn area, must be the display width for `epd_dl_draw()`.
+ * @param height: Height of the drawn area, must be the display height for `epd_dl_draw()`.
+ * @param background: The color of pixels not covered by any operation.
+ * @returns The new display list, or NULL if the allocation failed.
+ */
+EpdDisplayList* epd_dl_create(int width, int height, uint8_t background);
+
+/**
+ * Free a display list and all of its recorded operations.
+ */
+void epd_dl_free(EpdDisplayList* list);
+
+/**
+ * Remove all recorded operations from a display list.
+ */
+void epd_dl_clear(EpdDisplayList* list);
+
+/**
+ * Record filling a rectangle with a color.
+ */
+enum EpdDrawError epd_dl_fill_rect(EpdDisplayList* list, EpdRect rect, uint8_t color);
+
+/**
+ * Record drawing a horizontal line.
+ */
+enum EpdDrawError epd_dl_draw_hline(EpdDisplayList* list, int x, int y, int length, uint8_t color);
+
+/**
+ * Record drawing a vertical line.
+ */
+enum EpdDrawError epd_dl_draw_vline(EpdDisplayList* list, int x, int y, int length, uint8_t color);
+
+/**
+ * Record drawing the outline of a rectangle.
+ */
+enum EpdDrawError epd_dl_draw_rect(EpdDisplayList* list, EpdRect rect, uint8_t color);
+
+/**
+ * Record combining an image with the drawn content, as with `epd_blit()`.
+ * Only a reference to the image data is recorded, it must stay valid while the list is in use.
+ *
+ * @param image: The image, must use 4 bits per pixel.
+ * @param x: Horizontal position of the image.
+ * @param y: Vertical position of the image.
+ * @param op: The raster operation to combine the image with.
+ * @param param: Parameter of the raster operation, see `EpdRasterOp`.
+ */
+enum EpdDrawError epd_dl_draw_image(
+    EpdDisplayList* list,
+    const EpdBitmap* image,
+    int x,
+    int y,
+    enum EpdRasterOp op,
+    uint8_t param
+);
+
+/**
+ * Record writing a (multi-line) string, like `epd_write_string()`.
+ * Glyph bitmaps of uncompressed fonts are referenced, bitmaps of compressed fonts
+ * and fonts read from storage are loaded once for each distinct glyph and kept with the list.
+ *
+ * @param properties: The font properties, or NULL for the defaults.
+ */
+enum EpdDrawError epd_dl_write_string(
+    EpdDisplayList* list,
+    const EpdFont* font,
+    const char* string,
+    int* cursor_x,
+    int* cursor_y,
+    const EpdFontProperties* properties
+);
+
+/**
+ * Rasterize lines of a display list into a 4 bit per pixel buffer.
+ *
+ * @param y: The first line to rasterize.
+ * @param height: The number of lines to rasterize.
+ * @param buffer: Output buffer of `height` lines, with `(width + 1) / 2` bytes each.
+ */
+void epd_dl_rasterize(const EpdDisplayList* list, int y, int height, uint8_t* buffer);
+
+/**
+ * Draw a display list to the screen.
+ * Only lines covered by recorded operations are updated.
+ *
+ * @param mode: The draw mode, including `PREVIOUSLY_WHITE` or `PREVIOUSLY_BLACK`.
+ *      The packing mode is always `MODE_PACKING_2PPB`.
+ * @param temperature: The environmental temperature in °C.
+ * @param waveform: The waveform to use, e.g. `EPD_BUILTIN_WAVEFORM`.
+ */
+enum EpdDrawError epd_dl_draw(
+    const EpdDisplayList* list,
+    enum EpdDrawMode mode,
+    int temperature,
+    const EpdWaveform* waveform
+);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,80 @@
+/**
+ * @file "epd_dither.h"
+ * @brief Row by row dithering of 8 bit grayscale images.
+ *
+ * A ditherer converts an image of 8 bit gray values to 4 bit or 1 bit per pixel rows,
+ * one row at a time. Error diffusion only keeps the errors of the next rows,
+ * so images can be dithered while they are decoded, without a full 8 bit image buffer:
+ *
+ * 		EpdDither* dither = epd_dither_create(image_width, 4, EPD_DITHER_FLOYD_STEINBERG);
+ *
+ * 		for (int y = 0; y < image_height; y++) {
+ * 			// fill gray_row with the next row of the image
+ * 			epd_dither_row(dither, gray_row, packed_row);
+ * 			EpdRect row_area = { .x = 0, .y = y, .width = image_width, .height = 1 };
+ * 			epd_draw_rotated_image(row_area, packed_row, framebuffer);
+ * 		}
+ *
+ * 		epd_dither_free(dither);
+ *
+ * Output rows are packed like framebuffer lines: The first pixel of a byte is in
+ * its lower nibble (4 bit) or least significant bit (1 bit), a set bit is white.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Dithering methods.
+enum EpdDitherMethod {
+    /// Round every pixel to the closest output value.
+    EPD_DITHER_NONE = 0,
+    /// Ordered dithering with an 8x8 Bayer matrix.
+    EPD_DITHER_BAYER = 1,
+    /// Ordered dithering with a 16x16 blue noise pattern, which has less visible structure.
+    EPD_DITHER_BLUE_NOISE = 2,
+    /// Floyd-Steinberg error diffusion, on alternating row directions.
+    EPD_DITHER_FLOYD_STEINBERG = 3,
+    /// Atkinson error diffusion, which keeps more contrast by only diffusing 3/4 of the error.
+    EPD_DITHER_ATKINSON = 4,
+};
+
+/// State of a ditherer. Create with `epd_dither_create()`.
+typedef struct EpdDither EpdDither;
+
+/**
+ * Create a ditherer.
+ *
+ * @param width: Width of the image in pixels.
+ * @param bpp: Bits per output pixel, 4 or 1.
+ * @param method: The dithering method.
+ * @returns The new ditherer, or NULL if the allocation failed or the parameters are invalid.
+ */
+EpdDither* epd_dither_create(int width, int bpp, enum EpdDitherMethod method);
+
+/**
+ * Free a ditherer.
+ */
+void epd_dither_free(EpdDither* dither);
+
+/**
+ * Start a new image: Reset the row position and forget all diffused errors.
+ */
+void epd_dither_reset(EpdDither* dither);
+
+/**
+ * Dither the next row of the image.
+ *
+ * @param gray: The row of `width` gray values, 0 is black, 255 is white.
+ * @param output: Output buffer for the packed row of `(width * bpp + 7) / 8` bytes.
+ *      Bits beyond the image width are set to zero.
+ */
+void epd_dither_row(EpdDither* dither, const uint8_t* gray, uint8_t* output);
+
+#ifdef __cplusplus
+}
+#endif
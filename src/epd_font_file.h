@@ -0,0 +1,84 @@
+/**
+ * @file "epd_font_file.h"
+ * @brief Fonts loaded at runtime from binary font files.
+ *
+ * `scripts/fontconvert.py --binary` writes a font as a binary file instead of a C header.
+ * Such a font can be stored in a data partition, on a file system or anywhere in memory,
+ * so fonts and languages can be added without growing or reflashing the application:
+ *
+ * 		// partitions.csv: fonts, data, spiffs, , 4M
+ * 		// parttool.py write_partition --partition-name fonts --input NotoSansCJK.epdfont
+ * 		const EpdFont* font = epd_font_map_partition("fonts");
+ * 		epd_write_default(font, "你好", &cursor_x, &cursor_y, framebuffer);
+ *
+ * Fonts in partitions are memory mapped, so glyph data is only fetched from flash
+ * when it is used. Partitions that are too large to be mapped, and font files,
+ * are read glyph by glyph on demand, through the glyph cache (see `epd_glyph_cache_configure()`).
+ *
+ * The file format (version 1) is little endian, all sections are aligned to 4 bytes:
+ *
+ * | Offset | Size                  | Content                                            |
+ * |--------|-----------------------|----------------------------------------------------|
+ * | 0      | 4                     | Magic "EPDF"                                       |
+ * | 4      | 2                     | Format version                                     |
+ * | 6      | 2                     | Flags, bits 0-1: `EpdGlyphCompression` of glyphs   |
+ * | 8      | 2, 2, 2               | advance_y, ascender, descender (signed)            |
+ * | 14     | 2                     | Bits per pixel: 1, 2 or 4 (0 is read as 4)         |
+ * | 16     | 4, 4                  | Number of intervals, number of glyphs              |
+ * | 24     | 4, 4, 4               | Offsets of the intervals, glyphs and direct index  |
+ * | 36     | 4, 4                  | Offset and size of the glyph bitmaps               |
+ * | ...    | 12 per interval       | `EpdUnicodeInterval` array                         |
+ * | ...    | 20 per glyph          | `EpdGlyph` array                                   |
+ * | ...    | 512                   | `EpdFont.direct_index`, if its offset is not 0     |
+ * | ...    | bitmap size           | Glyph bitmaps                                      |
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "epd_internals.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Use a binary font in memory, e.g. embedded with `EMBED_FILES` or downloaded to PSRAM.
+ * The font refers to the data, which must stay valid and be aligned to 4 bytes.
+ *
+ * @returns The font, or NULL if the data is not a valid font. Release it with `epd_font_close()`.
+ */
+const EpdFont* epd_font_from_memory(const uint8_t* data, size_t size);
+
+/**
+ * Use a binary font stored in a data partition.
+ * The partition is memory mapped if possible, otherwise the font tables are loaded
+ * into memory and glyphs are read from flash when they are drawn.
+ *
+ * @param label: The label of the partition.
+ * @returns The font, or NULL if the partition does not exist or does not hold a valid font.
+ *      Release it with `epd_font_close()`.
+ */
+const EpdFont* epd_font_map_partition(const char* label);
+
+/**
+ * Use a binary font file, e.g. from an SD card.
+ * The font tables are loaded into memory, and glyphs are read from the file
+ * when they are drawn, so the file must stay accessible until the font is closed.
+ *
+ * @returns The font, or NULL if the file cannot be read or is not a valid font.
+ *      Release it with `epd_font_close()`.
+ */
+const EpdFont* epd_font_open_file(const char* path);
+
+/**
+ * Release a font from `epd_font_from_memory()`, `epd_font_map_partition()`
+ * or `epd_font_open_file()`, and its cached glyphs.
+ */
+void epd_font_close(const EpdFont* font);
+
+#ifdef __cplusplus
+}
+#endif
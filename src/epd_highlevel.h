@@ -81,6 +81,14 @@ typedef struct {
     bool* dirty_lines;
     /// Tainted column nibbles based on the last difference calculation.
     uint8_t* dirty_columns;
+    /// Transitions occurring in the last difference calculation.
+    EpdTransitionHistogram* transitions;
+    /// Per-line transition masks of the last difference calculation.
+    uint32_t* line_transitions;
+    /// Pixels left in an unknown state by aborted updates, one bit per pixel.
+    uint8_t* indeterminate_mask;
+    /// Whether any pixel is marked in `indeterminate_mask`.
+    bool indeterminate_pending;
     /// The waveform information to use.
     const EpdWaveform* waveform;
 } EpdiyHighlevelState;
@@ -104,7 +112,9 @@ uint8_t* epd_hl_get_framebuffer(EpdiyHighlevelState* state);
 /**
  * Update the EPD screen to match the content of the front frame buffer.
  * Prior to this, power to the display must be enabled via `epd_poweron()`
- * and should be disabled afterwards if no immediate additional updates follow.
+ * or `epd_poweron_async()`, and should be disabled afterwards if no immediate
+ * additional updates follow. Alternatively, hold a power request of
+ * `epd_power_acquire()`, which keeps the power on for updates in quick succession.
  *
  * @param state: A reference to the `EpdiyHighlevelState` object used.
  * @param mode: The update mode to use.
@@ -122,13 +132,19 @@ enum EpdDrawError epd_hl_update_screen(
  * Update an area of the screen to match the content of the front framebuffer.
  * Supplying a small area to update can speed up the update process.
  * Prior to this, power to the display must be enabled via `epd_poweron()`
- * and should be disabled afterwards if no immediate additional updates follow.
+ * or `epd_poweron_async()`, and should be disabled afterwards if no immediate
+ * additional updates follow. Alternatively, hold a power request of
+ * `epd_power_acquire()`, which keeps the power on for updates in quick succession.
  *
  * @param state: A reference to the `EpdiyHighlevelState` object used.
  * @param mode: See `epd_hl_update_screen()`.
  * @param temperature: Environmental temperature of the display in °C.
  * @param area: Area of the screen to update.
  * @returns `EPD_DRAW_SUCCESS` on sucess, a combination of error flags otherwise.
+ *      If the update is aborted (`EPD_DRAW_ABORTED`), the back framebuffer is set to the
+ *      actual display state. Pixels left in an unknown state are fully redrawn
+ *      by the next update of their area. If the power rails did not come up
+ *      (`EPD_DRAW_POWER_FAILED`), the back framebuffer is left unchanged.
  */
 enum EpdDrawError epd_hl_update_area(
     EpdiyHighlevelState* state, enum EpdDrawMode mode, int temperature, EpdRect area
@@ -152,6 +168,76 @@ void epd_fullclear(EpdiyHighlevelState* state, int temperature);
  */
 void epd_hl_waveform(EpdiyHighlevelState* state, const EpdWaveform* waveform);
 
+/// Holds the internal state of the monochrome high-level API.
+typedef struct {
+    /// The "front" framebuffer object, with one bit per pixel.
+    uint8_t* front_fb;
+    /// The "back" framebuffer object, with one bit per pixel.
+    uint8_t* back_fb;
+    /// Lines with pixels to darken, followed by lines with pixels to lighten.
+    bool* dirty_lines;
+    /// Column mask of the updated area, followed by an output line for each render thread.
+    uint8_t* line_buffers;
+    /// The waveform information to use.
+    const EpdWaveform* waveform;
+} EpdiyMonoState;
+
+/**
+ * Initialize a monochrome state object.
+ * Like `epd_hl_init()`, but with 1 bit per pixel framebuffers which are drawn to with
+ * the monochrome drawing functions of `epdiy.h`, such as `epd_fill_rect_mono()`.
+ * The framebuffers are 8 times smaller than for the grayscale state,
+ * and no difference image is needed, so PSRAM is not required.
+ *
+ * @param waveform: The waveform to use for updates.
+ * 		If you did not create your own, this will be `EPD_BUILTIN_WAVEFORM`.
+ * @returns An initialized state object.
+ */
+EpdiyMonoState epd_hl_mono_init(const EpdWaveform* waveform);
+
+/// Get a reference to the front framebuffer of a monochrome state.
+uint8_t* epd_hl_mono_get_framebuffer(EpdiyMonoState* state);
+
+/**
+ * Update the EPD screen to match the content of the monochrome front framebuffer.
+ *
+ * @param state: A reference to the `EpdiyMonoState` object used.
+ * @param mode: The update mode to use, e.g. `MODE_DU` or `MODE_EPDIY_MONOCHROME`.
+ *      The framebuffer format and previous display state are determined by the driver.
+ * @param temperature: Environmental temperature of the display in °C.
+ * @returns `EPD_DRAW_SUCCESS` on sucess, a combination of error flags otherwise.
+ */
+enum EpdDrawError epd_hl_mono_update_screen(
+    EpdiyMonoState* state, enum EpdDrawMode mode, int temperature
+);
+
+/**
+ * Update an area of the screen to match the content of the monochrome front framebuffer.
+ * Pixels to darken and pixels to lighten are driven in two separate passes,
+ * only lines which contain changed pixels are updated.
+ *
+ * @param state: A reference to the `EpdiyMonoState` object used.
+ * @param mode: See `epd_hl_mono_update_screen()`.
+ * @param temperature: Environmental temperature of the display in °C.
+ * @param area: Area of the screen to update.
+ * @returns `EPD_DRAW_SUCCESS` on sucess, a combination of error flags otherwise.
+ *      If a pass is aborted, the pixels it drives are driven again by the next update.
+ */
+enum EpdDrawError epd_hl_mono_update_area(
+    EpdiyMonoState* state, enum EpdDrawMode mode, int temperature, EpdRect area
+);
+
+/**
+ * Reset the monochrome front framebuffer to a white state.
+ */
+void epd_hl_mono_set_all_white(EpdiyMonoState* state);
+
+/**
+ * Bring the display to a fully white state and get rid of any
+ * remaining artifacts, for a monochrome state.
+ */
+void epd_hl_mono_fullclear(EpdiyMonoState* state, int temperature);
+
 #ifdef __cplusplus
 }
 #endif
@@ -10,6 +10,7 @@
 #define EPD_INTERNALS_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /// minimal draw time in ms for a frame layer,
@@ -63,7 +64,7 @@ typedef struct {
     uint16_t advance_x;        ///< Distance to advance cursor (x axis)
     int16_t left;              ///< X dist from cursor pos to UL corner
     int16_t top;               ///< Y dist from cursor pos to UL corner
-    uint32_t compressed_size;  ///< Size of the zlib-compressed font data.
+    uint32_t compressed_size;  ///< Size of the compressed font data.
     uint32_t data_offset;      ///< Pointer into EpdFont->bitmap
 } EpdGlyph;
 
@@ -74,16 +75,52 @@ typedef struct {
     uint32_t offset;  ///< Index of the first code point into the glyph array
 } EpdUnicodeInterval;
 
+struct EpdFontStack;
+
+/// Compression of glyph bitmaps, see `EpdFont.compressed`.
+enum EpdGlyphCompression {
+    /// Glyph bitmaps are stored as they are.
+    EPD_COMPRESSION_NONE = 0,
+    /// Each glyph bitmap is a zlib stream.
+    EPD_COMPRESSION_ZLIB = 1,
+    /**
+     * Each glyph bitmap is run-length encoded, which is faster to decode than zlib.
+     * Its pixels, including the padding at the end of each row, are a sequence of tokens.
+     * The upper 2 bits of the token byte are its type,
+     * the lower 6 bits `n` give the number of pixels, n + 1:
+     *  - 0: Pixels of value 0, i.e. uncovered pixels.
+     *  - 1: Pixels of the maximal value, i.e. fully covered pixels.
+     *  - 2: Literal pixels of any value, in the following (n + 1) * bits_per_pixel / 8
+     *       bytes, rounded up. The first pixel is in the lowest bits.
+     */
+    EPD_COMPRESSION_RLE = 2,
+};
+
 /// Data stored for FONT AS A WHOLE
-typedef struct {
+typedef struct EpdFont {
     const uint8_t* bitmap;                ///< Glyph bitmaps, concatenated
     const EpdGlyph* glyph;                ///< Glyph array
     const EpdUnicodeInterval* intervals;  ///< Valid unicode intervals for this font
     uint32_t interval_count;              ///< Number of unicode intervals.
-    bool compressed;                      ///< Does this font use compressed glyph bitmaps?
+    uint8_t compressed;                   ///< Glyph compression, an `EpdGlyphCompression`
     uint16_t advance_y;                   ///< Newline distance (y axis)
     int ascender;                         ///< Maximal height of a glyph above the base line
     int descender;                        ///< Maximal height of a glyph below the base line
+    /// Optional glyph array index of each code point below 256, `EPD_NO_GLYPH` if not included.
+    /// Fonts without it (NULL) are looked up by binary search for all code points.
+    const uint16_t* direct_index;
+    /// Bits per glyph pixel: 1, 2 or 4. Fonts that leave it 0 have 4 bits per pixel.
+    /// Rows of glyph bitmaps start at a byte boundary, the first pixel is in the lowest bits.
+    uint8_t bits_per_pixel;
+    /// For fonts loaded from storage with a NULL `bitmap`: Read `size` bytes of glyph data
+    /// at `offset` into `buffer`. Only called with the glyph cache locked.
+    bool (*read_data)(const struct EpdFont* font, uint32_t offset, uint8_t* buffer, size_t size);
+    /// Set for font stacks created by `epd_font_stack_create()`, which take their glyphs
+    /// from other fonts and have no glyphs or bitmaps of their own.
+    const struct EpdFontStack* stack;
 } EpdFont;
 
+/// Marks code points without a glyph in `EpdFont.direct_index`.
+#define EPD_NO_GLYPH 0xFFFF
+
 #endif  // EPD_INTERNALS_H
@@ -2,12 +2,18 @@
 #include "epd_board.h"
 #include "epd_display.h"
 #include "output_common/render_method.h"
+#include "pixel_run.h"
 #include "render.h"
 
 #include <esp_assert.h>
 #include <esp_heap_caps.h>
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <esp_types.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <string.h>
 
 // Simple x and y coordinate
 typedef struct {
@@ -20,6 +26,16 @@ static const EpdDisplay_t* display = NULL;
 // Display rotation. Can be updated using epd_set_rotation(enum EpdRotation)
 static enum EpdRotation display_rotation = EPD_ROT_LANDSCAPE;
 
+static inline int min(int x, int y) {
+    return x < y ? x : y;
+}
+static inline int max(int x, int y) {
+    return x > y ? x : y;
+}
+
+/// Edge length of the pixel tiles used for rotated image drawing.
+#define BLIT_TILE_SIZE 8
+
 #ifndef _swap_int
 #define _swap_int(a, b) \
     {                   \
@@ -38,20 +54,154 @@ void epd_clear() {
     epd_clear_area(epd_full_screen());
 }
 
-void epd_draw_hline(int x, int y, int length, uint8_t color, uint8_t* framebuffer) {
-    for (int i = 0; i < length; i++) {
-        int xx = x + i;
-        epd_draw_pixel(xx, y, color, framebuffer);
+/**
+ * Fill `length` pixels of a framebuffer line, starting at `x`.
+ * Whole bytes are written at once, only the edges need a nibble fix-up.
+ */
+static void fill_framebuffer_span(uint8_t* line, int x, int length, uint8_t color) {
+    uint8_t nibble = color >> 4;
+    if (x % 2 && length > 0) {
+        line[x / 2] = (line[x / 2] & 0x0F) | (nibble << 4);
+        x++;
+        length--;
+    }
+
+    memset(&line[x / 2], nibble * 0x11, length / 2);
+
+    if (length % 2) {
+        int last = x + length - 1;
+        line[last / 2] = (line[last / 2] & 0xF0) | nibble;
     }
 }
 
-void epd_draw_vline(int x, int y, int length, uint8_t color, uint8_t* framebuffer) {
-    for (int i = 0; i < length; i++) {
-        int yy = y + i;
-        epd_draw_pixel(x, yy, color, framebuffer);
+/**
+ * Fill a rectangle in unrotated framebuffer coordinates.
+ * The rectangle must be within the framebuffer.
+ */
+static void fill_framebuffer_rect(
+    int x, int y, int width, int height, uint8_t color, uint8_t* framebuffer
+) {
+    int line_bytes = epd_width() / 2;
+    uint8_t* line = framebuffer + y * line_bytes;
+
+    if (width == 1) {
+        uint8_t* ptr = line + x / 2;
+        uint8_t keep_mask = x % 2 ? 0x0F : 0xF0;
+        uint8_t value = x % 2 ? (color & 0xF0) : (color >> 4);
+        for (int i = 0; i < height; i++) {
+            *ptr = (*ptr & keep_mask) | value;
+            ptr += line_bytes;
+        }
+        return;
+    }
+
+    for (int i = 0; i < height; i++) {
+        fill_framebuffer_span(line, x, width, color);
+        line += line_bytes;
+    }
+}
+
+/// Bytes per line of a monochrome framebuffer.
+static inline int mono_line_bytes() {
+    return (epd_width() + 7) / 8;
+}
+
+/**
+ * Fill `length` pixels of a monochrome framebuffer line, starting at `x`.
+ * Only the partial bytes at the edges need masking.
+ */
+static void fill_mono_span(uint8_t* line, int x, int length, uint8_t color) {
+    uint8_t value = color & 0x80 ? 0xFF : 0x00;
+    int end = x + length;
+
+    if (x % 8 && length > 0) {
+        int n = min(8 - x % 8, length);
+        uint8_t mask = ((1 << n) - 1) << (x % 8);
+        line[x / 8] = (line[x / 8] & ~mask) | (value & mask);
+        x += n;
+    }
+
+    memset(&line[x / 8], value, (end - x) / 8);
+    x += (end - x) / 8 * 8;
+
+    if (end > x) {
+        uint8_t mask = (1 << (end - x)) - 1;
+        line[x / 8] = (line[x / 8] & ~mask) | (value & mask);
+    }
+}
+
+/**
+ * Fill a rectangle in unrotated monochrome framebuffer coordinates.
+ * The rectangle must be within the framebuffer.
+ */
+static void fill_mono_rect(
+    int x, int y, int width, int height, uint8_t color, uint8_t* framebuffer
+) {
+    int line_bytes = mono_line_bytes();
+    uint8_t* line = framebuffer + y * line_bytes;
+    for (int i = 0; i < height; i++) {
+        fill_mono_span(line, x, width, color);
+        line += line_bytes;
+    }
+}
+
+/// Fills a rectangle in unrotated framebuffer coordinates.
+typedef void (*rect_filler_t)(int x, int y, int width, int height, uint8_t color, uint8_t* fb);
+
+/**
+ * Fill a rectangle given in rotated display coordinates.
+ * Clipping and rotation are resolved once for the whole rectangle,
+ * so vertical spans in portrait orientation become horizontal runs in the framebuffer.
+ */
+static void fill_rotated_rect(
+    int x, int y, int width, int height, uint8_t color, uint8_t* framebuffer, rect_filler_t fill
+) {
+    // clip in rotated coordinates
+    if (x < 0) {
+        width += x;
+        x = 0;
+    }
+    if (y < 0) {
+        height += y;
+        y = 0;
+    }
+    width = min(width, epd_rotated_display_width() - x);
+    height = min(height, epd_rotated_display_height() - y);
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+
+    switch (display_rotation) {
+        case EPD_ROT_LANDSCAPE:
+            fill(x, y, width, height, color, framebuffer);
+            break;
+        case EPD_ROT_PORTRAIT:
+            fill(epd_width() - y - height, x, height, width, color, framebuffer);
+            break;
+        case EPD_ROT_INVERTED_LANDSCAPE:
+            fill(
+                epd_width() - x - width,
+                epd_height() - y - height,
+                width,
+                height,
+                color,
+                framebuffer
+            );
+            break;
+        case EPD_ROT_INVERTED_PORTRAIT:
+            fill(y, epd_height() - x - width, height, width, color, framebuffer);
+            break;
     }
 }
 
+void epd_draw_hline(int x, int y, int length, uint8_t color, uint8_t* framebuffer) {
+    fill_rotated_rect(x, y, length, 1, color, framebuffer, fill_framebuffer_rect);
+}
+
+void epd_draw_vline(int x, int y, int length, uint8_t color, uint8_t* framebuffer) {
+    fill_rotated_rect(x, y, 1, length, color, framebuffer, fill_framebuffer_rect);
+}
+
 Coord_xy _rotate(uint16_t x, uint16_t y) {
     switch (display_rotation) {
         case EPD_ROT_LANDSCAPE:
@@ -185,16 +335,20 @@ void epd_draw_rect(EpdRect rect, uint8_t color, uint8_t* framebuffer) {
 }
 
 void epd_fill_rect(EpdRect rect, uint8_t color, uint8_t* framebuffer) {
-    int x = rect.x;
-    int y = rect.y;
-    int w = rect.width;
-    int h = rect.height;
-    for (int i = y; i < y + h; i++) {
-        epd_draw_hline(x, i, w, color, framebuffer);
-    }
+    fill_rotated_rect(
+        rect.x, rect.y, rect.width, rect.height, color, framebuffer, fill_framebuffer_rect
+    );
 }
 
-static void epd_write_line(int x0, int y0, int x1, int y1, uint8_t color, uint8_t* framebuffer) {
+static void epd_write_line(
+    int x0,
+    int y0,
+    int x1,
+    int y1,
+    uint8_t color,
+    uint8_t* framebuffer,
+    void (*draw_pixel)(int x, int y, uint8_t color, uint8_t* framebuffer)
+) {
     int steep = abs(y1 - y0) > abs(x1 - x0);
     if (steep) {
         _swap_int(x0, y0);
@@ -221,9 +375,9 @@ static void epd_write_line(int x0, int y0, int x1, int y1, uint8_t color, uint8_
 
     for (; x0 <= x1; x0++) {
         if (steep) {
-            epd_draw_pixel(y0, x0, color, framebuffer);
+            draw_pixel(y0, x0, color, framebuffer);
         } else {
-            epd_draw_pixel(x0, y0, color, framebuffer);
+            draw_pixel(x0, y0, color, framebuffer);
         }
         err -= dy;
         if (err < 0) {
@@ -244,7 +398,7 @@ void epd_draw_line(int x0, int y0, int x1, int y1, uint8_t color, uint8_t* frame
             _swap_int(x0, x1);
         epd_draw_hline(x0, y0, x1 - x0 + 1, color, framebuffer);
     } else {
-        epd_write_line(x0, y0, x1, y1, color, framebuffer);
+        epd_write_line(x0, y0, x1, y1, color, framebuffer, epd_draw_pixel);
     }
 }
 
@@ -337,36 +491,83 @@ void epd_fill_triangle(
     }
 }
 
-void epd_copy_to_framebuffer(EpdRect image_area, const uint8_t* image_data, uint8_t* framebuffer) {
-    assert(framebuffer != NULL);
+void epd_draw_pixel_mono(int x, int y, uint8_t color, uint8_t* framebuffer) {
+    Coord_xy coord = _rotate(x, y);
+    x = coord.x;
+    y = coord.y;
 
-    for (uint32_t i = 0; i < image_area.width * image_area.height; i++) {
-        uint32_t value_index = i;
-        // for images of uneven width,
-        // consume an additional nibble per row.
-        if (image_area.width % 2) {
-            value_index += i / image_area.width;
-        }
-        uint8_t val = (value_index % 2) ? (image_data[value_index / 2] & 0xF0) >> 4
-                                        : image_data[value_index / 2] & 0x0F;
+    if (x < 0 || x >= epd_width() || y < 0 || y >= epd_height()) {
+        return;
+    }
 
-        int xx = image_area.x + i % image_area.width;
-        if (xx < 0 || xx >= epd_width()) {
-            continue;
-        }
-        int yy = image_area.y + i / image_area.width;
-        if (yy < 0 || yy >= epd_height()) {
-            continue;
-        }
-        uint8_t* buf_ptr = &framebuffer[yy * epd_width() / 2 + xx / 2];
-        if (xx % 2) {
-            *buf_ptr = (*buf_ptr & 0x0F) | (val << 4);
-        } else {
-            *buf_ptr = (*buf_ptr & 0xF0) | val;
-        }
+    uint8_t* buf_ptr = &framebuffer[y * mono_line_bytes() + x / 8];
+    if (color & 0x80) {
+        *buf_ptr |= 1 << (x % 8);
+    } else {
+        *buf_ptr &= ~(1 << (x % 8));
+    }
+}
+
+void epd_draw_hline_mono(int x, int y, int length, uint8_t color, uint8_t* framebuffer) {
+    fill_rotated_rect(x, y, length, 1, color, framebuffer, fill_mono_rect);
+}
+
+void epd_draw_vline_mono(int x, int y, int length, uint8_t color, uint8_t* framebuffer) {
+    fill_rotated_rect(x, y, 1, length, color, framebuffer, fill_mono_rect);
+}
+
+void epd_fill_rect_mono(EpdRect rect, uint8_t color, uint8_t* framebuffer) {
+    fill_rotated_rect(rect.x, rect.y, rect.width, rect.height, color, framebuffer, fill_mono_rect);
+}
+
+void epd_draw_rect_mono(EpdRect rect, uint8_t color, uint8_t* framebuffer) {
+    int x = rect.x;
+    int y = rect.y;
+    int w = rect.width;
+    int h = rect.height;
+    epd_draw_hline_mono(x, y, w, color, framebuffer);
+    epd_draw_hline_mono(x, y + h - 1, w, color, framebuffer);
+    epd_draw_vline_mono(x, y, h, color, framebuffer);
+    epd_draw_vline_mono(x + w - 1, y, h, color, framebuffer);
+}
+
+void epd_draw_line_mono(int x0, int y0, int x1, int y1, uint8_t color, uint8_t* framebuffer) {
+    if (x0 == x1 || y0 == y1) {
+        int x = min(x0, x1), y = min(y0, y1);
+        int width = abs(x1 - x0) + 1, height = abs(y1 - y0) + 1;
+        fill_rotated_rect(x, y, width, height, color, framebuffer, fill_mono_rect);
+    } else {
+        epd_write_line(x0, y0, x1, y1, color, framebuffer, epd_draw_pixel_mono);
     }
 }
 
+void epd_copy_to_framebuffer(EpdRect image_area, const uint8_t* image_data, uint8_t* framebuffer) {
+    assert(framebuffer != NULL);
+
+    const EpdBitmap fb = {
+        .data = framebuffer,
+        .width = epd_width(),
+        .height = epd_height(),
+        .stride = epd_width() / 2,
+        .bpp = 4,
+    };
+    // the source is only read by the copy operation
+    const EpdBitmap image = {
+        .data = (uint8_t*)image_data,
+        .width = image_area.width,
+        .height = image_area.height,
+        .stride = image_area.width / 2 + image_area.width % 2,
+        .bpp = 4,
+    };
+    EpdRect source_area = {
+        .x = 0,
+        .y = 0,
+        .width = image_area.width,
+        .height = image_area.height,
+    };
+    epd_blit(&fb, image_area.x, image_area.y, &image, source_area, EPD_ROP_COPY, 0);
+}
+
 enum EpdDrawError epd_draw_image(EpdRect area, const uint8_t* data, const EpdWaveform* waveform) {
     int temperature = epd_ambient_temperature();
     assert(waveform != NULL);
@@ -438,26 +639,101 @@ uint8_t epd_get_pixel(int x, int y, int fb_width, int fb_height, const uint8_t*
     return buf_val << 4;
 }
 
+/**
+ * Draw a 4bpp image in the current rotation.
+ *
+ * The image is processed in tiles of BLIT_TILE_SIZE x BLIT_TILE_SIZE pixels:
+ * A tile is read row by row from the image, transposed and / or mirrored on the stack
+ * according to the rotation, and written to the framebuffer as horizontal runs.
+ */
 static void draw_rotated_transparent_image(
     EpdRect image_area,
     const uint8_t* image_buffer,
     uint8_t* framebuffer,
     uint8_t* transparent_color
 ) {
-    uint16_t x_offset = 0;
-    uint16_t y_offset = 0;
-    uint8_t pixel_color;
-    for (uint16_t y = 0; y < image_area.height; y++) {
-        for (uint16_t x = 0; x < image_area.width; x++) {
-            x_offset = image_area.x + x;
-            y_offset = image_area.y + y;
-            if (x_offset >= epd_rotated_display_width())
-                continue;
-            if (y_offset >= epd_rotated_display_height())
-                continue;
-            pixel_color = epd_get_pixel(x, y, image_area.width, image_area.height, image_buffer);
-            if (transparent_color == NULL || pixel_color != (*transparent_color))
-                epd_draw_pixel(x_offset, y_offset, pixel_color, framebuffer);
+    // the color is compared to pixels as `value << 4`, so colors with a lower nibble match none
+    const int transparent
+        = transparent_color != NULL && *transparent_color % 16 == 0 ? *transparent_color >> 4 : -1;
+    const int image_stride = image_area.width / 2 + image_area.width % 2;
+    const int fb_stride = epd_width() / 2;
+
+    // clip to the visible part of the image
+    int x_start = max(0, -image_area.x);
+    int y_start = max(0, -image_area.y);
+    int x_end = min(image_area.width, epd_rotated_display_width() - image_area.x);
+    int y_end = min(image_area.height, epd_rotated_display_height() - image_area.y);
+
+    uint8_t tile[BLIT_TILE_SIZE][BLIT_TILE_SIZE];
+    uint8_t rotated[BLIT_TILE_SIZE][BLIT_TILE_SIZE];
+
+    for (int ty = y_start; ty < y_end; ty += BLIT_TILE_SIZE) {
+        int th = min(BLIT_TILE_SIZE, y_end - ty);
+        for (int tx = x_start; tx < x_end; tx += BLIT_TILE_SIZE) {
+            int tw = min(BLIT_TILE_SIZE, x_end - tx);
+
+            for (int r = 0; r < th; r++) {
+                const uint8_t* src = image_buffer + (ty + r) * image_stride;
+                for (int c = 0; c < tw; c++) {
+                    int x = tx + c;
+                    tile[r][c] = x % 2 ? src[x / 2] >> 4 : src[x / 2] & 0x0F;
+                }
+            }
+
+            // top left corner of the tile in display coordinates
+            int lx = image_area.x + tx;
+            int ly = image_area.y + ty;
+
+            // position and size of the tile in framebuffer coordinates
+            int fx, fy, rows, cols;
+            switch (display_rotation) {
+                case EPD_ROT_PORTRAIT:
+                    fx = epd_width() - ly - th;
+                    fy = lx;
+                    rows = tw;
+                    cols = th;
+                    for (int i = 0; i < rows; i++) {
+                        for (int j = 0; j < cols; j++) {
+                            rotated[i][j] = tile[th - 1 - j][i];
+                        }
+                    }
+                    break;
+                case EPD_ROT_INVERTED_LANDSCAPE:
+                    fx = epd_width() - lx - tw;
+                    fy = epd_height() - ly - th;
+                    rows = th;
+                    cols = tw;
+                    for (int i = 0; i < rows; i++) {
+                        for (int j = 0; j < cols; j++) {
+                            rotated[i][j] = tile[th - 1 - i][tw - 1 - j];
+                        }
+                    }
+                    break;
+                case EPD_ROT_INVERTED_PORTRAIT:
+                    fx = ly;
+                    fy = epd_height() - lx - tw;
+                    rows = tw;
+                    cols = th;
+                    for (int i = 0; i < rows; i++) {
+                        for (int j = 0; j < cols; j++) {
+                            rotated[i][j] = tile[j][tw - 1 - i];
+                        }
+                    }
+                    break;
+                case EPD_ROT_LANDSCAPE:
+                default:
+                    fx = lx;
+                    fy = ly;
+                    rows = th;
+                    cols = tw;
+                    memcpy(rotated, tile, sizeof(tile));
+                    break;
+            }
+
+            for (int i = 0; i < rows; i++) {
+                uint8_t* line = framebuffer + (fy + i) * fb_stride;
+                write_pixel_run(line, fx, rotated[i], cols, transparent);
+            }
         }
     }
 }
@@ -476,12 +752,197 @@ void epd_draw_rotated_image(EpdRect image_area, const uint8_t* image_buffer, uin
     }
 }
 
-void epd_poweron() {
-    epd_current_board()->poweron(epd_ctrl_state());
+/**
+ * The power state below is guarded by `power_mutex`, as it is used by the power idle task
+ * as well as by direct calls. The mutex is recursive, since power requests power the display
+ * on and off while holding it.
+ */
+static StaticSemaphore_t power_mutex_buffer;
+static SemaphoreHandle_t power_mutex = NULL;
+
+/// Set between `epd_poweron_async()` and the end of the power-on in `epd_poweron_wait()`.
+static bool poweron_pending = false;
+/// Set while the power rails are up.
+static bool power_good = false;
+/// Start of the current power-on in microseconds since boot, 0 while powered off.
+static int64_t power_on_since = 0;
+static EpdPowerStats power_stats = { 0 };
+
+/// Number of held power requests of `epd_power_acquire()`.
+static int power_requests = 0;
+static uint32_t power_idle_timeout_ms = EPD_POWER_DEFAULT_IDLE_TIMEOUT_MS;
+static esp_timer_handle_t power_idle_timer = NULL;
+/// Time the display is powered off after the last request was released, 0 if not pending.
+static int64_t power_idle_deadline = 0;
+/// Powers the display off for the idle timer, which must not block the esp_timer task.
+static TaskHandle_t power_idle_task = NULL;
+
+static EpdTemperatureReading temperature_reading = { 0 };
+static uint32_t temperature_max_age_ms = EPD_TEMPERATURE_DEFAULT_MAX_AGE_MS;
+static portMUX_TYPE temperature_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static float read_temperature_sensor() {
+    if (!epd_current_board()->get_temperature) {
+        ESP_LOGW("epdiy", "No ambient temperature sensor - returning 21C");
+        return 21.0;
+    }
+    return epd_current_board()->get_temperature();
+}
+
+/// Read the temperature sensor and update the cached reading.
+static EpdTemperatureReading sample_temperature() {
+    EpdTemperatureReading reading = {
+        .temperature = read_temperature_sensor(),
+        .timestamp_us = esp_timer_get_time(),
+    };
+    portENTER_CRITICAL(&temperature_lock);
+    temperature_reading = reading;
+    portEXIT_CRITICAL(&temperature_lock);
+    return reading;
+}
+
+/// Check whether a reading is younger than `max_age_ms`.
+static bool temperature_is_fresh(const EpdTemperatureReading* reading, uint32_t max_age_ms) {
+    return reading->timestamp_us != 0
+           && esp_timer_get_time() - reading->timestamp_us < (int64_t)max_age_ms * 1000;
+}
+
+static void lock_power() {
+    xSemaphoreTakeRecursive(power_mutex, portMAX_DELAY);
+}
+
+static void unlock_power() {
+    xSemaphoreGiveRecursive(power_mutex);
+}
+
+/// Account for the start of a power-on.
+static void count_poweron() {
+    if (power_on_since == 0) {
+        power_on_since = esp_timer_get_time();
+        power_stats.power_cycles++;
+    }
+}
+
+bool epd_poweron() {
+    lock_power();
+    // boards with an asynchronous power-on report whether the power rails came up
+    epd_poweron_async();
+    bool good = epd_poweron_wait();
+    unlock_power();
+    return good;
+}
+
+void epd_poweron_async() {
+    const EpdBoardDefinition* board = epd_current_board();
+    lock_power();
+    if (board->poweron_start == NULL || board->poweron_finish == NULL) {
+        count_poweron();
+        board->poweron(epd_ctrl_state());
+        power_good = true;
+    } else if (!poweron_pending) {
+        count_poweron();
+        board->poweron_start(epd_ctrl_state());
+        poweron_pending = true;
+    }
+    unlock_power();
+}
+
+bool epd_poweron_wait() {
+    lock_power();
+    bool good = true;
+    if (poweron_pending) {
+        poweron_pending = false;
+        power_good = epd_current_board()->poweron_finish(epd_ctrl_state());
+        good = power_good;
+    }
+    unlock_power();
+    return good;
 }
 
 void epd_poweroff() {
+    lock_power();
+    epd_poweron_wait();
+
+    // refresh the temperature while the sensor is powered anyway,
+    // so the next update can use the cached reading
+    EpdTemperatureReading reading = epd_temperature_reading();
+    if (power_good && epd_current_board()->get_temperature != NULL
+        && !temperature_is_fresh(&reading, temperature_max_age_ms / 2)) {
+        sample_temperature();
+    }
+
     epd_current_board()->poweroff(epd_ctrl_state());
+    power_good = false;
+    if (power_on_since != 0) {
+        power_stats.rails_up_us += esp_timer_get_time() - power_on_since;
+        power_on_since = 0;
+    }
+    unlock_power();
+}
+
+static void power_idle_task_main(void* arg) {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        lock_power();
+        // power may have been requested and released again since the timer fired
+        if (power_requests == 0 && power_idle_deadline != 0
+            && esp_timer_get_time() >= power_idle_deadline) {
+            power_idle_deadline = 0;
+            epd_poweroff();
+        }
+        unlock_power();
+    }
+}
+
+static void power_idle_timeout(void* arg) {
+    xTaskNotifyGive(power_idle_task);
+}
+
+void epd_power_acquire() {
+    lock_power();
+    esp_timer_stop(power_idle_timer);
+    power_idle_deadline = 0;
+    power_stats.requests++;
+    if (power_on_since != 0) {
+        power_stats.requests_powered++;
+    } else {
+        epd_poweron_async();
+    }
+    power_requests++;
+    unlock_power();
+}
+
+void epd_power_release() {
+    lock_power();
+    assert(power_requests > 0);
+    power_requests--;
+    if (power_requests == 0) {
+        if (power_idle_timeout_ms == 0) {
+            epd_poweroff();
+        } else {
+            power_idle_deadline = esp_timer_get_time() + (int64_t)power_idle_timeout_ms * 1000;
+            ESP_ERROR_CHECK(
+                esp_timer_start_once(power_idle_timer, (uint64_t)power_idle_timeout_ms * 1000)
+            );
+        }
+    }
+    unlock_power();
+}
+
+void epd_set_power_idle_timeout(uint32_t timeout_ms) {
+    lock_power();
+    power_idle_timeout_ms = timeout_ms;
+    unlock_power();
+}
+
+EpdPowerStats epd_power_stats() {
+    lock_power();
+    EpdPowerStats stats = power_stats;
+    if (power_on_since != 0) {
+        stats.rails_up_us += esp_timer_get_time() - power_on_since;
+    }
+    unlock_power();
+    return stats;
 }
 
 void epd_init(
@@ -490,9 +951,36 @@ void epd_init(
     display = disp;
     epd_set_board(board);
     epd_renderer_init(options);
+
+    power_mutex = xSemaphoreCreateRecursiveMutexStatic(&power_mutex_buffer);
+    power_requests = 0;
+    // readings of a previous board must not be used
+    temperature_reading = (EpdTemperatureReading){ 0 };
+    temperature_max_age_ms = EPD_TEMPERATURE_DEFAULT_MAX_AGE_MS;
+    power_idle_deadline = 0;
+    memset(&power_stats, 0, sizeof(EpdPowerStats));
+    if (xTaskCreate(power_idle_task_main, "epd_power", 1 << 12, NULL, 1, &power_idle_task)
+        != pdPASS) {
+        abort();
+    }
+    const esp_timer_create_args_t timer_args = {
+        .callback = power_idle_timeout,
+        .name = "epd_power_idle",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &power_idle_timer));
 }
 
 void epd_deinit() {
+    esp_timer_stop(power_idle_timer);
+    esp_timer_delete(power_idle_timer);
+    power_idle_timer = NULL;
+    // delete the task only while it does not hold the power mutex
+    lock_power();
+    vTaskDelete(power_idle_task);
+    power_idle_task = NULL;
+    unlock_power();
+
+    // powers off the display if it is still powered
     epd_renderer_deinit();
 }
 
@@ -502,11 +990,30 @@ float epd_ambient_temperature() {
         return 0.0;
     }
 
-    if (!epd_current_board()->get_temperature) {
-        ESP_LOGW("epdiy", "No ambient temperature sensor - returning 21C");
-        return 21.0;
+    if (power_mutex == NULL) {
+        ESP_LOGE("epdiy", "Could not read temperature: display not initialized!");
+        return 0.0;
     }
-    return epd_current_board()->get_temperature();
+
+    EpdTemperatureReading reading = epd_temperature_reading();
+    if (!temperature_is_fresh(&reading, temperature_max_age_ms)) {
+        // the sensor must not be read while the power rails are sequenced
+        lock_power();
+        reading = sample_temperature();
+        unlock_power();
+    }
+    return reading.temperature;
+}
+
+void epd_set_temperature_max_age(uint32_t max_age_ms) {
+    temperature_max_age_ms = max_age_ms;
+}
+
+EpdTemperatureReading epd_temperature_reading() {
+    portENTER_CRITICAL(&temperature_lock);
+    EpdTemperatureReading reading = temperature_reading;
+    portEXIT_CRITICAL(&temperature_lock);
+    return reading;
 }
 
 void epd_set_vcom(uint16_t vcom) {
@@ -543,3 +1050,12 @@ void epd_set_lcd_pixel_clock_MHz(int frequency) {
     ESP_LOGW("epdiy", "called set_lcd_pixel_clock_MHz, but LCD driver is not used!");
 #endif
 }
+
+void epd_set_lcd_adaptive_pixel_clock(bool enabled) {
+#ifdef RENDER_METHOD_LCD
+    void lcd_set_adaptive_pixel_clock(bool enabled);
+    lcd_set_adaptive_pixel_clock(enabled);
+#else
+    ESP_LOGW("epdiy", "called set_lcd_adaptive_pixel_clock, but LCD driver is not used!");
+#endif
+}
@@ -10,6 +10,7 @@ extern "C" {
 #pragma once
 #include <esp_attr.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "epd_internals.h"
@@ -26,6 +27,25 @@ typedef struct {
     int height;
 } EpdRect;
 
+/// Number of pixels per gray level transition of an update.
+typedef struct {
+    /// Pixel counts, indexed as `counts[to][from]`.
+    /// This corresponds to the pixel values of a `MODE_PACKING_1PPB_DIFFERENCE` image.
+    uint32_t counts[16][16];
+} EpdTransitionHistogram;
+
+/// Optional information about the content of an update,
+/// which allows the driver to skip unnecessary work.
+typedef struct {
+    /// If not NULL, the transitions occurring in the drawn area.
+    /// Frames that drive none of these transitions are skipped.
+    const EpdTransitionHistogram* transitions;
+    /// If not NULL, an array of line transition masks for each line of the image,
+    /// as calculated by `epd_difference_image_base()`.
+    /// Lines are skipped in all frames after their last driven transition is done.
+    const uint32_t* line_transitions;
+} EpdDrawHints;
+
 /// Global EPD driver options.
 enum EpdInitOptions {
     /// Use the default options.
@@ -163,6 +183,16 @@ enum EpdDrawError {
     ///
     /// Reduce the display clock speed.
     EPD_DRAW_EMPTY_LINE_QUEUE = 0x400,
+
+    /// The update was aborted with `epd_abort_update()` or by the preemption hook.
+    ///
+    /// Use `epd_get_abort_state()` to find out which pixels were changed.
+    EPD_DRAW_ABORTED = 0x800,
+
+    /// The display power rails did not come up, so the display was not driven.
+    ///
+    /// See `epd_poweron_wait()`.
+    EPD_DRAW_POWER_FAILED = 0x1000,
 };
 
 /// The default draw mode (non-flashy refresh, whith previously white screen).
@@ -184,6 +214,67 @@ enum EpdFontFlags {
     EPD_DRAW_ALIGN_CENTER = 0x8,
 };
 
+/// Default time the display stays powered after the last power request is released,
+/// see `epd_set_power_idle_timeout()`.
+#define EPD_POWER_DEFAULT_IDLE_TIMEOUT_MS 1000
+
+/// Statistics of the display power supply, see `epd_power_stats()`.
+typedef struct {
+    /// Power-ons which sequenced the power rails up.
+    uint32_t power_cycles;
+    /// Calls of `epd_power_acquire()`.
+    uint32_t requests;
+    /// Requests served by power rails that were already up.
+    uint32_t requests_powered;
+    /// Total time the power rails were up in microseconds, including the current power-on.
+    int64_t rails_up_us;
+} EpdPowerStats;
+
+/// Default maximum age of cached temperature readings, see `epd_set_temperature_max_age()`.
+#define EPD_TEMPERATURE_DEFAULT_MAX_AGE_MS (60 * 1000)
+
+/// An ambient temperature reading, see `epd_temperature_reading()`.
+typedef struct {
+    /// The temperature in °C.
+    float temperature;
+    /// Time of the reading in microseconds since boot, 0 if there was no reading yet.
+    int64_t timestamp_us;
+} EpdTemperatureReading;
+
+/// Default memory budget of the glyph cache, see `epd_glyph_cache_configure()`.
+#define EPD_GLYPH_CACHE_DEFAULT_BUDGET (16 * 1024)
+
+/// Usage statistics of the glyph cache.
+typedef struct {
+    /// Glyphs of compressed fonts found in the cache.
+    uint32_t hits;
+    /// Glyphs of compressed fonts that had to be decompressed.
+    uint32_t misses;
+    /// Glyphs removed from the cache to make room for others.
+    uint32_t evictions;
+    /// Memory currently used by cached glyphs, including bookkeeping.
+    size_t used_bytes;
+    /// The configured memory budget.
+    size_t budget_bytes;
+} EpdGlyphCacheStats;
+
+/// Default memory budget of the text cache, see `epd_text_cache_configure()`.
+#define EPD_TEXT_CACHE_DEFAULT_BUDGET (32 * 1024)
+
+/// Usage statistics of the text cache.
+typedef struct {
+    /// Strings drawn from the cache.
+    uint32_t hits;
+    /// Strings that had to be rendered.
+    uint32_t misses;
+    /// Strings removed from the cache to make room for others.
+    uint32_t evictions;
+    /// Memory currently used by rendered strings, including bookkeeping.
+    size_t used_bytes;
+    /// The configured memory budget.
+    size_t budget_bytes;
+} EpdTextCacheStats;
+
 /// Font properties.
 typedef struct {
     /// Foreground color
@@ -231,7 +322,7 @@ void epd_set_vcom(uint16_t vcom);
 
 /**
  * Get the current ambient temperature in °C,
- * if the board has a sensor.
+ * if the board has a sensor. See the description below.
  */
 float epd_ambient_temperature();
 
@@ -250,12 +341,60 @@ int epd_rotated_display_height();
 /** Deinit the ePaper display */
 void epd_deinit();
 
-/** Enable display power supply. */
-void epd_poweron();
+/**
+ * Enable display power supply.
+ *
+ * @returns false if the board reports that the power rails did not come up, true otherwise.
+ */
+bool epd_poweron();
+
+/**
+ * Start enabling the display power supply and return before the power rails are up.
+ *
+ * Drawing functions wait for the power rails before driving the display, so an update
+ * called right after this can prepare its data while the rails come up.
+ * Boards which do not support this are powered on like by `epd_poweron()`.
+ */
+void epd_poweron_async();
+
+/**
+ * Wait for a power-on started by `epd_poweron_async()` to finish.
+ *
+ * @returns false if the power rails did not come up, true otherwise.
+ */
+bool epd_poweron_wait();
 
 /** Disable display power supply. */
 void epd_poweroff();
 
+/**
+ * Request power for the display, e.g. for an update.
+ *
+ * Requests are counted, and the display stays powered while any request is held.
+ * If the display is off, it is powered on like by `epd_poweron_async()`.
+ * Once the last request is released by `epd_power_release()`, the display is powered off
+ * after the idle timeout, unless power is requested again. This way, bursts of updates
+ * power the display on only once.
+ * Do not mix this with `epd_poweron()` and `epd_poweroff()`.
+ */
+void epd_power_acquire();
+
+/**
+ * Release a power request of `epd_power_acquire()`.
+ */
+void epd_power_release();
+
+/**
+ * Set the time the display stays powered after the last power request is released.
+ * The default is `EPD_POWER_DEFAULT_IDLE_TIMEOUT_MS`, with 0 it is powered off right away.
+ */
+void epd_set_power_idle_timeout(uint32_t timeout_ms);
+
+/**
+ * Get the statistics of the display power supply since `epd_init()`.
+ */
+EpdPowerStats epd_power_stats();
+
 /** Clear the whole screen by flashing it. */
 void epd_clear();
 
@@ -293,6 +432,64 @@ EpdRect epd_full_screen();
  */
 void epd_copy_to_framebuffer(EpdRect image_area, const uint8_t* image_data, uint8_t* framebuffer);
 
+/// Raster operations of `epd_blit()`, combining source (S) and destination (D) pixels.
+enum EpdRasterOp {
+    /// D = S
+    EPD_ROP_COPY,
+    /// D = D & S
+    EPD_ROP_AND,
+    /// D = D | S
+    EPD_ROP_OR,
+    /// D = D ^ S
+    EPD_ROP_XOR,
+    /// D = ~D, the source is not used.
+    EPD_ROP_INVERT,
+    /// D = S, except where S equals the color key given as `param`.
+    EPD_ROP_TRANSPARENT,
+    /// D = (S * alpha + D * (15 - alpha)) / 15, with `alpha` given as `param` (0 - 15).
+    /// For 1bpp buffers, the source is copied if `alpha >= 8`.
+    EPD_ROP_ALPHA,
+};
+
+/// A packed pixel buffer for `epd_blit()`.
+typedef struct {
+    uint8_t* data;
+    int width;
+    int height;
+    /// Number of bytes per line.
+    int stride;
+    /// Bits per pixel: 4 for two pixels per byte, with the first pixel in the lower nibble,
+    /// or 1 for eight pixels per byte, with the first pixel in the least significant bit.
+    int bpp;
+} EpdBitmap;
+
+/**
+ * Combine an area of a source buffer with a destination buffer.
+ *
+ * Clipping is done once for the whole area. Lines are processed in 32-bit words,
+ * and byte-aligned copies use `memcpy`.
+ *
+ * @param dst: The destination buffer, e.g., a framebuffer.
+ * @param dst_x: Horizontal position of the area in the destination.
+ * @param dst_y: Vertical position of the area in the destination.
+ * @param src: The source buffer with the same depth as `dst`.
+ *      May be NULL for `EPD_ROP_INVERT`, which then inverts the area of size `src_rect`.
+ * @param src_rect: The area of the source buffer to use.
+ * @param op: The raster operation to apply.
+ * @param param: Color key for `EPD_ROP_TRANSPARENT` or alpha for `EPD_ROP_ALPHA`.
+ * @returns `EPD_DRAW_INVALID_PACKING_MODE` if the buffer depths are unsupported
+ *      or do not match, `EPD_DRAW_SUCCESS` otherwise.
+ */
+enum EpdDrawError epd_blit(
+    const EpdBitmap* dst,
+    int dst_x,
+    int dst_y,
+    const EpdBitmap* src,
+    EpdRect src_rect,
+    enum EpdRasterOp op,
+    uint8_t param
+);
+
 /**
  * Draw a pixel a given framebuffer.
  *
@@ -414,12 +611,70 @@ void epd_draw_triangle(
 void epd_fill_triangle(
     int x0, int y0, int x1, int y1, int x2, int y2, uint8_t color, uint8_t* framebuffer
 );
+
+/**
+ * Monochrome drawing.
+ *
+ * These functions draw to 1 bit per pixel framebuffers of `(epd_width() + 7) / 8 * epd_height()`
+ * bytes, as used with `MODE_PACKING_8PPB` and the monochrome highlevel state.
+ * The first pixel of a byte is in its least significant bit, a set bit is white.
+ * Colors are given as for the grayscale functions: Colors >= 0x80 are drawn white,
+ * darker colors are drawn black.
+ */
+
+/**
+ * Draw a pixel to a monochrome framebuffer.
+ */
+void epd_draw_pixel_mono(int x, int y, uint8_t color, uint8_t* framebuffer);
+
+/**
+ * Draw a horizontal line to a monochrome framebuffer.
+ */
+void epd_draw_hline_mono(int x, int y, int length, uint8_t color, uint8_t* framebuffer);
+
+/**
+ * Draw a vertical line to a monochrome framebuffer.
+ */
+void epd_draw_vline_mono(int x, int y, int length, uint8_t color, uint8_t* framebuffer);
+
+/**
+ * Fill a rectangle in a monochrome framebuffer.
+ */
+void epd_fill_rect_mono(EpdRect rect, uint8_t color, uint8_t* framebuffer);
+
+/**
+ * Draw the outline of a rectangle to a monochrome framebuffer.
+ */
+void epd_draw_rect_mono(EpdRect rect, uint8_t color, uint8_t* framebuffer);
+
+/**
+ * Draw a line to a monochrome framebuffer.
+ */
+void epd_draw_line_mono(int x0, int y0, int x1, int y1, uint8_t color, uint8_t* framebuffer);
+
 /**
  * Get the current ambient temperature in °C, if supported by the board.
- * Requires the display to be powered on.
+ *
+ * The last reading is returned while it is younger than the maximum age set by
+ * `epd_set_temperature_max_age()`, without accessing the sensor. Otherwise, the sensor
+ * is read, which requires the display to be powered on.
+ * The reading is also refreshed by `epd_poweroff()` while the power is still on,
+ * once it is older than half the maximum age, so updates rarely wait for the sensor.
+ * The reading and the maximum age are reset by `epd_init()`.
  */
 float epd_ambient_temperature();
 
+/**
+ * Set the maximum age of the temperature returned by `epd_ambient_temperature()`.
+ * The default is `EPD_TEMPERATURE_DEFAULT_MAX_AGE_MS`, with 0 the sensor is read every time.
+ */
+void epd_set_temperature_max_age(uint32_t max_age_ms);
+
+/**
+ * Get the last ambient temperature reading and its time, without accessing the sensor.
+ */
+EpdTemperatureReading epd_temperature_reading();
+
 /**
  * The default font properties.
  */
@@ -471,6 +726,35 @@ enum EpdDrawError epd_write_string(
     const EpdFontProperties* properties
 );
 
+/**
+ * Write text to the EPD, wrapping lines that would be wider than `max_width`.
+ * Lines are wrapped at the last space, which is dropped, or between glyphs
+ * if a word alone is wider. Newlines start a new line as for `epd_write_string()`,
+ * and every line is aligned as given by the font properties.
+ */
+enum EpdDrawError epd_write_string_wrapped(
+    const EpdFont* font,
+    const char* string,
+    int* cursor_x,
+    int* cursor_y,
+    int max_width,
+    uint8_t* framebuffer,
+    const EpdFontProperties* properties
+);
+
+/**
+ * Write text to a monochrome framebuffer.
+ * Glyph pixels are drawn white if they are lighter than the middle gray, black otherwise.
+ */
+enum EpdDrawError epd_write_string_mono(
+    const EpdFont* font,
+    const char* string,
+    int* cursor_x,
+    int* cursor_y,
+    uint8_t* framebuffer,
+    const EpdFontProperties* properties
+);
+
 /**
  * Write a (multi-line) string to the EPD.
  */
@@ -483,6 +767,118 @@ enum EpdDrawError epd_write_default(
  */
 const EpdGlyph* epd_get_glyph(const EpdFont* font, uint32_t code_point);
 
+/**
+ * Get the glyph for a unicode code point, and the font it belongs to.
+ * For font stacks, this is the first font of the stack with the code point,
+ * for other fonts the font itself.
+ *
+ * @param glyph_font: Set to the font of the glyph, which must be used to decompress it.
+ * @returns The glyph, or NULL if there is none.
+ */
+const EpdGlyph* epd_resolve_glyph(
+    const EpdFont* font, uint32_t code_point, const EpdFont** glyph_font
+);
+
+/**
+ * Combine fonts into a font stack, which takes each glyph from the first font that has it.
+ *
+ * The stack is used like a font by the drawing and measuring functions, e.g. to draw text
+ * in several scripts with fonts for each. Its lines are spaced for the largest font.
+ * The code points of all fonts are merged into one index when the stack is created,
+ * so glyph lookups take a single search however many fonts there are.
+ *
+ * @param fonts: The fonts, in order of priority. They must outlive the stack,
+ *      and cannot be font stacks themselves. The array is copied.
+ * @param count: The number of fonts, at most 255.
+ * @returns The font stack, or NULL if the fonts are invalid or allocation failed.
+ *      Free it with `epd_font_stack_free()`.
+ */
+const EpdFont* epd_font_stack_create(const EpdFont* const* fonts, int count);
+
+/**
+ * Free a font stack created by `epd_font_stack_create()`. The fonts of the stack are kept.
+ */
+void epd_font_stack_free(const EpdFont* font);
+
+/**
+ * Decode the next code point of a UTF-8 string and advance the string past it.
+ * Returns 0 at the end of the string.
+ */
+uint32_t epd_next_code_point(const uint8_t** string);
+
+/**
+ * Write the bitmap of a glyph to `buffer`, decompressing it for compressed fonts.
+ * The buffer must hold `(glyph->width * bits_per_pixel + 7) / 8 * glyph->height` bytes,
+ * see `EpdFont.bits_per_pixel`.
+ * For glyphs of font stacks, use the font returned by `epd_resolve_glyph()`.
+ */
+enum EpdDrawError epd_decompress_glyph(const EpdFont* font, const EpdGlyph* glyph, uint8_t* buffer);
+
+/**
+ * Configure the cache for decompressed glyphs of compressed fonts.
+ * Recently drawn glyphs are kept until the budget is exhausted,
+ * and the least recently used glyphs are dropped first.
+ * This clears the cache and resets its statistics.
+ *
+ * @param budget_bytes: The memory the cache may use, including some bookkeeping per glyph.
+ *      The default is `EPD_GLYPH_CACHE_DEFAULT_BUDGET`. With a budget of 0,
+ *      glyphs are decompressed every time they are drawn.
+ * @param heap_caps: Heap capabilities for the cached glyphs,
+ *      e.g. `MALLOC_CAP_SPIRAM` to keep internal memory free for larger budgets.
+ */
+void epd_glyph_cache_configure(size_t budget_bytes, uint32_t heap_caps);
+
+/**
+ * Free all memory of the glyph cache. It is filled again when text is drawn.
+ */
+void epd_glyph_cache_clear();
+
+/**
+ * Get the usage statistics of the glyph cache.
+ */
+EpdGlyphCacheStats epd_glyph_cache_stats();
+
+/**
+ * Write text to the EPD like `epd_write_string()`, keeping the rendered text in the text cache.
+ *
+ * The first time a string is drawn with a font, font properties and rotation, it is rendered
+ * into a packed bitmap. Later, it is combined with the framebuffer by `epd_blit()`,
+ * without decoding, glyph lookup or per-glyph drawing. This suits labels, units and headings
+ * that are drawn again and again. Strings are compared by content, fonts by address,
+ * so fonts must not change while their text is cached.
+ * Text that does not fit into the cache is drawn directly.
+ */
+enum EpdDrawError epd_write_string_cached(
+    const EpdFont* font,
+    const char* string,
+    int* cursor_x,
+    int* cursor_y,
+    uint8_t* framebuffer,
+    const EpdFontProperties* properties
+);
+
+/**
+ * Configure the cache for text drawn by `epd_write_string_cached()`.
+ * The least recently drawn strings are dropped first when the budget is exhausted.
+ * This clears the cache and resets its statistics.
+ *
+ * @param budget_bytes: The memory the cache may use, including the string and some
+ *      bookkeeping per entry. The default is `EPD_TEXT_CACHE_DEFAULT_BUDGET`.
+ *      With a budget of 0, text is drawn directly.
+ * @param heap_caps: Heap capabilities for the rendered text, e.g. `MALLOC_CAP_SPIRAM`.
+ */
+void epd_text_cache_configure(size_t budget_bytes, uint32_t heap_caps);
+
+/**
+ * Free all memory of the text cache.
+ */
+void epd_text_cache_clear();
+
+/**
+ * Get the usage statistics of the text cache.
+ */
+EpdTextCacheStats epd_text_cache_stats();
+
 /**
  * Darken / lighten an area for a given time.
  *
@@ -529,6 +925,113 @@ enum EpdDrawError epd_draw_base(
     const uint8_t* drawn_columns,
     const EpdWaveform* waveform
 );
+
+/**
+ * Like `epd_draw_base()`, but with additional information about the drawn content.
+ *
+ * @param hints: Information about the update content, see `EpdDrawHints`.
+ *      May be NULL, which is equivalent to `epd_draw_base()`.
+ */
+enum EpdDrawError epd_draw_base_with_hints(
+    EpdRect area,
+    const uint8_t* data,
+    EpdRect crop_to,
+    enum EpdDrawMode mode,
+    int temperature,
+    const bool* drawn_lines,
+    const uint8_t* drawn_columns,
+    const EpdWaveform* waveform,
+    const EpdDrawHints* hints
+);
+
+/**
+ * Provides a row of input data for `epd_draw_line_source()`.
+ *
+ * The line source is called from the render threads while the update is in progress,
+ * since all rows are needed again for every frame of the update.
+ * Within a frame, rows are requested in ascending order, but with the LCD output method,
+ * the two render threads request alternating rows concurrently.
+ * Slow line sources cause line buffer underruns, see `EPD_DRAW_EMPTY_LINE_QUEUE`.
+ *
+ * @param row: The row to provide, relative to the top of the drawn area.
+ * @param frame: The current frame of the update. Increases with every frame,
+ *      but frames which drive no pixels may be left out.
+ * @param thread_id: The render thread requesting the row, below `EPD_NUM_RENDER_THREADS`.
+ * @param arg: The argument given to `epd_draw_line_source()`.
+ * @returns The row data, in the packing of the draw mode and covering the full width
+ *      of the drawn area. It must stay valid until the next call with the same `thread_id`.
+ */
+typedef const uint8_t* (*EpdLineSource)(int row, int frame, int thread_id, void* arg);
+
+/// Number of render threads which may call a line source concurrently.
+#define EPD_NUM_RENDER_THREADS 2
+
+/**
+ * Like `epd_draw_base_with_hints()`, but requesting the input data row by row
+ * from a line source callback instead of reading it from a buffer.
+ * This way, content can be generated, decompressed or streamed on the fly
+ * without holding the whole image in memory.
+ *
+ * @param area: The area of the display covered by the rows of the line source.
+ * @param line_source: Provides the rows of the drawn area, see `EpdLineSource`.
+ * @param line_source_arg: Passed to each call of the line source.
+ *
+ * For the other parameters, see `epd_draw_base()`.
+ */
+enum EpdDrawError epd_draw_line_source(
+    EpdRect area,
+    EpdLineSource line_source,
+    void* line_source_arg,
+    EpdRect crop_to,
+    enum EpdDrawMode mode,
+    int temperature,
+    const bool* drawn_lines,
+    const uint8_t* drawn_columns,
+    const EpdWaveform* waveform,
+    const EpdDrawHints* hints
+);
+
+/**
+ * Pixel state after an aborted update, by transition.
+ * Bit `from` of `completed[to]` is set if pixels transitioning from `from` to `to`
+ * are already in the `to` state, likewise for `indeterminate[to]`.
+ * Pixels whose transition is neither completed nor indeterminate are still in their `from` state.
+ */
+typedef struct {
+    /// Number of waveform frames driven before the update was aborted.
+    int frames_driven;
+    /// Transitions which were driven completely.
+    uint16_t completed[16];
+    /// Transitions which were driven partially, leaving pixels in an unknown state.
+    uint16_t indeterminate[16];
+} EpdAbortState;
+
+/**
+ * Abort the update currently in progress at the next frame boundary.
+ * The display is left in a consistent driven state and the draw function returns
+ * `EPD_DRAW_ABORTED`. May be called from any task.
+ *
+ * If no frames are output yet, e.g. while `epd_hl_update_area()` computes the difference,
+ * or if no update is in progress, the request is kept and the next update is aborted
+ * before its first frame. Requests are cleared when an update finishes.
+ */
+void epd_abort_update();
+
+/**
+ * Set a hook that is called at every frame boundary of an update.
+ * If it returns `true`, the update is aborted like with `epd_abort_update()`,
+ * for instance because a higher-priority update is pending.
+ * The hook must be fast and must not draw itself. Set to NULL to disable.
+ */
+void epd_set_update_preemption_hook(bool (*hook)(void* arg), void* arg);
+
+/**
+ * Get the pixel state after the last update, if it was aborted.
+ *
+ * @returns `true` if the last update was aborted and `state` was filled, `false` otherwise.
+ */
+bool epd_get_abort_state(EpdAbortState* state);
+
 /**
  * Calculate a `MODE_PACKING_1PPB_DIFFERENCE` difference image
  * from two `MODE_PACKING_2PPB` (4 bit-per-pixel) buffers.
@@ -556,6 +1059,32 @@ EpdRect epd_difference_image_cropped(
     uint8_t* col_dirtiness
 );
 
+/**
+ * Base function for difference image calculation with explicit framebuffer dimensions.
+ * See `epd_difference_image_cropped()` for the common parameters.
+ *
+ * @param fb_width: Width of the framebuffers in pixels, must be divisible by 8.
+ * @param fb_height: Height of the framebuffers in pixels.
+ * @param transitions: If not NULL, the histogram is reset and filled with the
+ *      transitions of all lines containing changes.
+ * @param line_transitions: If not NULL, an array of at least `fb_height`.
+ *      For each line containing changes, the lower 16 bits are a mask of the
+ *      "from" gray levels in this line, the upper 16 bits a mask of the "to" gray levels.
+ *      Lines without changes are set to 0.
+ */
+EpdRect epd_difference_image_base(
+    const uint8_t* to,
+    const uint8_t* from,
+    EpdRect crop_to,
+    int fb_width,
+    int fb_height,
+    uint8_t* interlaced,
+    bool* dirty_lines,
+    uint8_t* col_dirtyness,
+    EpdTransitionHistogram* transitions,
+    uint32_t* line_transitions
+);
+
 /**
  * Simplified version of `epd_difference_image_cropped()`, which considers the
  * whole display frame buffer.
@@ -600,6 +1129,20 @@ void epd_draw_rotated_transparent_image(
  */
 void epd_set_lcd_pixel_clock_MHz(int frequency);
 
+/**
+ * Let the LCD driver (Epdiy V7+) adapt the pixel clock to the available CPU headroom.
+ *
+ * The clock is lowered between frames when line data preparation can't keep up
+ * and slowly raised towards the display's `bus_speed` when there is headroom.
+ * The best clock found is remembered for each draw mode and lookup method.
+ * After buffer underruns, the lines of the frame which were not driven are repeated
+ * at the lowered clock. Only if that fails repeatedly, `EPD_DRAW_EMPTY_LINE_QUEUE` is flagged.
+ *
+ * Enabling the controller forgets previously learned clocks,
+ * disabling it restores the pixel clock used before it was enabled.
+ */
+void epd_set_lcd_adaptive_pixel_clock(bool enabled);
+
 #ifdef __cplusplus
 }
 #endif
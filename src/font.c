@@ -4,8 +4,11 @@
 #include <esp_log.h>
 
 #include "epdiy.h"
+#include "font_stack.h"
+#include "glyph_cache.h"
+#include "pixel_run.h"
+#include "text_cache.h"
 
-#include <miniz.h>
 #include <math.h>
 #include <stdio.h>
 #include <string.h>
@@ -53,10 +56,14 @@ static int utf8_len(const uint8_t ch) {
     return len;
 }
 
-static uint32_t next_cp(const uint8_t** string) {
+uint32_t epd_next_code_point(const uint8_t** string) {
     if (**string == 0) {
         return 0;
     }
+    // most text is ASCII
+    if (**string < 0x80) {
+        return *(*string)++;
+    }
     int bytes = utf8_len(**string);
     const uint8_t* chr = *string;
     *string += bytes;
@@ -78,175 +85,565 @@ EpdFontProperties epd_font_properties_default() {
 }
 
 const EpdGlyph* epd_get_glyph(const EpdFont* font, uint32_t code_point) {
+    if (font->stack != NULL) {
+        const EpdFont* glyph_font;
+        return font_stack_get_glyph(font->stack, code_point, &glyph_font);
+    }
+    if (code_point < 256 && font->direct_index != NULL) {
+        uint16_t index = font->direct_index[code_point];
+        return index != EPD_NO_GLYPH ? &font->glyph[index] : NULL;
+    }
+
+    // find the first interval which does not end before the code point
     const EpdUnicodeInterval* intervals = font->intervals;
-    for (int i = 0; i < font->interval_count; i++) {
-        const EpdUnicodeInterval* interval = &intervals[i];
-        if (code_point >= interval->first && code_point <= interval->last) {
-            return &font->glyph[interval->offset + (code_point - interval->first)];
-        }
-        if (code_point < interval->first) {
-            return NULL;
+    int low = 0;
+    int high = font->interval_count;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (intervals[mid].last < code_point) {
+            low = mid + 1;
+        } else {
+            high = mid;
         }
     }
+
+    if (low < font->interval_count && code_point >= intervals[low].first) {
+        return &font->glyph[intervals[low].offset + (code_point - intervals[low].first)];
+    }
     return NULL;
 }
 
-static int uncompress(
-    uint8_t* dest, size_t uncompressed_size, const uint8_t* source, size_t source_size
+const EpdGlyph* epd_resolve_glyph(
+    const EpdFont* font, uint32_t code_point, const EpdFont** glyph_font
 ) {
-    tinfl_decompressor* decomp;
-    if (uncompressed_size == 0 || dest == NULL || source_size == 0 || source == NULL) {
-        return -1;
-    }
-    decomp = malloc(sizeof(tinfl_decompressor));
-    if (!decomp) {
-        // Out of memory
-        return -1;
-    }
-    tinfl_init(decomp);
-
-    // we know everything will fit into the buffer.
-    tinfl_status decomp_status = tinfl_decompress(
-        decomp,
-        source,
-        &source_size,
-        dest,
-        dest,
-        &uncompressed_size,
-        TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF
+    if (font->stack != NULL) {
+        return font_stack_get_glyph(font->stack, code_point, glyph_font);
+    }
+    *glyph_font = font;
+    return epd_get_glyph(font, code_point);
+}
+
+/// Pixels of a glyph row or column mapped to framebuffer levels at once.
+#define GLYPH_RUN_LENGTH 64
+/// Level of glyph pixels that leave the framebuffer untouched.
+#define LEVEL_TRANSPARENT 0xFF
+
+/// A buffer that text is drawn to, e.g. a framebuffer.
+typedef struct TextTarget {
+    /**
+     * Write `n` pixels of gray levels (0-15) to a line of the target, starting at (x, y)
+     * in unrotated coordinates. Pixels of level `LEVEL_TRANSPARENT` are skipped,
+     * they only occur if `transparent` is set.
+     */
+    void (*write_run)(
+        const struct TextTarget* target,
+        int x,
+        int y,
+        const uint8_t* levels,
+        int n,
+        bool transparent
     );
-    free(decomp);
-    if (decomp_status != TINFL_STATUS_DONE) {
-        return decomp_status;
+    uint8_t* data;
+    /// Size in unrotated coordinates.
+    int width;
+    int height;
+    /// Number of bytes per line.
+    int stride;
+    /// Rotation of the text coordinates.
+    enum EpdRotation rotation;
+} TextTarget;
+
+static void write_grayscale_run(
+    const TextTarget* target, int x, int y, const uint8_t* levels, int n, bool transparent
+) {
+    uint8_t* line = target->data + y * target->stride;
+    write_pixel_run(line, x, levels, n, transparent ? LEVEL_TRANSPARENT : -1);
+}
+
+static void write_mono_run(
+    const TextTarget* target, int x, int y, const uint8_t* levels, int n, bool transparent
+) {
+    uint8_t* line = target->data + y * target->stride;
+    // collect the pixels of each byte, so every byte is written once
+    uint8_t mask = 0, white = 0;
+    for (int i = 0; i < n; i++) {
+        int px = x + i;
+        if (levels[i] != LEVEL_TRANSPARENT) {
+            mask |= 1 << (px % 8);
+            white |= (levels[i] >= 8) << (px % 8);
+        }
+        if (px % 8 == 7 || i == n - 1) {
+            line[px / 8] = (line[px / 8] & ~mask) | white;
+            mask = 0;
+            white = 0;
+        }
     }
-    return 0;
 }
 
-/*!
-   @brief   Draw a single character to a pre-allocated buffer.
-*/
-static enum EpdDrawError IRAM_ATTR draw_char(
-    const EpdFont* font,
-    uint8_t* buffer,
-    int* cursor_x,
-    int cursor_y,
-    uint32_t cp,
-    const EpdFontProperties* props
+static TextTarget grayscale_framebuffer(uint8_t* framebuffer) {
+    assert(framebuffer != NULL);
+    TextTarget target = {
+        .write_run = write_grayscale_run,
+        .data = framebuffer,
+        .width = epd_width(),
+        .height = epd_height(),
+        .stride = epd_width() / 2,
+        .rotation = epd_get_rotation(),
+    };
+    return target;
+}
+
+static TextTarget mono_framebuffer(uint8_t* framebuffer) {
+    TextTarget target = grayscale_framebuffer(framebuffer);
+    target.write_run = write_mono_run;
+    target.stride = (epd_width() + 7) / 8;
+    return target;
+}
+
+/// Width of a target in rotated coordinates.
+static inline int rotated_width(const TextTarget* target) {
+    bool portrait = target->rotation == EPD_ROT_PORTRAIT
+                    || target->rotation == EPD_ROT_INVERTED_PORTRAIT;
+    return portrait ? target->height : target->width;
+}
+
+/// Height of a target in rotated coordinates.
+static inline int rotated_height(const TextTarget* target) {
+    bool portrait = target->rotation == EPD_ROT_PORTRAIT
+                    || target->rotation == EPD_ROT_INVERTED_PORTRAIT;
+    return portrait ? target->width : target->height;
+}
+
+/**
+ * Fill a rectangle in rotated coordinates with a level.
+ * Rotation is resolved once, so the rectangle is written in horizontal runs.
+ */
+static void fill_rect(
+    const TextTarget* target, int x, int y, int width, int height, uint8_t level
 ) {
-    assert(props != NULL);
+    int x_end = min(x + width, rotated_width(target));
+    int y_end = min(y + height, rotated_height(target));
+    x = max(x, 0);
+    y = max(y, 0);
+    width = x_end - x;
+    height = y_end - y;
+    if (width <= 0 || height <= 0) {
+        return;
+    }
 
-    const EpdGlyph* glyph = epd_get_glyph(font, cp);
-    if (!glyph) {
-        glyph = epd_get_glyph(font, props->fallback_glyph);
+    EpdRect rect;
+    switch (target->rotation) {
+        case EPD_ROT_PORTRAIT:
+            rect = (EpdRect){ target->width - y - height, x, height, width };
+            break;
+        case EPD_ROT_INVERTED_LANDSCAPE:
+            rect = (EpdRect){
+                target->width - x - width, target->height - y - height, width, height
+            };
+            break;
+        case EPD_ROT_INVERTED_PORTRAIT:
+            rect = (EpdRect){ y, target->height - x - width, height, width };
+            break;
+        default:
+            rect = (EpdRect){ x, y, width, height };
+            break;
     }
 
-    if (!glyph) {
-        return EPD_DRAW_GLYPH_FALLBACK_FAILED;
+    uint8_t levels[GLYPH_RUN_LENGTH];
+    memset(levels, level, sizeof(levels));
+    for (int ry = rect.y; ry < rect.y + rect.height; ry++) {
+        for (int rx = rect.x; rx < rect.x + rect.width; rx += GLYPH_RUN_LENGTH) {
+            int n = min(GLYPH_RUN_LENGTH, rect.x + rect.width - rx);
+            target->write_run(target, rx, ry, levels, n, false);
+        }
     }
+}
 
-    uint32_t offset = glyph->data_offset;
-    uint16_t width = glyph->width, height = glyph->height;
-    int left = glyph->left;
+/// Value of pixel `x` of a glyph row with `bpp` bits per pixel.
+static inline uint8_t glyph_pixel(const uint8_t* row, int x, int bpp) {
+    int bit = x * bpp;
+    return (row[bit / 8] >> (bit % 8)) & ((1 << bpp) - 1);
+}
 
-    int byte_width = (width / 2 + width % 2);
-    unsigned long bitmap_size = byte_width * height;
-    const uint8_t* bitmap = NULL;
-    if (bitmap_size > 0 && font->compressed) {
-        uint8_t* tmp_bitmap = (uint8_t*)malloc(bitmap_size);
-        if (tmp_bitmap == NULL && bitmap_size) {
-            ESP_LOGE("font", "malloc failed.");
-            return EPD_DRAW_FAILED_ALLOC;
+/// Map `n` pixels of a glyph row, starting at `x`, to levels.
+static inline void map_row(
+    const uint8_t* row, int x, int n, const uint8_t* color_lut, uint8_t* levels, int bpp
+) {
+    const int pixels_per_byte = 8 / bpp;
+    const uint8_t mask = (1 << bpp) - 1;
+    int i = 0;
+    for (; i < n && (x + i) % pixels_per_byte; i++) {
+        levels[i] = color_lut[glyph_pixel(row, x + i, bpp)];
+    }
+    // whole bytes
+    const uint8_t* src = &row[(x + i) / pixels_per_byte];
+    for (; i + pixels_per_byte <= n; src++) {
+        uint8_t byte = *src;
+        for (int p = 0; p < pixels_per_byte; p++, byte >>= bpp) {
+            levels[i++] = color_lut[byte & mask];
         }
-        uncompress(tmp_bitmap, bitmap_size, &font->bitmap[offset], glyph->compressed_size);
-        bitmap = tmp_bitmap;
-    } else {
-        bitmap = &font->bitmap[offset];
-    }
-
-    uint8_t color_lut[16];
-    for (int c = 0; c < 16; c++) {
-        int color_difference = (int)props->fg_color - (int)props->bg_color;
-        color_lut[c] = max(0, min(15, props->bg_color + c * color_difference / 15));
-    }
-    bool background_needed = props->flags & EPD_DRAW_BACKGROUND;
-
-    for (int y = 0; y < height; y++) {
-        int yy = cursor_y - glyph->top + y;
-        int start_pos = *cursor_x + left;
-        bool byte_complete = start_pos % 2;
-        int x = max(0, -start_pos);
-        int max_x = start_pos + width;
-        uint8_t color;
-
-        for (int xx = start_pos; xx < max_x; xx++) {
-            uint8_t bm = bitmap[y * byte_width + x / 2];
-            if ((x & 1) == 0) {
-                bm = bm & 0xF;
-            } else {
-                bm = bm >> 4;
+    }
+    for (; i < n; i++) {
+        levels[i] = color_lut[glyph_pixel(row, x + i, bpp)];
+    }
+}
+
+/// Map `n` pixels of a glyph row to levels, from right to left starting at `x`.
+static inline void map_row_reversed(
+    const uint8_t* row, int x, int n, const uint8_t* color_lut, uint8_t* levels, int bpp
+) {
+    for (int i = 0; i < n; i++, x--) {
+        levels[i] = color_lut[glyph_pixel(row, x, bpp)];
+    }
+}
+
+/// Map `n` pixels of a glyph column to levels, starting at `y` and moving by `step` rows.
+static inline void map_column(
+    const uint8_t* bitmap,
+    int byte_width,
+    int x,
+    int y,
+    int step,
+    int n,
+    const uint8_t* color_lut,
+    uint8_t* levels,
+    int bpp
+) {
+    const uint8_t* src = bitmap + y * byte_width + x * bpp / 8;
+    int shift = x * bpp % 8;
+    uint8_t mask = (1 << bpp) - 1;
+    int stride = step * byte_width;
+    for (int i = 0; i < n; i++, src += stride) {
+        levels[i] = color_lut[(*src >> shift) & mask];
+    }
+}
+
+/**
+ * Draw the part `clip` of a glyph bitmap with `bpp` bits per pixel, with the glyph's
+ * top left corner at (x, y) in rotated coordinates. `clip` must be within the target.
+ *
+ * The glyph is written along target lines: Its rows are target lines
+ * in the landscape orientations, its columns in the portrait orientations.
+ */
+static inline void blit_glyph(
+    const TextTarget* target,
+    const uint8_t* bitmap,
+    int byte_width,
+    EpdRect clip,
+    int x,
+    int y,
+    const uint8_t* color_lut,
+    int bpp
+) {
+    uint8_t levels[GLYPH_RUN_LENGTH];
+    bool transparent = color_lut[0] == LEVEL_TRANSPARENT;
+    int fb_width = target->width;
+    int fb_height = target->height;
+    int x_end = clip.x + clip.width;
+    int y_end = clip.y + clip.height;
+
+    switch (target->rotation) {
+        case EPD_ROT_LANDSCAPE:
+            for (int gy = clip.y; gy < y_end; gy++) {
+                const uint8_t* row = bitmap + gy * byte_width;
+                for (int gx = clip.x; gx < x_end; gx += GLYPH_RUN_LENGTH) {
+                    int n = min(GLYPH_RUN_LENGTH, x_end - gx);
+                    map_row(row, gx, n, color_lut, levels, bpp);
+                    target->write_run(target, x + gx, y + gy, levels, n, transparent);
+                }
             }
-            if (background_needed || bm) {
-                color = color_lut[bm] << 4;
-                epd_draw_pixel(xx, yy, color, buffer);
+            break;
+        case EPD_ROT_INVERTED_LANDSCAPE:
+            for (int gy = clip.y; gy < y_end; gy++) {
+                const uint8_t* row = bitmap + gy * byte_width;
+                int fy = fb_height - 1 - (y + gy);
+                for (int gx_end = x_end; gx_end > clip.x; gx_end -= GLYPH_RUN_LENGTH) {
+                    int n = min(GLYPH_RUN_LENGTH, gx_end - clip.x);
+                    int fx = fb_width - x - gx_end;
+                    map_row_reversed(row, gx_end - 1, n, color_lut, levels, bpp);
+                    target->write_run(target, fx, fy, levels, n, transparent);
+                }
             }
-            byte_complete = !byte_complete;
-            x++;
-        }
+            break;
+        case EPD_ROT_PORTRAIT:
+            for (int gx = clip.x; gx < x_end; gx++) {
+                for (int gy_end = y_end; gy_end > clip.y; gy_end -= GLYPH_RUN_LENGTH) {
+                    int n = min(GLYPH_RUN_LENGTH, gy_end - clip.y);
+                    int fx = fb_width - y - gy_end;
+                    map_column(
+                        bitmap, byte_width, gx, gy_end - 1, -1, n, color_lut, levels, bpp
+                    );
+                    target->write_run(target, fx, x + gx, levels, n, transparent);
+                }
+            }
+            break;
+        case EPD_ROT_INVERTED_PORTRAIT:
+            for (int gx = clip.x; gx < x_end; gx++) {
+                int fy = fb_height - 1 - (x + gx);
+                for (int gy = clip.y; gy < y_end; gy += GLYPH_RUN_LENGTH) {
+                    int n = min(GLYPH_RUN_LENGTH, y_end - gy);
+                    map_column(bitmap, byte_width, gx, gy, 1, n, color_lut, levels, bpp);
+                    target->write_run(target, y + gy, fy, levels, n, transparent);
+                }
+            }
+            break;
     }
-    if (bitmap_size > 0 && font->compressed) {
-        free((uint8_t*)bitmap);
+}
+
+/**
+ * Build the framebuffer level of each glyph pixel value for the font properties,
+ * with `bpp` bits per pixel. Uncovered pixels are transparent unless a background is drawn.
+ */
+static void build_color_lut(const EpdFontProperties* props, int bpp, uint8_t* color_lut) {
+    int color_difference = (int)props->fg_color - (int)props->bg_color;
+    int max_value = (1 << bpp) - 1;
+    for (int v = 0; v <= max_value; v++) {
+        int coverage = v * 15 / max_value;
+        color_lut[v] = max(0, min(15, props->bg_color + coverage * color_difference / 15));
+    }
+    if (!(props->flags & EPD_DRAW_BACKGROUND)) {
+        color_lut[0] = LEVEL_TRANSPARENT;
     }
-    *cursor_x += glyph->advance_x;
-    return EPD_DRAW_SUCCESS;
 }
 
-/*!
- * @brief Calculate the bounds of a character when drawn at (x, y), move the
- * cursor (*x) forward, adjust the given bounds.
+/// Color lookup tables for glyphs with 1, 2 and 4 bits per pixel.
+typedef struct {
+    uint8_t lut[3][16];
+} ColorLuts;
+
+/**
+ * Draw a glyph of `font` with the pen at (x, y) in rotated coordinates.
  */
-static void get_char_bounds(
+static enum EpdDrawError IRAM_ATTR draw_glyph(
     const EpdFont* font,
-    uint32_t cp,
-    int* x,
-    int* y,
-    int* minx,
-    int* miny,
-    int* maxx,
-    int* maxy,
-    const EpdFontProperties* props
+    const TextTarget* target,
+    const EpdGlyph* glyph,
+    int pen_x,
+    int pen_y,
+    const ColorLuts* color_luts
 ) {
-    assert(props != NULL);
-
-    const EpdGlyph* glyph = epd_get_glyph(font, cp);
+    // top left corner of the glyph, and its visible part in glyph coordinates
+    int x = pen_x + glyph->left;
+    int y = pen_y - glyph->top;
+
+    int clip_x = max(0, -x);
+    int clip_y = max(0, -y);
+    EpdRect clip = {
+        .x = clip_x,
+        .y = clip_y,
+        .width = min(glyph->width, rotated_width(target) - x) - clip_x,
+        .height = min(glyph->height, rotated_height(target) - y) - clip_y,
+    };
+    if (clip.width <= 0 || clip.height <= 0) {
+        return EPD_DRAW_SUCCESS;
+    }
 
-    if (!glyph) {
-        glyph = epd_get_glyph(font, props->fallback_glyph);
+    const uint8_t* bitmap = glyph_cache_acquire(font, glyph);
+    if (bitmap == NULL) {
+        glyph_cache_release(font);
+        return EPD_DRAW_FAILED_ALLOC;
     }
+    int byte_width = glyph_byte_width(font, glyph);
+    // a constant depth for each call, so each gets a blitter specialized for it
+    switch (glyph_bits_per_pixel(font)) {
+        case 1:
+            blit_glyph(target, bitmap, byte_width, clip, x, y, color_luts->lut[0], 1);
+            break;
+        case 2:
+            blit_glyph(target, bitmap, byte_width, clip, x, y, color_luts->lut[1], 2);
+            break;
+        default:
+            blit_glyph(target, bitmap, byte_width, clip, x, y, color_luts->lut[2], 4);
+            break;
+    }
+    glyph_cache_release(font);
+    return EPD_DRAW_SUCCESS;
+}
 
+/**
+ * Get the glyph of a code point, or the fallback glyph. NULL if neither exists.
+ * Sets `glyph_font` to the font the glyph is taken from, which differs for font stacks.
+ */
+static inline const EpdGlyph* lookup_glyph(
+    const EpdFont* font, uint32_t cp, const EpdFontProperties* props, const EpdFont** glyph_font
+) {
+    const EpdGlyph* glyph = epd_resolve_glyph(font, cp, glyph_font);
     if (!glyph) {
-        return;
+        glyph = epd_resolve_glyph(font, props->fallback_glyph, glyph_font);
     }
+    return glyph;
+}
 
-    int x1 = *x + glyph->left, y1 = *y + glyph->top - glyph->height, x2 = x1 + glyph->width,
+/// Bounds of laid out text in display coordinates.
+typedef struct {
+    int min_x;
+    int min_y;
+    int max_x;
+    int max_y;
+} TextBounds;
+
+/// Bounds of text without glyphs.
+static const TextBounds NO_BOUNDS = {
+    .min_x = 100000,
+    .min_y = 100000,
+    .max_x = -1,
+    .max_y = -1,
+};
+
+/*!
+ * @brief Extend the bounds by a glyph drawn with the pen at (x, y).
+ */
+static void add_glyph_bounds(
+    const EpdFont* font,
+    const EpdGlyph* glyph,
+    int x,
+    int y,
+    const EpdFontProperties* props,
+    TextBounds* bounds
+) {
+    int x1 = x + glyph->left, y1 = y + glyph->top - glyph->height, x2 = x1 + glyph->width,
         y2 = y1 + glyph->height;
 
     // background needs to be taken into account
     if (props->flags & EPD_DRAW_BACKGROUND) {
-        *minx = min(*x, min(*minx, x1));
-        *maxx = max(max(*x + glyph->advance_x, x2), *maxx);
-        *miny = min(*y + font->descender, min(*miny, y1));
-        *maxy = max(*y + font->ascender, max(*maxy, y2));
+        bounds->min_x = min(x, min(bounds->min_x, x1));
+        bounds->max_x = max(max(x + glyph->advance_x, x2), bounds->max_x);
+        bounds->min_y = min(y + font->descender, min(bounds->min_y, y1));
+        bounds->max_y = max(y + font->ascender, max(bounds->max_y, y2));
     } else {
-        if (x1 < *minx)
-            *minx = x1;
-        if (y1 < *miny)
-            *miny = y1;
-        if (x2 > *maxx)
-            *maxx = x2;
-        if (y2 > *maxy)
-            *maxy = y2;
+        bounds->min_x = min(bounds->min_x, x1);
+        bounds->min_y = min(bounds->min_y, y1);
+        bounds->max_x = max(bounds->max_x, x2);
+        bounds->max_y = max(bounds->max_y, y2);
+    }
+}
+
+static void merge_bounds(TextBounds* bounds, const TextBounds* other) {
+    bounds->min_x = min(bounds->min_x, other->min_x);
+    bounds->min_y = min(bounds->min_y, other->min_y);
+    bounds->max_x = max(bounds->max_x, other->max_x);
+    bounds->max_y = max(bounds->max_y, other->max_y);
+}
+
+/// Glyphs kept per laid out line, the glyphs of longer lines are looked up again for drawing.
+#define LAYOUT_MAX_GLYPHS 64
+
+/// A glyph placed on a line.
+typedef struct {
+    /// NULL for code points without a glyph and fallback glyph.
+    const EpdGlyph* glyph;
+    /// The font of the glyph, which differs from the drawn font for font stacks.
+    const EpdFont* font;
+    /// Pen position, relative to the start of the line.
+    int x;
+} PlacedGlyph;
+
+/// A line of text, decoded and measured once, for both measuring and drawing.
+typedef struct {
+    /// Text of the line.
+    const uint8_t* start;
+    const uint8_t* end;
+    /// Start of the next line, NULL if this is the last line.
+    const uint8_t* next;
+    /// Horizontal pen advance of the whole line.
+    int advance;
+    /// Bounds of the line, as for `epd_get_text_bounds()`.
+    TextBounds bounds;
+    /// The first `num_glyphs` glyphs of the line.
+    PlacedGlyph glyphs[LAYOUT_MAX_GLYPHS];
+    int num_glyphs;
+    /// If not all glyphs are kept, the text after the last kept glyph.
+    const uint8_t* rest;
+    /// Pen position of the first glyph of `rest`, relative to the start of the line.
+    int rest_x;
+} TextLine;
+
+/**
+ * Lay out a line of text, with the pen starting at (x, y).
+ *
+ * The line ends with the string, at a newline if `split_lines` is set,
+ * or if `max_width` is positive, where the pen would advance beyond `max_width`:
+ * At the last space, which is dropped, or before the glyph if there is no space.
+ */
+static void layout_line(
+    const EpdFont* font,
+    const uint8_t* text,
+    int x,
+    int y,
+    int max_width,
+    bool split_lines,
+    const EpdFontProperties* props,
+    TextLine* line
+) {
+    line->start = text;
+    line->next = NULL;
+    line->advance = 0;
+    line->bounds = NO_BOUNDS;
+    line->rest = NULL;
+
+    // the state before the last space, where the line can be wrapped
+    const uint8_t* wrap_end = NULL;
+    const uint8_t* wrap_next = NULL;
+    int wrap_advance = 0, wrap_count = 0;
+    TextBounds wrap_bounds = NO_BOUNDS;
+    int count = 0;
+
+    const uint8_t* pos = text;
+    while (true) {
+        const uint8_t* glyph_start = pos;
+        uint32_t cp = epd_next_code_point(&pos);
+        if (cp == 0 || (cp == '\n' && split_lines)) {
+            line->end = glyph_start;
+            line->next = cp ? pos : NULL;
+            break;
+        }
+
+        const EpdFont* glyph_font;
+        const EpdGlyph* glyph = lookup_glyph(font, cp, props, &glyph_font);
+        int advance = glyph ? glyph->advance_x : 0;
+        if (max_width > 0) {
+            if (cp == ' ') {
+                wrap_end = glyph_start;
+                wrap_next = pos;
+                wrap_advance = line->advance;
+                wrap_bounds = line->bounds;
+                wrap_count = count;
+            }
+            if (count > 0 && line->advance + advance > max_width) {
+                if (wrap_end != NULL) {
+                    line->end = wrap_end;
+                    line->next = wrap_next;
+                    line->advance = wrap_advance;
+                    line->bounds = wrap_bounds;
+                    count = wrap_count;
+                } else {
+                    line->end = glyph_start;
+                    line->next = glyph_start;
+                }
+                break;
+            }
+        }
+
+        if (count < LAYOUT_MAX_GLYPHS) {
+            line->glyphs[count].glyph = glyph;
+            line->glyphs[count].font = glyph_font;
+            line->glyphs[count].x = line->advance;
+        } else if (count == LAYOUT_MAX_GLYPHS) {
+            line->rest = glyph_start;
+            line->rest_x = line->advance;
+        }
+        count++;
+
+        if (glyph) {
+            add_glyph_bounds(font, glyph, x + line->advance, y, props, &line->bounds);
+        }
+        line->advance += advance;
+    }
+
+    line->num_glyphs = min(count, LAYOUT_MAX_GLYPHS);
+    if (count <= LAYOUT_MAX_GLYPHS) {
+        line->rest = NULL;
     }
-    *x += glyph->advance_x;
 }
 
 EpdRect epd_get_string_rect(
@@ -263,22 +660,21 @@ EpdRect epd_get_string_rect(
     EpdRect temp = { .x = x, .y = y, .width = 0, .height = 0 };
     if (*string == '\0')
         return temp;
-    int minx = 100000, miny = 100000, maxx = -1, maxy = -1;
-    int temp_x = x;
+    TextBounds bounds = NO_BOUNDS;
     int temp_y = y + font->ascender;
 
     // Go through each line and get it's co-ordinates
-    uint32_t c;
-    while ((c = next_cp((const uint8_t**)&string))) {
-        if (c == 0x000A)  // newline
-        {
-            temp_x = x;
-            temp_y += font->advance_y;
-        } else
-            get_char_bounds(font, c, &temp_x, &temp_y, &minx, &miny, &maxx, &maxy, &props);
-    }
-    temp.width = maxx - x + (margin * 2);
-    temp.height = maxy - miny + (margin * 2);
+    TextLine line;
+    const uint8_t* text = (const uint8_t*)string;
+    do {
+        layout_line(font, text, x, temp_y, 0, true, &props, &line);
+        merge_bounds(&bounds, &line.bounds);
+        temp_y += font->advance_y;
+        text = line.next;
+    } while (text != NULL);
+
+    temp.width = bounds.max_x - x + (margin * 2);
+    temp.height = bounds.max_y - bounds.min_y + (margin * 2);
     return temp;
 }
 
@@ -296,7 +692,6 @@ void epd_get_text_bounds(
     // FIXME: Does not respect alignment!
 
     assert(properties != NULL);
-    EpdFontProperties props = *properties;
 
     if (*string == '\0') {
         *w = 0;
@@ -305,92 +700,95 @@ void epd_get_text_bounds(
         *x1 = *x;
         return;
     }
-    int minx = 100000, miny = 100000, maxx = -1, maxy = -1;
-    int original_x = *x;
-    int temp_x = *x;
-    int temp_y = *y;
-    uint32_t c;
-    while ((c = next_cp((const uint8_t**)&string))) {
-        get_char_bounds(font, c, &temp_x, &temp_y, &minx, &miny, &maxx, &maxy, &props);
-    }
-    *x1 = min(original_x, minx);
-    *w = maxx - *x1;
-    *y1 = miny;
-    *h = maxy - miny;
+    TextLine line;
+    layout_line(font, (const uint8_t*)string, *x, *y, 0, false, properties, &line);
+    *x1 = min(*x, line.bounds.min_x);
+    *w = line.bounds.max_x - *x1;
+    *y1 = line.bounds.min_y;
+    *h = line.bounds.max_y - line.bounds.min_y;
 }
 
-static enum EpdDrawError epd_write_line(
+static enum EpdDrawError draw_line(
     const EpdFont* font,
-    const char* string,
+    const TextTarget* target,
+    const TextLine* line,
     int* cursor_x,
-    int* cursor_y,
-    uint8_t* framebuffer,
-    const EpdFontProperties* properties
+    int cursor_y,
+    const EpdFontProperties* props
 ) {
-    assert(framebuffer != NULL);
-
-    if (*string == '\0') {
+    if (line->end == line->start) {
         return EPD_DRAW_SUCCESS;
     }
 
-    assert(properties != NULL);
-    EpdFontProperties props = *properties;
     enum EpdFontFlags alignment_mask
         = EPD_DRAW_ALIGN_LEFT | EPD_DRAW_ALIGN_RIGHT | EPD_DRAW_ALIGN_CENTER;
-    enum EpdFontFlags alignment = props.flags & alignment_mask;
+    enum EpdFontFlags alignment = props->flags & alignment_mask;
 
     // alignments are mutually exclusive!
     if ((alignment & (alignment - 1)) != 0) {
         return EPD_DRAW_INVALID_FONT_FLAGS;
     }
 
-    int x1 = 0, y1 = 0, w = 0, h = 0;
-    int tmp_cur_x = *cursor_x;
-    int tmp_cur_y = *cursor_y;
-    epd_get_text_bounds(font, string, &tmp_cur_x, &tmp_cur_y, &x1, &y1, &w, &h, &props);
+    int x1 = min(*cursor_x, line->bounds.min_x);
+    int w = line->bounds.max_x - x1;
+    int h = line->bounds.max_y - line->bounds.min_y;
 
     // no printable characters
     if (w < 0 || h < 0) {
         return EPD_DRAW_NO_DRAWABLE_CHARACTERS;
     }
 
-    uint8_t* buffer = framebuffer;
-    int local_cursor_x = *cursor_x;
-    int local_cursor_y = *cursor_y;
-    uint32_t c;
-
-    int cursor_x_init = local_cursor_x;
-    int cursor_y_init = local_cursor_y;
-
+    int x = *cursor_x;
     switch (alignment) {
-        case EPD_DRAW_ALIGN_LEFT: {
-            break;
-        }
-        case EPD_DRAW_ALIGN_CENTER: {
-            local_cursor_x -= w / 2;
+        case EPD_DRAW_ALIGN_CENTER:
+            x -= w / 2;
             break;
-        }
-        case EPD_DRAW_ALIGN_RIGHT: {
-            local_cursor_x -= w;
+        case EPD_DRAW_ALIGN_RIGHT:
+            x -= w;
             break;
-        }
         default:
             break;
     }
 
-    uint8_t bg = props.bg_color;
-    if (props.flags & EPD_DRAW_BACKGROUND) {
-        for (int l = local_cursor_y - font->ascender; l < local_cursor_y - font->descender; l++) {
-            epd_draw_hline(local_cursor_x, l, w, bg << 4, buffer);
-        }
+    if (props->flags & EPD_DRAW_BACKGROUND) {
+        int height = font->ascender - font->descender;
+        fill_rect(target, x, cursor_y - font->ascender, w, height, props->bg_color);
+    }
+
+    // the fonts of a font stack may have different bit depths
+    ColorLuts color_luts;
+    for (int i = 0; i < 3; i++) {
+        build_color_lut(props, 1 << i, color_luts.lut[i]);
     }
     enum EpdDrawError err = EPD_DRAW_SUCCESS;
-    while ((c = next_cp((const uint8_t**)&string))) {
-        err |= draw_char(font, buffer, &local_cursor_x, local_cursor_y, c, &props);
+    for (int i = 0; i < line->num_glyphs; i++) {
+        const PlacedGlyph* placed = &line->glyphs[i];
+        if (placed->glyph == NULL) {
+            err |= EPD_DRAW_GLYPH_FALLBACK_FAILED;
+            continue;
+        }
+        err |= draw_glyph(
+            placed->font, target, placed->glyph, x + placed->x, cursor_y, &color_luts
+        );
+    }
+
+    if (line->rest != NULL) {
+        const uint8_t* pos = line->rest;
+        int pen_x = x + line->rest_x;
+        while (pos < line->end) {
+            const EpdFont* glyph_font;
+            const EpdGlyph* glyph
+                = lookup_glyph(font, epd_next_code_point(&pos), props, &glyph_font);
+            if (glyph == NULL) {
+                err |= EPD_DRAW_GLYPH_FALLBACK_FAILED;
+                continue;
+            }
+            err |= draw_glyph(glyph_font, target, glyph, pen_x, cursor_y, &color_luts);
+            pen_x += glyph->advance_x;
+        }
     }
 
-    *cursor_x += local_cursor_x - cursor_x_init;
-    *cursor_y += local_cursor_y - cursor_y_init;
+    *cursor_x = x + line->advance;
     return err;
 }
 
@@ -401,34 +799,151 @@ enum EpdDrawError epd_write_default(
     return epd_write_string(font, string, cursor_x, cursor_y, framebuffer, &props);
 }
 
-enum EpdDrawError epd_write_string(
+static enum EpdDrawError write_string(
     const EpdFont* font,
+    const TextTarget* target,
     const char* string,
     int* cursor_x,
     int* cursor_y,
-    uint8_t* framebuffer,
+    int max_width,
     const EpdFontProperties* properties
 ) {
-    char *token, *newstring, *tofree;
     if (string == NULL) {
         ESP_LOGE("font.c", "cannot draw a NULL string!");
         return EPD_DRAW_STRING_INVALID;
     }
-    tofree = newstring = strdup(string);
-    if (newstring == NULL) {
-        ESP_LOGE("font.c", "cannot allocate string copy!");
-        return EPD_DRAW_FAILED_ALLOC;
-    }
+    assert(properties != NULL);
 
     enum EpdDrawError err = EPD_DRAW_SUCCESS;
-    // taken from the strsep manpage
     int line_start = *cursor_x;
-    while ((token = strsep(&newstring, "\n")) != NULL) {
+    TextLine line;
+    const uint8_t* text = (const uint8_t*)string;
+    do {
         *cursor_x = line_start;
-        err |= epd_write_line(font, token, cursor_x, cursor_y, framebuffer, properties);
+        layout_line(font, text, *cursor_x, *cursor_y, max_width, true, properties, &line);
+        err |= draw_line(font, target, &line, cursor_x, *cursor_y, properties);
         *cursor_y += font->advance_y;
+        text = line.next;
+    } while (text != NULL);
+
+    return err;
+}
+
+enum EpdDrawError epd_write_string(
+    const EpdFont* font,
+    const char* string,
+    int* cursor_x,
+    int* cursor_y,
+    uint8_t* framebuffer,
+    const EpdFontProperties* properties
+) {
+    TextTarget target = grayscale_framebuffer(framebuffer);
+    return write_string(font, &target, string, cursor_x, cursor_y, 0, properties);
+}
+
+enum EpdDrawError epd_write_string_wrapped(
+    const EpdFont* font,
+    const char* string,
+    int* cursor_x,
+    int* cursor_y,
+    int max_width,
+    uint8_t* framebuffer,
+    const EpdFontProperties* properties
+) {
+    TextTarget target = grayscale_framebuffer(framebuffer);
+    return write_string(font, &target, string, cursor_x, cursor_y, max_width, properties);
+}
+
+enum EpdDrawError epd_write_string_mono(
+    const EpdFont* font,
+    const char* string,
+    int* cursor_x,
+    int* cursor_y,
+    uint8_t* framebuffer,
+    const EpdFontProperties* properties
+) {
+    TextTarget target = mono_framebuffer(framebuffer);
+    return write_string(font, &target, string, cursor_x, cursor_y, 0, properties);
+}
+
+/// Origin and size of the virtual target strings are measured on.
+#define MEASURE_ORIGIN (1 << 14)
+#define MEASURE_SIZE (1 << 15)
+
+/// Records the area written to, instead of drawing.
+typedef struct {
+    /// Must be the first member, the target is passed around as `TextTarget` pointer.
+    TextTarget target;
+    TextBounds bounds;
+} MeasureTarget;
+
+static void measure_run(
+    const TextTarget* target, int x, int y, const uint8_t* levels, int n, bool transparent
+) {
+    TextBounds* bounds = &((MeasureTarget*)target)->bounds;
+    int first = 0, last = n - 1;
+    while (first <= last && levels[first] == LEVEL_TRANSPARENT) {
+        first++;
+    }
+    while (last >= first && levels[last] == LEVEL_TRANSPARENT) {
+        last--;
+    }
+    if (first > last) {
+        return;
     }
+    bounds->min_x = min(bounds->min_x, x + first);
+    bounds->max_x = max(bounds->max_x, x + last + 1);
+    bounds->min_y = min(bounds->min_y, y);
+    bounds->max_y = max(bounds->max_y, y + 1);
+}
 
-    free(tofree);
+enum EpdDrawError text_measure(
+    const EpdFont* font,
+    const char* string,
+    const EpdFontProperties* properties,
+    EpdRect* box,
+    int* advance_x,
+    int* advance_y
+) {
+    // measured unrotated, where target and text coordinates are the same
+    MeasureTarget measure = {
+        .target = {
+            .write_run = measure_run,
+            .width = MEASURE_SIZE,
+            .height = MEASURE_SIZE,
+            .rotation = EPD_ROT_LANDSCAPE,
+        },
+        .bounds = NO_BOUNDS,
+    };
+    int x = MEASURE_ORIGIN, y = MEASURE_ORIGIN;
+    enum EpdDrawError err = write_string(font, &measure.target, string, &x, &y, 0, properties);
+
+    const TextBounds* bounds = &measure.bounds;
+    box->x = bounds->min_x - MEASURE_ORIGIN;
+    box->y = bounds->min_y - MEASURE_ORIGIN;
+    box->width = max(0, bounds->max_x - bounds->min_x);
+    box->height = max(0, bounds->max_y - bounds->min_y);
+    *advance_x = x - MEASURE_ORIGIN;
+    *advance_y = y - MEASURE_ORIGIN;
     return err;
 }
+
+enum EpdDrawError text_render(
+    const EpdFont* font,
+    const char* string,
+    const EpdFontProperties* properties,
+    enum EpdRotation rotation,
+    EpdRect box,
+    const EpdBitmap* bitmap
+) {
+    TextTarget target = {
+        .write_run = write_grayscale_run,
+        .data = bitmap->data,
+        .width = bitmap->width,
+        .height = bitmap->height,
+        .stride = bitmap->stride,
+        .rotation = rotation,
+    };
+    int x = -box.x, y = -box.y;
+    return write_string(font, &target, string, &x, &y, 0, properties);
+}
@@ -0,0 +1,331 @@
+/**
+ * Loading of binary font files, see `epd_font_file.h` for the format.
+ *
+ * The interval and glyph records of the file have the layout of `EpdUnicodeInterval`
+ * and `EpdGlyph`, so mapped fonts are used in place. Fonts that are read from storage
+ * keep their tables in memory, and read glyph data through `EpdFont.read_data`.
+ */
+
+#include <esp_heap_caps.h>
+#include <esp_idf_version.h>
+#include <esp_log.h>
+#include <esp_partition.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "epd_font_file.h"
+#include "glyph_cache.h"
+#include "text_cache.h"
+
+// partitions have their own mapping functions since esp-idf 5.1
+#if ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 1, 0)
+typedef spi_flash_mmap_handle_t mmap_handle_t;
+#define MMAP_DATA SPI_FLASH_MMAP_DATA
+#define partition_munmap spi_flash_munmap
+#else
+typedef esp_partition_mmap_handle_t mmap_handle_t;
+#define MMAP_DATA ESP_PARTITION_MMAP_DATA
+#define partition_munmap esp_partition_munmap
+#endif
+
+#define FONT_FILE_MAGIC "EPDF"
+#define FONT_FILE_VERSION 1
+/// Flag bits holding the `EpdGlyphCompression` of the glyphs.
+#define FONT_FILE_COMPRESSION_MASK 3
+
+_Static_assert(sizeof(EpdUnicodeInterval) == 12, "intervals must match the file records");
+_Static_assert(sizeof(EpdGlyph) == 20, "glyphs must match the file records");
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t flags;
+    uint16_t advance_y;
+    int16_t ascender;
+    int16_t descender;
+    uint16_t bits_per_pixel;
+    uint32_t interval_count;
+    uint32_t glyph_count;
+    uint32_t intervals_offset;
+    uint32_t glyphs_offset;
+    uint32_t direct_index_offset;
+    uint32_t bitmap_offset;
+    uint32_t bitmap_size;
+} FontFileHeader;
+
+_Static_assert(sizeof(FontFileHeader) == 44, "header must match the file format");
+
+typedef enum {
+    SOURCE_MEMORY,
+    SOURCE_MAPPED_PARTITION,
+    SOURCE_PARTITION,
+    SOURCE_FILE,
+} FontSource;
+
+typedef struct {
+    /// Must be the first member, fonts are passed around as `EpdFont` pointers.
+    EpdFont font;
+    FontSource source;
+    mmap_handle_t mmap_handle;
+    const esp_partition_t* partition;
+    FILE* file;
+    /// Offset of the glyph bitmaps in the partition or file.
+    uint32_t bitmap_offset;
+    /// Font tables loaded into memory.
+    uint8_t* tables;
+} LoadedFont;
+
+/// Check the header, and that all sections are within `size` bytes.
+static bool check_header(const FontFileHeader* header, size_t size) {
+    if (memcmp(header->magic, FONT_FILE_MAGIC, 4) != 0) {
+        ESP_LOGE("epdiy", "not a font file.");
+        return false;
+    }
+    if (header->version != FONT_FILE_VERSION) {
+        ESP_LOGE("epdiy", "unsupported font file version %d.", header->version);
+        return false;
+    }
+    if ((header->flags & FONT_FILE_COMPRESSION_MASK) > EPD_COMPRESSION_RLE) {
+        ESP_LOGE("epdiy", "unsupported glyph compression.");
+        return false;
+    }
+    if (header->bits_per_pixel > 4 || header->bits_per_pixel == 3) {
+        ESP_LOGE("epdiy", "unsupported glyph bit depth %d.", header->bits_per_pixel);
+        return false;
+    }
+
+    uint64_t intervals_end = header->intervals_offset
+                             + (uint64_t)header->interval_count * sizeof(EpdUnicodeInterval);
+    uint64_t glyphs_end
+        = header->glyphs_offset + (uint64_t)header->glyph_count * sizeof(EpdGlyph);
+    uint64_t index_end = header->direct_index_offset + 256 * sizeof(uint16_t);
+    uint64_t bitmap_end = (uint64_t)header->bitmap_offset + header->bitmap_size;
+    if (header->intervals_offset % 4 || header->glyphs_offset % 4
+        || header->direct_index_offset % 4 || intervals_end > size || glyphs_end > size
+        || (header->direct_index_offset && index_end > size) || bitmap_end > size) {
+        ESP_LOGE("epdiy", "font file sections are out of bounds.");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Check that all intervals and direct index entries refer to glyphs in the glyph table,
+ * and that the data of all glyphs is within the bitmap section.
+ */
+static bool check_tables(const EpdFont* font, const FontFileHeader* header) {
+    for (int i = 0; i < font->interval_count; i++) {
+        const EpdUnicodeInterval* interval = &font->intervals[i];
+        if (interval->last < interval->first
+            || interval->offset + (uint64_t)(interval->last - interval->first)
+                   >= header->glyph_count) {
+            ESP_LOGE("epdiy", "font file interval %d is invalid.", i);
+            return false;
+        }
+    }
+    for (int cp = 0; font->direct_index != NULL && cp < 256; cp++) {
+        uint16_t index = font->direct_index[cp];
+        if (index != EPD_NO_GLYPH && index >= header->glyph_count) {
+            ESP_LOGE("epdiy", "font file direct index entry %d is invalid.", cp);
+            return false;
+        }
+    }
+    for (int g = 0; g < header->glyph_count; g++) {
+        const EpdGlyph* glyph = &font->glyph[g];
+        size_t data_size = font->compressed ? glyph->compressed_size
+                                            : glyph_byte_width(font, glyph) * glyph->height;
+        if ((uint64_t)glyph->data_offset + data_size > header->bitmap_size) {
+            ESP_LOGE("epdiy", "font file glyph %d is out of bounds.", g);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void init_font(EpdFont* font, const FontFileHeader* header) {
+    font->interval_count = header->interval_count;
+    font->compressed = header->flags & FONT_FILE_COMPRESSION_MASK;
+    font->advance_y = header->advance_y;
+    font->ascender = header->ascender;
+    font->descender = header->descender;
+    font->bits_per_pixel = header->bits_per_pixel;
+}
+
+/// Set up a font using all sections in place.
+static LoadedFont* use_in_place(const uint8_t* data, size_t size, FontSource source) {
+    const FontFileHeader* header = (const FontFileHeader*)data;
+    if (size < sizeof(FontFileHeader) || !check_header(header, size)) {
+        return NULL;
+    }
+
+    LoadedFont* loaded = calloc(1, sizeof(LoadedFont));
+    if (loaded == NULL) {
+        return NULL;
+    }
+    loaded->source = source;
+    EpdFont* font = &loaded->font;
+    init_font(font, header);
+    font->bitmap = data + header->bitmap_offset;
+    font->glyph = (const EpdGlyph*)(data + header->glyphs_offset);
+    font->intervals = (const EpdUnicodeInterval*)(data + header->intervals_offset);
+    if (header->direct_index_offset) {
+        font->direct_index = (const uint16_t*)(data + header->direct_index_offset);
+    }
+    if (!check_tables(font, header)) {
+        free(loaded);
+        return NULL;
+    }
+    return loaded;
+}
+
+static bool read_storage(LoadedFont* loaded, uint32_t offset, void* buffer, size_t size) {
+    if (loaded->source == SOURCE_PARTITION) {
+        return esp_partition_read(loaded->partition, offset, buffer, size) == ESP_OK;
+    }
+    return fseek(loaded->file, offset, SEEK_SET) == 0
+           && fread(buffer, 1, size, loaded->file) == size;
+}
+
+static bool read_glyph_data(const EpdFont* font, uint32_t offset, uint8_t* buffer, size_t size) {
+    LoadedFont* loaded = (LoadedFont*)font;
+    return read_storage(loaded, loaded->bitmap_offset + offset, buffer, size);
+}
+
+/**
+ * Set up a font that is read from a partition or file of `size` bytes:
+ * The tables are loaded into memory, glyph data is read on demand.
+ */
+static LoadedFont* load_tables(LoadedFont* loaded, size_t size) {
+    FontFileHeader header;
+    if (size < sizeof(header) || !read_storage(loaded, 0, &header, sizeof(header))
+        || !check_header(&header, size)) {
+        return NULL;
+    }
+
+    size_t intervals_size = header.interval_count * sizeof(EpdUnicodeInterval);
+    size_t glyphs_size = header.glyph_count * sizeof(EpdGlyph);
+    size_t index_size = header.direct_index_offset ? 256 * sizeof(uint16_t) : 0;
+    size_t tables_size = intervals_size + glyphs_size + index_size;
+    // tables of large fonts are better kept in PSRAM
+    loaded->tables = heap_caps_malloc(tables_size, MALLOC_CAP_SPIRAM);
+    if (loaded->tables == NULL) {
+        loaded->tables = heap_caps_malloc(tables_size, MALLOC_CAP_8BIT);
+    }
+    if (loaded->tables == NULL) {
+        ESP_LOGE("epdiy", "cannot allocate font tables.");
+        return NULL;
+    }
+
+    uint8_t* intervals = loaded->tables;
+    uint8_t* glyphs = intervals + intervals_size;
+    uint8_t* direct_index = glyphs + glyphs_size;
+    if (!read_storage(loaded, header.intervals_offset, intervals, intervals_size)
+        || !read_storage(loaded, header.glyphs_offset, glyphs, glyphs_size)
+        || (index_size
+            && !read_storage(loaded, header.direct_index_offset, direct_index, index_size))) {
+        ESP_LOGE("epdiy", "cannot read font tables.");
+        return NULL;
+    }
+
+    EpdFont* font = &loaded->font;
+    init_font(font, &header);
+    font->glyph = (const EpdGlyph*)glyphs;
+    font->intervals = (const EpdUnicodeInterval*)intervals;
+    font->direct_index = index_size ? (const uint16_t*)direct_index : NULL;
+    font->read_data = read_glyph_data;
+    loaded->bitmap_offset = header.bitmap_offset;
+    if (!check_tables(font, &header)) {
+        return NULL;
+    }
+    return loaded;
+}
+
+const EpdFont* epd_font_from_memory(const uint8_t* data, size_t size) {
+    if ((uintptr_t)data % 4) {
+        ESP_LOGE("epdiy", "font data must be aligned to 4 bytes.");
+        return NULL;
+    }
+    LoadedFont* loaded = use_in_place(data, size, SOURCE_MEMORY);
+    return loaded != NULL ? &loaded->font : NULL;
+}
+
+const EpdFont* epd_font_map_partition(const char* label) {
+    const esp_partition_t* partition
+        = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (partition == NULL) {
+        ESP_LOGE("epdiy", "font partition %s not found.", label);
+        return NULL;
+    }
+
+    const void* data;
+    mmap_handle_t handle;
+    if (esp_partition_mmap(partition, 0, partition->size, MMAP_DATA, &data, &handle) == ESP_OK) {
+        LoadedFont* loaded = use_in_place(data, partition->size, SOURCE_MAPPED_PARTITION);
+        if (loaded == NULL) {
+            partition_munmap(handle);
+            return NULL;
+        }
+        loaded->mmap_handle = handle;
+        return &loaded->font;
+    }
+
+    // not enough free MMU pages to map the whole partition
+    ESP_LOGW("epdiy", "cannot map font partition %s, reading glyphs on demand.", label);
+    LoadedFont* loaded = calloc(1, sizeof(LoadedFont));
+    if (loaded == NULL) {
+        return NULL;
+    }
+    loaded->source = SOURCE_PARTITION;
+    loaded->partition = partition;
+    if (load_tables(loaded, partition->size) == NULL) {
+        epd_font_close(&loaded->font);
+        return NULL;
+    }
+    return &loaded->font;
+}
+
+const EpdFont* epd_font_open_file(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        ESP_LOGE("epdiy", "cannot open font file %s.", path);
+        return NULL;
+    }
+    long size = -1;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        size = ftell(file);
+    }
+
+    LoadedFont* loaded = calloc(1, sizeof(LoadedFont));
+    if (loaded == NULL) {
+        fclose(file);
+        return NULL;
+    }
+    loaded->source = SOURCE_FILE;
+    loaded->file = file;
+    if (size < 0 || load_tables(loaded, size) == NULL) {
+        epd_font_close(&loaded->font);
+        return NULL;
+    }
+    return &loaded->font;
+}
+
+void epd_font_close(const EpdFont* font) {
+    if (font == NULL) {
+        return;
+    }
+    LoadedFont* loaded = (LoadedFont*)font;
+    glyph_cache_forget(font);
+    text_cache_forget(font);
+    switch (loaded->source) {
+        case SOURCE_MAPPED_PARTITION:
+            partition_munmap(loaded->mmap_handle);
+            break;
+        case SOURCE_FILE:
+            fclose(loaded->file);
+            break;
+        default:
+            break;
+    }
+    heap_caps_free(loaded->tables);
+    free(loaded);
+}
@@ -0,0 +1,214 @@
+/**
+ * Font stacks, see `epd_font_stack_create()`.
+ *
+ * The code point intervals of all fonts of a stack are merged into one sorted index
+ * when the stack is created. Each interval of the index refers to consecutive glyphs
+ * of the first font that has them, so a lookup is a single binary search,
+ * independent of the number of fonts. Code points below 256 are looked up directly.
+ */
+
+#include <esp_assert.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <stdlib.h>
+
+#include "epdiy.h"
+#include "font_stack.h"
+#include "text_cache.h"
+
+/// Code points with consecutive glyphs of one font of the stack.
+typedef struct {
+    uint32_t first;
+    uint32_t last;
+    /// Index of the glyph of `first` in the glyph array of the font.
+    uint32_t offset;
+    /// Index of the font in the stack.
+    uint32_t font;
+} StackInterval;
+
+/// The glyph of a code point below 256, and the index of its font in the stack.
+typedef struct {
+    const EpdGlyph* glyph;
+    uint8_t font;
+} StackGlyph;
+
+struct EpdFontStack {
+    /// Must be the first member, stacks are passed around as `EpdFont` pointers.
+    EpdFont font;
+    StackInterval* intervals;
+    uint32_t interval_count;
+    StackGlyph direct_index[256];
+    int font_count;
+    const EpdFont* fonts[];
+};
+
+const EpdGlyph* font_stack_get_glyph(
+    const struct EpdFontStack* stack, uint32_t code_point, const EpdFont** glyph_font
+) {
+    if (code_point < 256) {
+        const StackGlyph* direct = &stack->direct_index[code_point];
+        *glyph_font = stack->fonts[direct->font];
+        return direct->glyph;
+    }
+
+    // find the first interval which does not end before the code point
+    const StackInterval* intervals = stack->intervals;
+    int low = 0;
+    int high = stack->interval_count;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (intervals[mid].last < code_point) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    if (low < stack->interval_count && code_point >= intervals[low].first) {
+        const EpdFont* font = stack->fonts[intervals[low].font];
+        *glyph_font = font;
+        return &font->glyph[intervals[low].offset + (code_point - intervals[low].first)];
+    }
+    *glyph_font = &stack->font;
+    return NULL;
+}
+
+static int compare_code_points(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+/// Look up a code point in each font of the stack, and set `font` to the first that has it.
+static const EpdGlyph* first_glyph(
+    const struct EpdFontStack* stack, uint32_t code_point, int* font
+) {
+    for (int f = 0; f < stack->font_count; f++) {
+        const EpdGlyph* glyph = epd_get_glyph(stack->fonts[f], code_point);
+        if (glyph != NULL) {
+            *font = f;
+            return glyph;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Build the merged interval index of a stack.
+ *
+ * The first code points of all intervals and the code points after them split the
+ * code space into ranges where no interval of any font starts or ends. Each range
+ * belongs to the first font that has its first code point, and adjacent ranges with
+ * consecutive glyphs of the same font are joined.
+ */
+static bool build_index(struct EpdFontStack* stack) {
+    size_t boundary_count = 0;
+    for (int f = 0; f < stack->font_count; f++) {
+        boundary_count += 2 * stack->fonts[f]->interval_count;
+    }
+    if (boundary_count == 0) {
+        return true;
+    }
+
+    uint32_t* boundaries = malloc(boundary_count * sizeof(uint32_t));
+    // every range is at most one interval
+    stack->intervals = heap_caps_malloc(boundary_count * sizeof(StackInterval), MALLOC_CAP_8BIT);
+    if (boundaries == NULL || stack->intervals == NULL) {
+        free(boundaries);
+        return false;
+    }
+    size_t n = 0;
+    for (int f = 0; f < stack->font_count; f++) {
+        const EpdFont* font = stack->fonts[f];
+        for (int i = 0; i < font->interval_count; i++) {
+            boundaries[n++] = font->intervals[i].first;
+            boundaries[n++] = font->intervals[i].last + 1;
+        }
+    }
+    qsort(boundaries, n, sizeof(uint32_t), compare_code_points);
+
+    StackInterval* last = NULL;
+    for (size_t i = 0; i + 1 < n; i++) {
+        uint32_t first = boundaries[i];
+        if (first == boundaries[i + 1]) {
+            continue;
+        }
+        int f;
+        const EpdGlyph* glyph = first_glyph(stack, first, &f);
+        if (glyph == NULL) {
+            continue;
+        }
+
+        uint32_t offset = glyph - stack->fonts[f]->glyph;
+        if (last != NULL && last->font == f && last->last + 1 == first
+            && last->offset + (first - last->first) == offset) {
+            last->last = boundaries[i + 1] - 1;
+            continue;
+        }
+        last = &stack->intervals[stack->interval_count++];
+        last->first = first;
+        last->last = boundaries[i + 1] - 1;
+        last->offset = offset;
+        last->font = f;
+    }
+    free(boundaries);
+    return true;
+}
+
+const EpdFont* epd_font_stack_create(const EpdFont* const* fonts, int count) {
+    if (count < 1 || count > 255) {
+        ESP_LOGE("epdiy", "a font stack must have 1 to 255 fonts.");
+        return NULL;
+    }
+    for (int f = 0; f < count; f++) {
+        if (fonts[f] == NULL || fonts[f]->stack != NULL) {
+            ESP_LOGE("epdiy", "font %d of the stack is NULL or a font stack.", f);
+            return NULL;
+        }
+    }
+
+    struct EpdFontStack* stack = calloc(1, sizeof(struct EpdFontStack) + count * sizeof(EpdFont*));
+    if (stack == NULL) {
+        return NULL;
+    }
+    stack->font_count = count;
+    EpdFont* font = &stack->font;
+    font->stack = stack;
+    // lines are spaced for the largest font
+    font->ascender = fonts[0]->ascender;
+    font->descender = fonts[0]->descender;
+    for (int f = 0; f < count; f++) {
+        stack->fonts[f] = fonts[f];
+        if (fonts[f]->advance_y > font->advance_y) {
+            font->advance_y = fonts[f]->advance_y;
+        }
+        if (fonts[f]->ascender > font->ascender) {
+            font->ascender = fonts[f]->ascender;
+        }
+        if (fonts[f]->descender < font->descender) {
+            font->descender = fonts[f]->descender;
+        }
+    }
+
+    for (uint32_t code_point = 0; code_point < 256; code_point++) {
+        int f = 0;
+        stack->direct_index[code_point].glyph = first_glyph(stack, code_point, &f);
+        stack->direct_index[code_point].font = f;
+    }
+    if (!build_index(stack)) {
+        ESP_LOGE("epdiy", "cannot allocate the font stack index.");
+        epd_font_stack_free(font);
+        return NULL;
+    }
+    return font;
+}
+
+void epd_font_stack_free(const EpdFont* font) {
+    if (font == NULL) {
+        return;
+    }
+    assert(font->stack != NULL);
+    struct EpdFontStack* stack = (struct EpdFontStack*)font->stack;
+    text_cache_forget(font);
+    heap_caps_free(stack->intervals);
+    free(stack);
+}
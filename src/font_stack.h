@@ -0,0 +1,15 @@
+/**
+ * Glyph lookup in font stacks, see `epd_font_stack_create()`.
+ */
+
+#pragma once
+
+#include "epd_internals.h"
+
+/**
+ * Get the glyph of a code point from the first font of the stack that has it.
+ * Sets `glyph_font` to that font. Returns NULL if no font of the stack has the code point.
+ */
+const EpdGlyph* font_stack_get_glyph(
+    const struct EpdFontStack* stack, uint32_t code_point, const EpdFont** glyph_font
+);
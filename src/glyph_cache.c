@@ -0,0 +1,442 @@
+/**
+ * LRU cache of decompressed glyph bitmaps.
+ *
+ * Entries are keyed by font and glyph, and found through a small hash table.
+ * Each entry holds its bitmap in the same allocation, and is counted against the budget
+ * together with its bookkeeping. Glyphs that do not fit are decompressed into a scratch
+ * buffer, which is reused, as is the decompressor.
+ * Glyphs of fonts read from storage (see `epd_font_file.h`) are cached the same way.
+ * A mutex guards the cache from `glyph_cache_acquire()` until `glyph_cache_release()`.
+ */
+
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <miniz.h>
+#include <string.h>
+
+#include "epdiy.h"
+#include "glyph_cache.h"
+#include "lazy_mutex.h"
+
+/// Number of hash buckets, must be a power of two.
+#define NUM_BUCKETS 128
+
+typedef struct CacheEntry {
+    const EpdFont* font;
+    const EpdGlyph* glyph;
+    /// Size of the entry, including the bitmap.
+    size_t size;
+    /// Neighbours in the LRU list.
+    struct CacheEntry* newer;
+    struct CacheEntry* older;
+    /// Next entry in the same hash bucket.
+    struct CacheEntry* next_in_bucket;
+    uint8_t bitmap[];
+} CacheEntry;
+
+typedef struct {
+    size_t budget;
+    uint32_t heap_caps;
+    size_t used;
+    CacheEntry* buckets[NUM_BUCKETS];
+    CacheEntry* newest;
+    CacheEntry* oldest;
+    /// Reused for all decompressions, allocated on first use.
+    tinfl_decompressor* decompressor;
+    /// Holds glyphs that do not fit into the cache.
+    uint8_t* scratch;
+    size_t scratch_size;
+    /// Holds compressed glyph data read from storage.
+    uint8_t* source;
+    size_t source_size;
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+} GlyphCache;
+
+static GlyphCache cache = {
+    .budget = EPD_GLYPH_CACHE_DEFAULT_BUDGET,
+    .heap_caps = MALLOC_CAP_8BIT,
+};
+
+static LazyMutex cache_mutex = LAZY_MUTEX_INITIALIZER;
+
+static void lock_cache() {
+    lazy_mutex_lock(&cache_mutex);
+}
+
+static void unlock_cache() {
+    lazy_mutex_unlock(&cache_mutex);
+}
+
+static inline size_t glyph_bitmap_size(const EpdFont* font, const EpdGlyph* glyph) {
+    return glyph_byte_width(font, glyph) * glyph->height;
+}
+
+static inline CacheEntry** bucket_of(const EpdFont* font, const EpdGlyph* glyph) {
+    uint32_t key = (uint32_t)(uintptr_t)glyph ^ ((uint32_t)(uintptr_t)font >> 4);
+    return &cache.buckets[((key >> 2) * 2654435761u) >> 25 & (NUM_BUCKETS - 1)];
+}
+
+/// Decompress a zlib stream, the cache must be locked.
+static int uncompress(
+    uint8_t* dest, size_t uncompressed_size, const uint8_t* source, size_t source_size
+) {
+    if (uncompressed_size == 0 || dest == NULL || source_size == 0 || source == NULL) {
+        return -1;
+    }
+    if (cache.decompressor == NULL) {
+        cache.decompressor = malloc(sizeof(tinfl_decompressor));
+        if (cache.decompressor == NULL) {
+            // Out of memory
+            return -1;
+        }
+    }
+    tinfl_init(cache.decompressor);
+
+    // we know everything will fit into the buffer.
+    tinfl_status decomp_status = tinfl_decompress(
+        cache.decompressor,
+        source,
+        &source_size,
+        dest,
+        dest,
+        &uncompressed_size,
+        TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF
+    );
+    if (decomp_status != TINFL_STATUS_DONE) {
+        return decomp_status;
+    }
+    return 0;
+}
+
+/// Set `n` bits of `dest`, starting at bit `start`.
+static inline void set_bits(uint8_t* dest, int start, int n) {
+    int end = start + n;
+    if (start / 8 == end / 8) {
+        dest[start / 8] |= ((1 << n) - 1) << (start % 8);
+        return;
+    }
+    if (start % 8) {
+        dest[start / 8] |= 0xFF << (start % 8);
+        start += 8 - start % 8;
+    }
+    for (int i = start / 8; i < end / 8; i++) {
+        dest[i] = 0xFF;
+    }
+    if (end % 8) {
+        dest[end / 8] |= (1 << (end % 8)) - 1;
+    }
+}
+
+/// Add `n` bits from `src` to `dest`, starting at bit `start`. Bits of `dest` must be zero.
+static inline void add_bits(uint8_t* dest, int start, const uint8_t* src, int n) {
+    uint8_t* d = dest + start / 8;
+    int shift = start % 8;
+    int bytes = (n + 7) / 8;
+    if (shift == 0) {
+        memcpy(d, src, bytes);
+        return;
+    }
+    for (int i = 0; i < bytes; i++) {
+        d[i] |= src[i] << shift;
+        // the upper bits of a byte go to the next one, if they are used
+        if (i * 8 + 8 - shift < n) {
+            d[i + 1] = src[i] >> (8 - shift);
+        }
+    }
+}
+
+/**
+ * Decode a run-length encoded glyph bitmap of `size` bytes with `bpp` bits per pixel,
+ * see `EPD_COMPRESSION_RLE`. Runs of uncovered pixels are skipped,
+ * covered pixels are filled and literal pixels copied a byte at a time.
+ */
+static inline bool decode_rle(
+    const uint8_t* source, size_t source_size, uint8_t* dest, size_t size, int bpp
+) {
+    const uint8_t* end = source + source_size;
+    const int total_bits = size * 8;
+    memset(dest, 0, size);
+
+    int bit = 0;
+    while (bit < total_bits) {
+        if (source == end) {
+            return false;
+        }
+        uint8_t token = *source++;
+        int bits = ((token & 0x3F) + 1) * bpp;
+        if (bit + bits > total_bits) {
+            return false;
+        }
+        switch (token >> 6) {
+            case 0:
+                break;
+            case 1:
+                set_bits(dest, bit, bits);
+                break;
+            case 2:
+                if (end - source < (bits + 7) / 8) {
+                    return false;
+                }
+                add_bits(dest, bit, source, bits);
+                source += (bits + 7) / 8;
+                break;
+            default:
+                return false;
+        }
+        bit += bits;
+    }
+    return source == end;
+}
+
+/// Decode a run-length encoded glyph with a decoder specialized for the bit depth.
+static bool decode_rle_glyph(
+    const EpdFont* font, const EpdGlyph* glyph, const uint8_t* source, uint8_t* dest
+) {
+    size_t size = glyph_bitmap_size(font, glyph);
+    switch (glyph_bits_per_pixel(font)) {
+        case 1:
+            return decode_rle(source, glyph->compressed_size, dest, size, 1);
+        case 2:
+            return decode_rle(source, glyph->compressed_size, dest, size, 2);
+        default:
+            return decode_rle(source, glyph->compressed_size, dest, size, 4);
+    }
+}
+
+static void unlink_entry(CacheEntry* entry) {
+    if (entry->newer != NULL) {
+        entry->newer->older = entry->older;
+    } else {
+        cache.newest = entry->older;
+    }
+    if (entry->older != NULL) {
+        entry->older->newer = entry->newer;
+    } else {
+        cache.oldest = entry->newer;
+    }
+}
+
+static void push_newest(CacheEntry* entry) {
+    entry->newer = NULL;
+    entry->older = cache.newest;
+    if (cache.newest != NULL) {
+        cache.newest->newer = entry;
+    } else {
+        cache.oldest = entry;
+    }
+    cache.newest = entry;
+}
+
+static void remove_entry(CacheEntry* entry) {
+    CacheEntry** link = bucket_of(entry->font, entry->glyph);
+    while (*link != entry) {
+        link = &(*link)->next_in_bucket;
+    }
+    *link = entry->next_in_bucket;
+    unlink_entry(entry);
+    cache.used -= entry->size;
+    heap_caps_free(entry);
+}
+
+static void evict_oldest() {
+    remove_entry(cache.oldest);
+}
+
+/// Free all entries, the decompressor and the scratch buffers, the cache must be locked.
+static void clear_locked() {
+    while (cache.oldest != NULL) {
+        evict_oldest();
+    }
+    free(cache.decompressor);
+    cache.decompressor = NULL;
+    heap_caps_free(cache.scratch);
+    cache.scratch = NULL;
+    cache.scratch_size = 0;
+    heap_caps_free(cache.source);
+    cache.source = NULL;
+    cache.source_size = 0;
+}
+
+/// Make sure a scratch buffer holds at least `needed` bytes.
+static uint8_t* reserve(uint8_t** buffer, size_t* size, size_t needed) {
+    if (*size < needed) {
+        heap_caps_free(*buffer);
+        *size = 0;
+        *buffer = heap_caps_malloc(needed, MALLOC_CAP_8BIT);
+        if (*buffer == NULL) {
+            return NULL;
+        }
+        *size = needed;
+    }
+    return *buffer;
+}
+
+/// Write the bitmap of a glyph to `dest`, the cache must be locked.
+static bool load_bitmap(const EpdFont* font, const EpdGlyph* glyph, uint8_t* dest) {
+    size_t bitmap_size = glyph_bitmap_size(font, glyph);
+    if (!font->compressed) {
+        if (font->bitmap == NULL) {
+            return font->read_data(font, glyph->data_offset, dest, bitmap_size);
+        }
+        memcpy(dest, &font->bitmap[glyph->data_offset], bitmap_size);
+        return true;
+    }
+
+    const uint8_t* source = NULL;
+    if (font->bitmap != NULL) {
+        source = &font->bitmap[glyph->data_offset];
+    } else {
+        uint8_t* buffer = reserve(&cache.source, &cache.source_size, glyph->compressed_size);
+        if (buffer == NULL
+            || !font->read_data(font, glyph->data_offset, buffer, glyph->compressed_size)) {
+            return false;
+        }
+        source = buffer;
+    }
+    if (font->compressed == EPD_COMPRESSION_RLE) {
+        return decode_rle_glyph(font, glyph, source, dest);
+    }
+    return uncompress(dest, bitmap_size, source, glyph->compressed_size) == 0;
+}
+
+/// Load a glyph that is not cached into a new entry, or the scratch buffer.
+static const uint8_t* load_uncached(const EpdFont* font, const EpdGlyph* glyph) {
+    size_t bitmap_size = glyph_bitmap_size(font, glyph);
+    size_t entry_size = sizeof(CacheEntry) + bitmap_size;
+
+    if (entry_size <= cache.budget) {
+        while (cache.used + entry_size > cache.budget) {
+            evict_oldest();
+            cache.evictions++;
+        }
+        CacheEntry* entry = heap_caps_malloc(entry_size, cache.heap_caps);
+        if (entry != NULL) {
+            if (!load_bitmap(font, glyph, entry->bitmap)) {
+                heap_caps_free(entry);
+                return NULL;
+            }
+            entry->font = font;
+            entry->glyph = glyph;
+            entry->size = entry_size;
+            CacheEntry** bucket = bucket_of(font, glyph);
+            entry->next_in_bucket = *bucket;
+            *bucket = entry;
+            push_newest(entry);
+            cache.used += entry_size;
+            return entry->bitmap;
+        }
+    }
+
+    uint8_t* scratch = reserve(&cache.scratch, &cache.scratch_size, bitmap_size);
+    if (scratch == NULL || !load_bitmap(font, glyph, scratch)) {
+        return NULL;
+    }
+    return scratch;
+}
+
+/// Glyphs of compressed fonts and fonts read from storage go through the cache.
+static inline bool uses_cache(const EpdFont* font) {
+    return font->compressed || font->bitmap == NULL;
+}
+
+const uint8_t* glyph_cache_acquire(const EpdFont* font, const EpdGlyph* glyph) {
+    if (!uses_cache(font)) {
+        return &font->bitmap[glyph->data_offset];
+    }
+
+    lock_cache();
+    if (glyph_bitmap_size(font, glyph) == 0) {
+        static const uint8_t empty_bitmap = 0;
+        return &empty_bitmap;
+    }
+
+    for (CacheEntry* entry = *bucket_of(font, glyph); entry != NULL;
+         entry = entry->next_in_bucket) {
+        if (entry->glyph == glyph && entry->font == font) {
+            if (entry != cache.newest) {
+                unlink_entry(entry);
+                push_newest(entry);
+            }
+            cache.hits++;
+            return entry->bitmap;
+        }
+    }
+
+    cache.misses++;
+    const uint8_t* bitmap = load_uncached(font, glyph);
+    if (bitmap == NULL) {
+        ESP_LOGE("font", "glyph decompression failed.");
+    }
+    return bitmap;
+}
+
+void glyph_cache_release(const EpdFont* font) {
+    if (uses_cache(font)) {
+        unlock_cache();
+    }
+}
+
+void glyph_cache_forget(const EpdFont* font) {
+    lock_cache();
+    CacheEntry* entry = cache.oldest;
+    while (entry != NULL) {
+        CacheEntry* newer = entry->newer;
+        if (entry->font == font) {
+            remove_entry(entry);
+        }
+        entry = newer;
+    }
+    unlock_cache();
+}
+
+enum EpdDrawError epd_decompress_glyph(
+    const EpdFont* font, const EpdGlyph* glyph, uint8_t* buffer
+) {
+    if (glyph_bitmap_size(font, glyph) == 0) {
+        return EPD_DRAW_SUCCESS;
+    }
+    if (!uses_cache(font)) {
+        memcpy(buffer, &font->bitmap[glyph->data_offset], glyph_bitmap_size(font, glyph));
+        return EPD_DRAW_SUCCESS;
+    }
+    lock_cache();
+    bool success = load_bitmap(font, glyph, buffer);
+    unlock_cache();
+    if (!success) {
+        ESP_LOGE("font", "glyph decompression failed.");
+        return EPD_DRAW_FAILED_ALLOC;
+    }
+    return EPD_DRAW_SUCCESS;
+}
+
+void epd_glyph_cache_configure(size_t budget_bytes, uint32_t heap_caps) {
+    lock_cache();
+    clear_locked();
+    cache.budget = budget_bytes;
+    cache.heap_caps = heap_caps;
+    cache.hits = 0;
+    cache.misses = 0;
+    cache.evictions = 0;
+    unlock_cache();
+}
+
+void epd_glyph_cache_clear() {
+    lock_cache();
+    clear_locked();
+    unlock_cache();
+}
+
+EpdGlyphCacheStats epd_glyph_cache_stats() {
+    lock_cache();
+    EpdGlyphCacheStats stats = {
+        .hits = cache.hits,
+        .misses = cache.misses,
+        .evictions = cache.evictions,
+        .used_bytes = cache.used,
+        .budget_bytes = cache.budget,
+    };
+    unlock_cache();
+    return stats;
+}
@@ -0,0 +1,39 @@
+/**
+ * Access to glyph bitmaps for the font drawing functions.
+ *
+ * Glyphs of compressed fonts are decompressed into a bounded LRU cache,
+ * see `epd_glyph_cache_configure()`.
+ */
+
+#pragma once
+
+#include "epd_internals.h"
+
+/// Bits per pixel of the glyph bitmaps of a font.
+static inline int glyph_bits_per_pixel(const EpdFont* font) {
+    return font->bits_per_pixel ? font->bits_per_pixel : 4;
+}
+
+/// Bytes per row of a glyph bitmap.
+static inline int glyph_byte_width(const EpdFont* font, const EpdGlyph* glyph) {
+    return (glyph->width * glyph_bits_per_pixel(font) + 7) / 8;
+}
+
+/**
+ * Get the bitmap of a glyph, decompressed for compressed fonts.
+ *
+ * For compressed fonts, this locks the cache: The bitmap stays valid until
+ * `glyph_cache_release()` is called with the same font, which must happen in any case.
+ * Returns NULL if the glyph could not be decompressed.
+ */
+const uint8_t* glyph_cache_acquire(const EpdFont* font, const EpdGlyph* glyph);
+
+/**
+ * Release the bitmap returned by the last `glyph_cache_acquire()` for this font.
+ */
+void glyph_cache_release(const EpdFont* font);
+
+/**
+ * Drop all cached glyphs of a font, before its memory is released.
+ */
+void glyph_cache_forget(const EpdFont* font);
@@ -22,6 +22,89 @@
 #endif
 
 static bool already_initialized = 0;
+static bool mono_already_initialized = 0;
+
+/// Bytes per line of the indeterminate pixel mask.
+static inline int mask_stride() {
+    return (epd_width() + 7) / 8;
+}
+
+static inline uint8_t get_nibble(const uint8_t* line, int x) {
+    return x % 2 ? line[x / 2] >> 4 : line[x / 2] & 0x0F;
+}
+
+static inline void set_nibble(uint8_t* line, int x, uint8_t value) {
+    if (x % 2) {
+        line[x / 2] = (line[x / 2] & 0x0F) | (value << 4);
+    } else {
+        line[x / 2] = (line[x / 2] & 0xF0) | value;
+    }
+}
+
+/**
+ * Prepare pixels left in an unknown state by an aborted update for redrawing.
+ * Within `area`, their back buffer value is set to the extreme opposite of their target,
+ * so the next difference image contains a full transition for them.
+ */
+static void correct_indeterminate_pixels(EpdiyHighlevelState* state, EpdRect area) {
+    int x_start = area.x > 0 ? area.x : 0;
+    int y_start = area.y > 0 ? area.y : 0;
+    int x_end = area.x + area.width < epd_width() ? area.x + area.width : epd_width();
+    int y_end = area.y + area.height < epd_height() ? area.y + area.height : epd_height();
+    int stride = mask_stride();
+
+    for (int y = y_start; y < y_end; y++) {
+        uint8_t* mask = state->indeterminate_mask + stride * y;
+        const uint8_t* lfb = state->front_fb + epd_width() / 2 * y;
+        uint8_t* lbb = state->back_fb + epd_width() / 2 * y;
+        for (int x = x_start; x < x_end; x++) {
+            if (mask[x / 8] & (1 << (x % 8))) {
+                set_nibble(lbb, x, get_nibble(lfb, x) >= 8 ? 0x0 : 0xF);
+                mask[x / 8] &= ~(1 << (x % 8));
+            }
+        }
+    }
+
+    state->indeterminate_pending = false;
+    int mask_size = stride * epd_height();
+    for (int i = 0; i < mask_size; i++) {
+        if (state->indeterminate_mask[i]) {
+            state->indeterminate_pending = true;
+            break;
+        }
+    }
+}
+
+/**
+ * Update the back buffer after an aborted update, according to the transitions
+ * which were completed. Pixels with partially driven transitions are marked as indeterminate.
+ */
+static void apply_abort_state(EpdiyHighlevelState* state, const EpdAbortState* abort_state) {
+    int stride = mask_stride();
+
+    for (int y = 0; y < epd_height(); y++) {
+        if (!state->dirty_lines[y]) {
+            continue;
+        }
+        uint8_t* mask = state->indeterminate_mask + stride * y;
+        const uint8_t* lfb = state->front_fb + epd_width() / 2 * y;
+        uint8_t* lbb = state->back_fb + epd_width() / 2 * y;
+        for (int x = 0; x < epd_width(); x++) {
+            uint8_t from = get_nibble(lbb, x);
+            uint8_t to = get_nibble(lfb, x);
+            if (from == to) {
+                continue;
+            }
+            if (abort_state->indeterminate[to] & (1 << from)) {
+                set_nibble(lbb, x, to);
+                mask[x / 8] |= 1 << (x % 8);
+                state->indeterminate_pending = true;
+            } else if (abort_state->completed[to] & (1 << from)) {
+                set_nibble(lbb, x, to);
+            }
+        }
+    }
+}
 
 EpdiyHighlevelState epd_hl_init(const EpdWaveform* waveform) {
     assert(!already_initialized);
@@ -48,6 +131,13 @@ EpdiyHighlevelState epd_hl_init(const EpdWaveform* waveform) {
     state.dirty_columns
         = heap_caps_aligned_alloc(16, epd_width() / 2, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
     assert(state.dirty_columns != NULL);
+    state.transitions = malloc(sizeof(EpdTransitionHistogram));
+    assert(state.transitions != NULL);
+    state.line_transitions = malloc(epd_height() * sizeof(uint32_t));
+    assert(state.line_transitions != NULL);
+    state.indeterminate_mask = heap_caps_calloc(1, mask_stride() * epd_height(), MALLOC_CAP_SPIRAM);
+    assert(state.indeterminate_mask != NULL);
+    state.indeterminate_pending = false;
     state.waveform = waveform;
 
     memset(state.front_fb, 0xFF, fb_size);
@@ -117,14 +207,22 @@ enum EpdDrawError epd_hl_update_area(
 
     uint32_t ts = esp_timer_get_time() / 1000;
 
+    if (state->indeterminate_pending) {
+        correct_indeterminate_pixels(state, area);
+    }
+
     // FIXME: use crop information here, if available
-    EpdRect diff_area = epd_difference_image_cropped(
+    EpdRect diff_area = epd_difference_image_base(
         state->front_fb,
         state->back_fb,
         area,
+        epd_width(),
+        epd_height(),
         state->difference_fb,
         state->dirty_lines,
-        state->dirty_columns
+        state->dirty_columns,
+        state->transitions,
+        state->line_transitions
     );
 
     if (diff_area.height == 0 || diff_area.width == 0) {
@@ -133,13 +231,18 @@ enum EpdDrawError epd_hl_update_area(
 
     uint32_t t1 = esp_timer_get_time() / 1000;
 
+    // Only the vertical extent of the difference is used for cropping, so the render pipeline
+    // skips the lines outside of it. Horizontally, undrawn columns are masked instead.
     diff_area.x = 0;
-    diff_area.y = 0;
     diff_area.width = epd_width();
-    diff_area.height = epd_height();
+
+    EpdDrawHints hints = {
+        .transitions = state->transitions,
+        .line_transitions = state->line_transitions,
+    };
 
     enum EpdDrawError err = EPD_DRAW_SUCCESS;
-    err = epd_draw_base(
+    err = epd_draw_base_with_hints(
         epd_full_screen(),
         state->difference_fb,
         diff_area,
@@ -147,11 +250,23 @@ enum EpdDrawError epd_hl_update_area(
         temperature,
         state->dirty_lines,
         state->dirty_columns,
-        state->waveform
+        state->waveform,
+        &hints
     );
 
     uint32_t t2 = esp_timer_get_time() / 1000;
 
+    // the display was not driven, so the next update draws the same difference
+    if (err & EPD_DRAW_POWER_FAILED) {
+        return err;
+    }
+
+    EpdAbortState abort_state;
+    if ((err & EPD_DRAW_ABORTED) && epd_get_abort_state(&abort_state)) {
+        apply_abort_state(state, &abort_state);
+        return err;
+    }
+
     diff_area.x = 0;
     diff_area.y = 0;
     diff_area.width = epd_width();
@@ -206,6 +321,9 @@ void epd_fullclear(EpdiyHighlevelState* state, int temperature) {
     enum EpdDrawError err = epd_hl_update_screen(state, MODE_GC16, temperature);
     assert(err == EPD_DRAW_SUCCESS);
     epd_clear();
+
+    memset(state->indeterminate_mask, 0, mask_stride() * epd_height());
+    state->indeterminate_pending = false;
 }
 
 void epd_hl_waveform(EpdiyHighlevelState* state, const EpdWaveform* waveform) {
@@ -213,4 +331,229 @@ void epd_hl_waveform(EpdiyHighlevelState* state, const EpdWaveform* waveform) {
         waveform = epd_get_display()->default_waveform;
     }
     state->waveform = waveform;
-}
\ No newline at end of file
+}
+
+/// Which transitions a pass of a monochrome update drives.
+enum MonoPass {
+    /// Drive pixels from white to black, assuming a white display.
+    MONO_DARKEN,
+    /// Drive pixels from black to white, assuming a black display.
+    MONO_LIGHTEN,
+};
+
+/// Line source argument of a monochrome update pass.
+typedef struct {
+    const EpdiyMonoState* state;
+    enum MonoPass pass;
+} MonoPassContext;
+
+/// Bytes per line buffer of the monochrome state, aligned for word access by the LUT functions.
+static inline int mono_buffer_stride() {
+    return (mask_stride() + 15) / 16 * 16;
+}
+
+static inline uint32_t load32(const uint8_t* ptr) {
+    uint32_t value;
+    memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+static inline void store32(uint8_t* ptr, uint32_t value) {
+    memcpy(ptr, &value, sizeof(value));
+}
+
+/**
+ * The 8ppB input bits of a pass for 32 pixels.
+ * Only pixels within the column mask which differ in the direction of the pass are driven:
+ * 0 bits darken a previously white display, 1 bits lighten a previously black display.
+ */
+static inline uint32_t
+mono_pass_word(uint32_t front, uint32_t back, uint32_t mask, enum MonoPass pass) {
+    if (pass == MONO_DARKEN) {
+        return ~(back & ~front & mask);
+    }
+    return ~back & front & mask;
+}
+
+/**
+ * Compute the 8ppB input bits of pass for line `y` into `out`.
+ * Returns whether any pixel of the line is driven.
+ */
+static bool mono_pass_bits(const EpdiyMonoState* state, int y, enum MonoPass pass, uint8_t* out) {
+    int stride = mask_stride();
+    const uint8_t* mask = state->line_buffers;
+    const uint8_t* front = state->front_fb + stride * y;
+    const uint8_t* back = state->back_fb + stride * y;
+    uint32_t no_op = pass == MONO_DARKEN ? 0xFFFFFFFF : 0;
+    uint32_t driven = 0;
+
+    int i = 0;
+    for (; i + 4 <= stride; i += 4) {
+        uint32_t bits = mono_pass_word(load32(front + i), load32(back + i), load32(mask + i), pass);
+        store32(out + i, bits);
+        driven |= bits ^ no_op;
+    }
+    for (; i < stride; i++) {
+        out[i] = mono_pass_word(front[i], back[i], mask[i], pass);
+        driven |= (uint8_t)(out[i] ^ no_op);
+    }
+    return driven != 0;
+}
+
+/// Line source of a monochrome update pass, computes the difference on the fly.
+static const uint8_t* mono_pass_line(int row, int frame, int thread_id, void* arg) {
+    const MonoPassContext* ctx = arg;
+    uint8_t* out = ctx->state->line_buffers + (1 + thread_id) * mono_buffer_stride();
+    mono_pass_bits(ctx->state, row, ctx->pass, out);
+    return out;
+}
+
+/// Set the back buffer lines of a completed pass to the state they were driven to.
+static void mono_apply_pass(EpdiyMonoState* state, enum MonoPass pass, const bool* lines) {
+    int stride = mask_stride();
+    uint8_t* bits = state->line_buffers + mono_buffer_stride();
+
+    for (int y = 0; y < epd_height(); y++) {
+        if (!lines[y]) {
+            continue;
+        }
+        mono_pass_bits(state, y, pass, bits);
+        uint8_t* back = state->back_fb + stride * y;
+        for (int i = 0; i < stride; i++) {
+            back[i] = pass == MONO_DARKEN ? back[i] & bits[i] : back[i] | bits[i];
+        }
+    }
+}
+
+EpdiyMonoState epd_hl_mono_init(const EpdWaveform* waveform) {
+    assert(!mono_already_initialized);
+    if (waveform == NULL) {
+        waveform = epd_get_display()->default_waveform;
+    }
+
+    int fb_size = mask_stride() * epd_height();
+
+    EpdiyMonoState state;
+    state.back_fb = heap_caps_aligned_alloc(16, fb_size, MALLOC_CAP_8BIT);
+    assert(state.back_fb != NULL);
+    state.front_fb = heap_caps_aligned_alloc(16, fb_size, MALLOC_CAP_8BIT);
+    assert(state.front_fb != NULL);
+    state.dirty_lines = malloc(2 * epd_height() * sizeof(bool));
+    assert(state.dirty_lines != NULL);
+    state.line_buffers = heap_caps_aligned_alloc(
+        16,
+        (1 + EPD_NUM_RENDER_THREADS) * mono_buffer_stride(),
+        MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT
+    );
+    assert(state.line_buffers != NULL);
+    state.waveform = waveform;
+
+    memset(state.front_fb, 0xFF, fb_size);
+    memset(state.back_fb, 0xFF, fb_size);
+
+    mono_already_initialized = true;
+    return state;
+}
+
+uint8_t* epd_hl_mono_get_framebuffer(EpdiyMonoState* state) {
+    assert(state != NULL);
+    return state->front_fb;
+}
+
+enum EpdDrawError epd_hl_mono_update_screen(
+    EpdiyMonoState* state, enum EpdDrawMode mode, int temperature
+) {
+    return epd_hl_mono_update_area(state, mode, temperature, epd_full_screen());
+}
+
+enum EpdDrawError epd_hl_mono_update_area(
+    EpdiyMonoState* state, enum EpdDrawMode mode, int temperature, EpdRect area
+) {
+    assert(state != NULL);
+
+    area = _inverse_rotated_area(area.x, area.y, area.width, area.height);
+    int x_start = area.x > 0 ? area.x : 0;
+    int y_start = area.y > 0 ? area.y : 0;
+    int x_end = area.x + area.width < epd_width() ? area.x + area.width : epd_width();
+    int y_end = area.y + area.height < epd_height() ? area.y + area.height : epd_height();
+    if (x_start >= x_end || y_start >= y_end) {
+        return EPD_DRAW_SUCCESS;
+    }
+
+    uint32_t ts = esp_timer_get_time() / 1000;
+
+    uint8_t* mask = state->line_buffers;
+    memset(mask, 0, mask_stride());
+    for (int x = x_start; x < x_end; x++) {
+        mask[x / 8] |= 1 << (x % 8);
+    }
+
+    uint8_t* scratch = state->line_buffers + mono_buffer_stride();
+    enum MonoPass passes[2] = { MONO_DARKEN, MONO_LIGHTEN };
+    int first_line[2] = { epd_height(), epd_height() };
+    int last_line[2] = { -1, -1 };
+    memset(state->dirty_lines, 0, 2 * epd_height() * sizeof(bool));
+    for (int p = 0; p < 2; p++) {
+        bool* lines = state->dirty_lines + p * epd_height();
+        for (int y = y_start; y < y_end; y++) {
+            lines[y] = mono_pass_bits(state, y, passes[p], scratch);
+            if (lines[y]) {
+                first_line[p] = y < first_line[p] ? y : first_line[p];
+                last_line[p] = y;
+            }
+        }
+    }
+
+    uint32_t t1 = esp_timer_get_time() / 1000;
+
+    enum EpdDrawError err = EPD_DRAW_SUCCESS;
+    for (int p = 0; p < 2; p++) {
+        if (last_line[p] < 0) {
+            continue;
+        }
+        const bool* lines = state->dirty_lines + p * epd_height();
+        EpdRect crop = {
+            .x = 0,
+            .y = first_line[p],
+            .width = epd_width(),
+            .height = last_line[p] - first_line[p] + 1,
+        };
+        MonoPassContext ctx = { .state = state, .pass = passes[p] };
+        enum EpdDrawMode pass_mode = passes[p] == MONO_DARKEN ? PREVIOUSLY_WHITE : PREVIOUSLY_BLACK;
+        err = epd_draw_line_source(
+            epd_full_screen(),
+            mono_pass_line,
+            &ctx,
+            crop,
+            MODE_PACKING_8PPB | pass_mode | mode,
+            temperature,
+            lines,
+            NULL,
+            state->waveform,
+            NULL
+        );
+        // the back buffer of an aborted pass stays unchanged, so it is driven again next time
+        if (err != EPD_DRAW_SUCCESS) {
+            return err;
+        }
+        mono_apply_pass(state, passes[p], lines);
+    }
+
+    uint32_t t2 = esp_timer_get_time() / 1000;
+
+    ESP_LOGI("epdiy", "mono diff: %dms, draw: %dms, total: %dms", t1 - ts, t2 - t1, t2 - ts);
+    return err;
+}
+
+void epd_hl_mono_set_all_white(EpdiyMonoState* state) {
+    assert(state != NULL);
+    memset(state->front_fb, 0xFF, mask_stride() * epd_height());
+}
+
+void epd_hl_mono_fullclear(EpdiyMonoState* state, int temperature) {
+    assert(state != NULL);
+    epd_hl_mono_set_all_white(state);
+    enum EpdDrawError err = epd_hl_mono_update_screen(state, MODE_DU, temperature);
+    assert(err == EPD_DRAW_SUCCESS);
+    epd_clear();
+}
@@ -0,0 +1,34 @@
+/**
+ * Mutexes which are created on first use.
+ *
+ * Used for state that can be accessed before `epd_init()`, like the glyph and text caches.
+ */
+
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+typedef struct {
+    portMUX_TYPE init_lock;
+    StaticSemaphore_t buffer;
+    SemaphoreHandle_t volatile handle;
+} LazyMutex;
+
+#define LAZY_MUTEX_INITIALIZER { .init_lock = portMUX_INITIALIZER_UNLOCKED, .handle = NULL }
+
+/// Take the mutex, creating it if it does not exist yet.
+static inline void lazy_mutex_lock(LazyMutex* mutex) {
+    if (mutex->handle == NULL) {
+        taskENTER_CRITICAL(&mutex->init_lock);
+        if (mutex->handle == NULL) {
+            mutex->handle = xSemaphoreCreateMutexStatic(&mutex->buffer);
+        }
+        taskEXIT_CRITICAL(&mutex->init_lock);
+    }
+    xSemaphoreTake(mutex->handle, portMAX_DELAY);
+}
+
+static inline void lazy_mutex_unlock(LazyMutex* mutex) {
+    xSemaphoreGive(mutex->handle);
+}
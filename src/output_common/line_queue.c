@@ -80,6 +80,12 @@ int IRAM_ATTR lq_read(LineQueue_t* queue, uint8_t* dst) {
     return 0;
 }
 
+int IRAM_ATTR lq_fill(LineQueue_t* queue) {
+    int current = atomic_load_explicit(&queue->current, memory_order_acquire);
+    int last = atomic_load_explicit(&queue->last, memory_order_acquire);
+    return (current - last + queue->size) % queue->size;
+}
+
 void IRAM_ATTR lq_reset(LineQueue_t* queue) {
     queue->current = 0;
     queue->last = 0;
@@ -35,6 +35,9 @@ void lq_commit(LineQueue_t* queue);
 /// Returns 0 for a successful read to `dst`, -1 for a failed read (empty queue).
 int lq_read(LineQueue_t* queue, uint8_t* dst);
 
+/// Number of elements currently in the queue.
+int lq_fill(LineQueue_t* queue);
+
 /// Reset the queue into an empty state.
 /// This operation is *not* atomic!
 void lq_reset(LineQueue_t* queue);
@@ -68,6 +68,27 @@ void get_buffer_params(
     *pixels_per_byte = width_divider;
 }
 
+static void IRAM_ATTR build_frame_lut(RenderContext_t* ctx, int frame) {
+    if (ctx->lut_frame == frame) {
+        return;
+    }
+    const EpdWaveformPhases* phases
+        = ctx->waveform->mode_data[ctx->waveform_index]->range_data[ctx->waveform_range];
+
+    assert(ctx->lut_build_func != NULL);
+    ctx->lut_build_func(ctx->conversion_lut, phases, frame);
+    ctx->lut_frame = frame;
+}
+
+void prepare_first_frame_lut(RenderContext_t* ctx) {
+    for (int frame = 0; frame < ctx->cycle_frames; frame++) {
+        if (frame_is_active(ctx, frame)) {
+            build_frame_lut(ctx, frame);
+            return;
+        }
+    }
+}
+
 void IRAM_ATTR prepare_context_for_next_frame(RenderContext_t* ctx) {
     int frame_time = DEFAULT_FRAME_TIME;
     if (ctx->phase_times != NULL) {
@@ -79,14 +100,10 @@ void IRAM_ATTR prepare_context_for_next_frame(RenderContext_t* ctx) {
     }
     ctx->frame_time = frame_time;
 
-    const EpdWaveformPhases* phases
-        = ctx->waveform->mode_data[ctx->waveform_index]->range_data[ctx->waveform_range];
-
-    assert(ctx->lut_build_func != NULL);
-    ctx->lut_build_func(ctx->conversion_lut, phases, ctx->current_frame);
+    build_frame_lut(ctx, ctx->current_frame);
 
-    ctx->lines_prepared = 0;
-    ctx->lines_consumed = 0;
+    ctx->lines_prepared = ctx->lines_start;
+    ctx->lines_consumed = ctx->lines_start;
 }
 
 void epd_populate_line_mask(uint8_t* line_mask, const uint8_t* dirty_columns, int mask_len) {
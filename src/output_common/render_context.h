@@ -10,13 +10,18 @@
 #include "line_queue.h"
 #include "lut.h"
 
-#define NUM_RENDER_THREADS 2
+#define NUM_RENDER_THREADS EPD_NUM_RENDER_THREADS
 
 typedef struct {
     EpdRect area;
     EpdRect crop_to;
     const bool* drawn_lines;
     const uint8_t* data_ptr;
+    /// If not NULL, input lines are requested from this callback instead of `data_ptr`.
+    EpdLineSource line_source;
+    void* line_source_arg;
+    /// Byte offset of the first used pixel in each row of a line source.
+    int line_source_x_offset;
 
     /// The display width for quick access.
     int display_width;
@@ -26,12 +31,42 @@ typedef struct {
     /// index of the next line of data to process
     atomic_int lines_prepared;
     volatile int lines_consumed;
-    int lines_total;
+    /// First line of the vertical window processed in each frame.
+    /// Lines outside of [lines_start, lines_end) are skipped without fetching data.
+    int lines_start;
+    /// Line after the vertical window, not a count of lines.
+    int lines_end;
 
     /// frame currently in the current update cycle
     int current_frame;
     /// number of frames in the current update cycle
     int cycle_frames;
+    /// Bit set of frames in the update cycle which drive at least one pixel.
+    /// Inactive frames are skipped.
+    uint32_t active_frames[8];
+    /// Number of line buffer underruns in the current frame.
+    volatile int frame_underruns;
+    /// Lowest line queue fill level seen while lines were still being prepared.
+    volatile int frame_min_queue_fill;
+    /// First line of the current frame which was not prepared in time, or -1.
+    volatile int frame_underrun_line;
+    /// Lines of the frame window above this one are output as no-op lines,
+    /// to repeat the rest of a frame after an underrun.
+    int first_driven_line;
+    /// Set if frames with an underrun are repeated. All lines after an underrun are then
+    /// output as no-op lines, otherwise only the lines which were not prepared in time.
+    bool repeat_underrun_frames;
+
+    /// Set to abort the current or next update at its next frame boundary, cleared when
+    /// an update finishes.
+    atomic_bool abort_requested;
+    /// Called at every frame boundary, aborts the update when returning true.
+    bool (*preemption_hook)(void* arg);
+    void* preemption_hook_arg;
+
+    /// For each display line, the number of frames after which
+    /// all of its transitions are done. The line is skipped afterwards.
+    uint8_t* line_end_frames;
 
     TaskHandle_t feed_tasks[NUM_RENDER_THREADS];
     SemaphoreHandle_t feed_done_smphr[NUM_RENDER_THREADS];
@@ -63,6 +98,8 @@ typedef struct {
     lut_func_t lut_lookup_func;
     /// LUT building function. Must not be NULL
     lut_build_func_t lut_build_func;
+    /// Frame of the current update the lookup table was built for, or -1.
+    int lut_frame;
 
     /// Queue of lines prepared for output to the display,
     /// one for each thread.
@@ -92,6 +129,56 @@ void get_buffer_params(
     int* pixels_per_byte
 );
 
+/**
+ * Get the input data for display line `l`, from the line source or the input buffer.
+ * The buffer parameters must have been obtained by `get_buffer_params()`.
+ */
+static inline const uint8_t* get_input_line(
+    const RenderContext_t* ctx,
+    const uint8_t* ptr_start,
+    int bytes_per_line,
+    int min_y,
+    int l,
+    int thread_id
+) {
+    if (ctx->line_source != NULL) {
+        const uint8_t* row = ctx->line_source(
+            l - ctx->area.y, ctx->current_frame, thread_id, ctx->line_source_arg
+        );
+        return row + ctx->line_source_x_offset;
+    }
+    return ptr_start + bytes_per_line * (l - min_y);
+}
+
+/**
+ * Is the given frame of the current update cycle driving any pixels?
+ */
+static inline bool frame_is_active(const RenderContext_t* ctx, int frame) {
+    return (ctx->active_frames[frame / 32] >> (frame % 32)) & 1;
+}
+
+/**
+ * Should the update be stopped before the current frame?
+ * Sets `EPD_DRAW_ABORTED` if so.
+ */
+static inline bool update_aborted(RenderContext_t* ctx) {
+    if (atomic_load(&ctx->abort_requested)
+        || (ctx->preemption_hook != NULL && ctx->preemption_hook(ctx->preemption_hook_arg))) {
+        ctx->error |= EPD_DRAW_ABORTED;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Is the display line `l` skipped in the current frame?
+ * This is the case if it is not drawn at all, or all of its transitions are done.
+ */
+static inline bool line_is_skipped(const RenderContext_t* ctx, int l) {
+    return (ctx->drawn_lines != NULL && !ctx->drawn_lines[l - ctx->area.y])
+           || ctx->current_frame >= ctx->line_end_frames[l];
+}
+
 /**
  * Prepare the render context for drawing the next frame.
  *
@@ -99,6 +186,12 @@ void get_buffer_params(
  */
 void prepare_context_for_next_frame(RenderContext_t* ctx);
 
+/**
+ * Build the lookup table for the first active frame of the update cycle ahead of time,
+ * so it is ready when the output starts.
+ */
+void prepare_first_frame_lut(RenderContext_t* ctx);
+
 /**
  * Populate an output line mask from line dirtyness with two bits per pixel.
  * If the dirtyness data is NULL, set the mask to neutral.
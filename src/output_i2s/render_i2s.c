@@ -158,6 +158,15 @@ static void i2s_end_frame() {
 
 void i2s_do_update(RenderContext_t* ctx) {
     for (uint8_t k = 0; k < ctx->cycle_frames; k++) {
+        if (!frame_is_active(ctx, ctx->current_frame)) {
+            ctx->current_frame++;
+            continue;
+        }
+
+        if (update_aborted(ctx)) {
+            break;
+        }
+
         prepare_context_for_next_frame(ctx);
 
         // start both feeder tasks
@@ -230,6 +239,12 @@ void IRAM_ATTR i2s_output_frame(RenderContext_t* ctx, int thread_id) {
 
     i2s_start_frame();
     for (int i = 0; i < ctx->display_height; i++) {
+        // no data is fetched outside of the vertical window
+        if (i < ctx->lines_start || i >= ctx->lines_end) {
+            i2s_skip_row(ctx, frame_time);
+            continue;
+        }
+
         LineQueue_t* lq = &ctx->line_queues[0];
 
         memset(line_buf, 0, ctx->display_width);
@@ -238,7 +253,7 @@ void IRAM_ATTR i2s_output_frame(RenderContext_t* ctx, int thread_id) {
 
         ctx->lines_consumed += 1;
 
-        if (ctx->drawn_lines != NULL && !ctx->drawn_lines[i - area.y]) {
+        if (line_is_skipped(ctx, i)) {
             i2s_skip_row(ctx, frame_time);
             continue;
         }
@@ -301,13 +316,13 @@ void IRAM_ATTR i2s_fetch_frame_data(RenderContext_t* ctx, int thread_id) {
     line_start_x = min(max(line_start_x, 0), ctx->display_width);
     line_end_x = min(max(line_end_x, 0), ctx->display_width);
 
+    int lines_end = min(ctx->lines_end, ctx->display_height);
     int l = 0;
-    while (l = atomic_fetch_add(&ctx->lines_prepared, 1), l < ctx->display_height) {
+    while (l = atomic_fetch_add(&ctx->lines_prepared, 1), l < lines_end) {
         // if (thread_id) gpio_set_level(15, 0);
         ctx->line_threads[l] = thread_id;
 
-        if (l < min_y || l >= max_y
-            || (ctx->drawn_lines != NULL && !ctx->drawn_lines[l - area.y])) {
+        if (l < min_y || l >= max_y || line_is_skipped(ctx, l)) {
             uint8_t* buf = NULL;
             while (buf == NULL)
                 buf = lq_current(lq);
@@ -318,7 +333,7 @@ void IRAM_ATTR i2s_fetch_frame_data(RenderContext_t* ctx, int thread_id) {
 
         uint32_t* lp = (uint32_t*)input_line;
         bool shifted = false;
-        const uint8_t* ptr = ptr_start + bytes_per_line * (l - min_y);
+        const uint8_t* ptr = get_input_line(ctx, ptr_start, bytes_per_line, min_y, l, thread_id);
 
         if (area.width == ctx->display_width && area.x == 0 && !ctx->error) {
             lp = (uint32_t*)ptr;
@@ -118,6 +118,8 @@ typedef struct {
 
     /// The number of lines of the display
     int display_lines;
+    /// The number of lines output in the current frame
+    int frame_lines;
 } s3_lcd_t;
 
 static s3_lcd_t lcd = { 0 };
@@ -158,18 +160,51 @@ static void start_ckv_cycles(int cycles) {
 }
 
 /**
- * Build the RMT signal according to the timing set in the lcd object.
+ * Set the RMT signal for a single CKV cycle, in 1/10us.
  */
-static void ckv_rmt_build_signal() {
-    int low_time = (lcd.line_length_us * 10 - lcd.config.ckv_high_time);
+static void ckv_rmt_set_signal(int high_time, int low_time) {
     volatile rmt_item32_t* rmt_mem_ptr = &(RMTMEM.chan[RMT_CKV_CHAN].data32[0]);
-    rmt_mem_ptr->duration0 = lcd.config.ckv_high_time;
+    rmt_mem_ptr->duration0 = high_time;
     rmt_mem_ptr->level0 = 1;
     rmt_mem_ptr->duration1 = low_time;
     rmt_mem_ptr->level1 = 0;
     rmt_mem_ptr[1].val = 0;
 }
 
+/**
+ * Build the RMT signal according to the timing set in the lcd object.
+ */
+static void ckv_rmt_build_signal() {
+    int low_time = (lcd.line_length_us * 10 - lcd.config.ckv_high_time);
+    ckv_rmt_set_signal(lcd.config.ckv_high_time, low_time);
+}
+
+/**
+ * Advance the gate driver by `lines` lines without outputting data,
+ * starting a new frame in the process.
+ *
+ * The source drivers keep the last latched line, which must be a no-op line.
+ */
+static void ckv_skip_lines(int lines) {
+    // According to the spec, the OC4 maximum CKV frequency is 200kHz.
+    const int high_time = 45;
+    const int low_time = 5;
+
+    ckv_rmt_set_signal(high_time, low_time);
+
+    gpio_set_level(lcd.config.bus.stv, 0);
+    start_ckv_cycles(1);
+    esp_rom_delay_us((high_time + low_time) / 10 + 1);
+    gpio_set_level(lcd.config.bus.stv, 1);
+
+    if (lines > 1) {
+        start_ckv_cycles(lines - 1);
+        esp_rom_delay_us((lines - 1) * (high_time + low_time) / 10 + 1);
+    }
+
+    ckv_rmt_build_signal();
+}
+
 /**
  * Configure the RMT peripheral for use as the CKV clock.
  */
@@ -216,7 +251,7 @@ __attribute__((optimize("O3"))) IRAM_ATTR static void lcd_isr_vsync(void* args)
     lcd_ll_clear_interrupt_status(lcd.hal.dev, intr_status);
 
     if (intr_status & LCD_LL_EVENT_VSYNC_END) {
-        int batches_needed = lcd.display_lines / LINE_BATCH;
+        int batches_needed = lcd.frame_lines / LINE_BATCH;
         if (lcd.batches >= batches_needed) {
             lcd_ll_stop(lcd.hal.dev);
             if (lcd.frame_done_cb != NULL) {
@@ -227,8 +262,8 @@ __attribute__((optimize("O3"))) IRAM_ATTR static void lcd_isr_vsync(void* args)
             // last batch
             if (lcd.batches == batches_needed - 1) {
                 lcd_ll_enable_auto_next_frame(lcd.hal.dev, false);
-                lcd_ll_set_vertical_timing(lcd.hal.dev, 1, 0, lcd.display_lines % LINE_BATCH, 10);
-                ckv_cycles = lcd.display_lines % LINE_BATCH + 10;
+                lcd_ll_set_vertical_timing(lcd.hal.dev, 1, 0, lcd.frame_lines % LINE_BATCH, 10);
+                ckv_cycles = lcd.frame_lines % LINE_BATCH + 10;
             } else {
                 lcd_ll_set_vertical_timing(lcd.hal.dev, 1, 0, LINE_BATCH, 1);
                 ckv_cycles = LINE_BATCH + 1;
@@ -413,6 +448,7 @@ static void assign_lcd_parameters_from_config(
 
     // Make sure the bounce buffers divide the display height evenly.
     lcd.display_lines = (((display_height + 7) / 8) * 8);
+    lcd.frame_lines = lcd.display_lines;
 
     lcd.line_bytes = display_width / 4;
     lcd.lcd_res_h = lcd.line_bytes / (lcd.config.bus_width / 8);
@@ -629,8 +665,20 @@ void epd_lcd_set_pixel_clock_MHz(int frequency) {
     ckv_rmt_build_signal();
 }
 
+int epd_lcd_get_pixel_clock_MHz() {
+    return lcd.config.pixel_clock / 1000 / 1000;
+}
+
 void IRAM_ATTR epd_lcd_start_frame() {
-    int initial_lines = min(LINE_BATCH, lcd.display_lines);
+    epd_lcd_start_frame_window(0, lcd.display_lines);
+}
+
+void IRAM_ATTR epd_lcd_start_frame_window(int first_line, int num_lines) {
+    assert(first_line >= 0 && num_lines > 0 && first_line + num_lines <= lcd.display_lines);
+    assert(num_lines % BOUNCE_BUF_LINES == 0);
+
+    lcd.frame_lines = num_lines;
+    int initial_lines = min(LINE_BATCH, lcd.frame_lines);
 
     // hsync: pulse with, back porch, active width, front porch
     int end_line
@@ -658,6 +706,11 @@ void IRAM_ATTR epd_lcd_start_frame() {
     fill_bounce_buffer(lcd.bounce_buffer[0]);
     fill_bounce_buffer(lcd.bounce_buffer[1]);
 
+    // lines above the window are skipped with CKV pulses only
+    if (first_line > 0) {
+        ckv_skip_lines(first_line);
+    }
+
     // the start of DMA should be prior to the start of LCD engine
     gdma_start(lcd.dma_chan, (intptr_t)&lcd.dma_nodes[0]);
 
@@ -666,7 +719,9 @@ void IRAM_ATTR epd_lcd_start_frame() {
 
     // delay 1us is sufficient for DMA to pass data to LCD FIFO
     // in fact, this is only needed when LCD pixel clock is set too high
-    gpio_set_level(lcd.config.bus.stv, 0);
+    if (first_line == 0) {
+        gpio_set_level(lcd.config.bus.stv, 0);
+    }
     // esp_rom_delay_us(1);
     //  for picture clarity, it seems to be important to start CKV at a "good"
     //  time, seemingly start or towards end of line.
@@ -44,7 +44,19 @@ void epd_lcd_deinit();
 void epd_lcd_frame_done_cb(frame_done_func_t, void* payload);
 void epd_lcd_line_source_cb(line_cb_func_t, void* payload);
 void epd_lcd_start_frame();
+/**
+ * Start a frame which only outputs `num_lines` lines, starting at display line `first_line`.
+ * Lines above the window are skipped quickly, lines below are not output at all.
+ * Skipped lines are driven with the line last output, so for `first_line > 0`,
+ * that must have been a no-op line.
+ * `num_lines` must be a multiple of the bounce buffer size (4 lines).
+ */
+void epd_lcd_start_frame_window(int first_line, int num_lines);
 /**
  * Set the LCD pixel clock frequency in MHz.
  */
 void epd_lcd_set_pixel_clock_MHz(int frequency);
+/**
+ * Get the current LCD pixel clock frequency in MHz.
+ */
+int epd_lcd_get_pixel_clock_MHz();
@@ -1,3 +1,4 @@
+#include <limits.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -20,9 +21,129 @@
 // declare vector optimized line mask application.
 void epd_apply_line_mask_VE(uint8_t* line, const uint8_t* mask, int mask_len);
 
+static inline int max(int x, int y) {
+    return x > y ? x : y;
+}
+
+/// Lower bound of the adaptive pixel clock in MHz.
+#define ADAPTIVE_PCLK_MIN_MHZ 2
+/// Number of frames with sufficient headroom before the pixel clock is raised.
+#define ADAPTIVE_PCLK_RAISE_FRAMES 32
+/// Number of draw mode / lookup method combinations to remember a pixel clock for.
+#define ADAPTIVE_PCLK_SLOTS 8
+/// Number of times the rest of a frame is repeated after underruns before giving up.
+#define ADAPTIVE_PCLK_MAX_REPEATS 3
+
+/// Pixel clock learned for a combination of draw mode and lookup method.
+typedef struct {
+    enum EpdDrawMode mode;
+    lut_func_t lookup_func;
+    /// The pixel clock to use, in MHz.
+    int pclk_mhz;
+    /// The lowest pixel clock that caused underruns, in MHz.
+    int failed_mhz;
+} LearnedPixelClock;
+
+static struct {
+    bool enabled;
+    LearnedPixelClock learned[ADAPTIVE_PCLK_SLOTS];
+    int num_learned;
+    int next_slot;
+    /// Number of consecutive frames with sufficient queue headroom.
+    int headroom_frames;
+    /// The pixel clock before the controller was enabled, in MHz.
+    int configured_mhz;
+} adaptive_pclk = { 0 };
+
+void lcd_set_adaptive_pixel_clock(bool enabled) {
+    int configured_mhz = epd_lcd_get_pixel_clock_MHz();
+    if (adaptive_pclk.enabled) {
+        configured_mhz = adaptive_pclk.configured_mhz;
+        if (!enabled && epd_lcd_get_pixel_clock_MHz() != configured_mhz) {
+            epd_lcd_set_pixel_clock_MHz(configured_mhz);
+        }
+    }
+    memset(&adaptive_pclk, 0, sizeof(adaptive_pclk));
+    adaptive_pclk.enabled = enabled;
+    adaptive_pclk.configured_mhz = configured_mhz;
+}
+
+/**
+ * Find the learned pixel clock for the current draw, or start learning it
+ * at the current pixel clock, replacing the oldest entry if necessary.
+ */
+static LearnedPixelClock* learned_pixel_clock(const RenderContext_t* ctx) {
+    for (int i = 0; i < adaptive_pclk.num_learned; i++) {
+        LearnedPixelClock* clock = &adaptive_pclk.learned[i];
+        if (clock->mode == ctx->mode && clock->lookup_func == ctx->lut_lookup_func) {
+            return clock;
+        }
+    }
+
+    LearnedPixelClock* clock = &adaptive_pclk.learned[adaptive_pclk.next_slot];
+    adaptive_pclk.next_slot = (adaptive_pclk.next_slot + 1) % ADAPTIVE_PCLK_SLOTS;
+    if (adaptive_pclk.num_learned < ADAPTIVE_PCLK_SLOTS) {
+        adaptive_pclk.num_learned++;
+    }
+
+    clock->mode = ctx->mode;
+    clock->lookup_func = ctx->lut_lookup_func;
+    clock->pclk_mhz = epd_lcd_get_pixel_clock_MHz();
+    clock->failed_mhz = epd_get_display()->bus_speed + 1;
+    adaptive_pclk.headroom_frames = 0;
+    return clock;
+}
+
+/**
+ * Adjust the pixel clock based on the line queue statistics of the last frame.
+ *
+ * After underruns, the clock is reduced by a quarter. If the line queues never ran
+ * low for a number of frames, the clock is raised by 1 MHz, up to the display's bus speed.
+ * Probing a clock that caused underruns before requires a longer streak of good frames.
+ */
+static void adapt_pixel_clock(const RenderContext_t* ctx, LearnedPixelClock* clock) {
+    const int pclk = clock->pclk_mhz;
+    const int queue_size = ctx->line_queues[0].size;
+    const int ceiling = epd_get_display()->bus_speed;
+
+    if (ctx->frame_underruns > 0) {
+        clock->failed_mhz = pclk;
+        clock->pclk_mhz = max(pclk * 3 / 4, ADAPTIVE_PCLK_MIN_MHZ);
+        adaptive_pclk.headroom_frames = 0;
+    } else if (ctx->frame_min_queue_fill > queue_size) {
+        // no lines were output while others were prepared, nothing learned.
+    } else if (ctx->frame_min_queue_fill >= queue_size / 2) {
+        adaptive_pclk.headroom_frames++;
+
+        int required = ADAPTIVE_PCLK_RAISE_FRAMES;
+        if (pclk + 1 >= clock->failed_mhz) {
+            required *= 4;
+        }
+        if (pclk < ceiling && adaptive_pclk.headroom_frames >= required) {
+            clock->pclk_mhz = pclk + 1;
+            clock->failed_mhz = max(clock->failed_mhz, pclk + 2);
+            adaptive_pclk.headroom_frames = 0;
+        }
+    } else {
+        adaptive_pclk.headroom_frames = 0;
+    }
+
+    if (clock->pclk_mhz != pclk) {
+        ESP_LOGI(
+            "epd_lcd",
+            "adapting pixel clock: %d -> %d MHz (%d underruns, min. queue fill %d)",
+            pclk,
+            clock->pclk_mhz,
+            ctx->frame_underruns,
+            ctx->frame_min_queue_fill
+        );
+        epd_lcd_set_pixel_clock_MHz(clock->pclk_mhz);
+    }
+}
+
 __attribute__((optimize("O3"))) static bool IRAM_ATTR
 retrieve_line_isr(RenderContext_t* ctx, uint8_t* buf) {
-    if (ctx->lines_consumed >= ctx->lines_total) {
+    if (ctx->lines_consumed >= ctx->lines_end) {
         return false;
     }
     int thread = ctx->line_threads[ctx->lines_consumed];
@@ -32,18 +153,40 @@ retrieve_line_isr(RenderContext_t* ctx, uint8_t* buf) {
 
     BaseType_t awoken = pdFALSE;
 
-    if (lq_read(lq, buf) != 0) {
+    // queue headroom is only meaningful while lines are still prepared
+    if (ctx->lines_prepared < ctx->lines_end) {
+        int fill = lq_fill(lq);
+        if (fill < ctx->frame_min_queue_fill) {
+            ctx->frame_min_queue_fill = fill;
+        }
+    }
+
+    bool missing = lq_read(lq, buf) != 0;
+    if (missing) {
         ctx->error |= EPD_DRAW_EMPTY_LINE_QUEUE;
-        memset(buf, 0x00, ctx->display_width / 4);
+        ctx->frame_underruns += 1;
+        if (ctx->frame_underrun_line < 0) {
+            ctx->frame_underrun_line = ctx->lines_consumed;
+        }
     }
 
-    if (ctx->lines_consumed >= ctx->display_height) {
+    // When frames are repeated, lines after an underrun are not driven either,
+    // so that the rest of the frame can be repeated as a whole.
+    if (missing || (ctx->repeat_underrun_frames && ctx->frame_underrun_line >= 0)
+        || ctx->lines_consumed < ctx->first_driven_line
+        || ctx->lines_consumed >= ctx->display_height) {
         memset(buf, 0x00, ctx->display_width / 4);
     }
     ctx->lines_consumed += 1;
     return awoken;
 }
 
+/// start LCD output of the vertical window of the current frame
+static void IRAM_ATTR start_frame_window(RenderContext_t* ctx) {
+    epd_lcd_line_source_cb((line_cb_func_t)&retrieve_line_isr, ctx);
+    epd_lcd_start_frame_window(ctx->lines_start, ctx->lines_end - ctx->lines_start);
+}
+
 /// start the next frame in the current update cycle
 static void IRAM_ATTR handle_lcd_frame_done(RenderContext_t* ctx) {
     epd_lcd_frame_done_cb(NULL, NULL);
@@ -55,22 +198,99 @@ static void IRAM_ATTR handle_lcd_frame_done(RenderContext_t* ctx) {
     portYIELD_FROM_ISR();
 }
 
+/**
+ * Check whether the last line of the current frame window was a no-op line.
+ * The source drivers hold it while the lines above the next window are skipped.
+ */
+static bool window_ends_with_noop(RenderContext_t* ctx) {
+    int min_y, max_y, bytes_per_line, _ppB;
+    const uint8_t* ptr_start;
+    get_buffer_params(ctx, &bytes_per_line, &ptr_start, &min_y, &max_y, &_ppB);
+
+    int last = ctx->lines_end - 1;
+    // all lines after an underrun are output as no-op lines if the frame is repeated
+    if (ctx->repeat_underrun_frames && ctx->frame_underrun_line >= 0) {
+        return true;
+    }
+    if (ctx->error || last < 0) {
+        return false;
+    }
+    return last < min_y || last >= max_y || last >= ctx->display_height
+           || line_is_skipped(ctx, last);
+}
+
 void lcd_do_update(RenderContext_t* ctx) {
+    LearnedPixelClock* clock = NULL;
+    bool underrun_occurred = false;
+    if (adaptive_pclk.enabled) {
+        clock = learned_pixel_clock(ctx);
+        if (clock->pclk_mhz != epd_lcd_get_pixel_clock_MHz()) {
+            epd_lcd_set_pixel_clock_MHz(clock->pclk_mhz);
+        }
+    }
+    ctx->repeat_underrun_frames = clock != NULL;
+
     epd_set_mode(1);
 
+    // Lines above the window are skipped by only advancing the gate driver, which drives
+    // them with the line held by the source drivers. Unless that is known to be a no-op line,
+    // e.g. in the first frame, the frame is output from the top instead.
+    const int window_start = ctx->lines_start;
+    bool holds_noop_line = false;
+
     for (uint8_t k = 0; k < ctx->cycle_frames; k++) {
-        epd_lcd_frame_done_cb((frame_done_func_t)handle_lcd_frame_done, ctx);
-        prepare_context_for_next_frame(ctx);
+        if (!frame_is_active(ctx, ctx->current_frame)) {
+            ctx->current_frame++;
+            continue;
+        }
+
+        if (update_aborted(ctx)) {
+            break;
+        }
+
+        ctx->lines_start = holds_noop_line ? window_start : 0;
+        ctx->first_driven_line = 0;
+
+        for (int repeats = 0;; repeats++) {
+            ctx->frame_underruns = 0;
+            ctx->frame_underrun_line = -1;
+            ctx->frame_min_queue_fill = INT_MAX;
+
+            epd_lcd_frame_done_cb((frame_done_func_t)handle_lcd_frame_done, ctx);
+            prepare_context_for_next_frame(ctx);
+
+            // start both feeder tasks
+            xTaskNotifyGive(ctx->feed_tasks[!xPortGetCoreID()]);
+            xTaskNotifyGive(ctx->feed_tasks[xPortGetCoreID()]);
 
-        // start both feeder tasks
-        xTaskNotifyGive(ctx->feed_tasks[!xPortGetCoreID()]);
-        xTaskNotifyGive(ctx->feed_tasks[xPortGetCoreID()]);
+            // transmission is started in renderer threads, now wait util it's done
+            xSemaphoreTake(ctx->frame_done, portMAX_DELAY);
 
-        // transmission is started in renderer threads, now wait util it's done
-        xSemaphoreTake(ctx->frame_done, portMAX_DELAY);
+            for (int i = 0; i < NUM_RENDER_THREADS; i++) {
+                xSemaphoreTake(ctx->feed_done_smphr[i], portMAX_DELAY);
+            }
+            holds_noop_line = window_ends_with_noop(ctx);
+
+            if (clock == NULL) {
+                break;
+            }
+            adapt_pixel_clock(ctx, clock);
+            if (!(ctx->error & EPD_DRAW_EMPTY_LINE_QUEUE)) {
+                break;
+            }
 
-        for (int i = 0; i < NUM_RENDER_THREADS; i++) {
-            xSemaphoreTake(ctx->feed_done_smphr[i], portMAX_DELAY);
+            ctx->error &= ~EPD_DRAW_EMPTY_LINE_QUEUE;
+            for (int i = 0; i < NUM_RENDER_THREADS; i++) {
+                lq_reset(&ctx->line_queues[i]);
+            }
+            if (repeats >= ADAPTIVE_PCLK_MAX_REPEATS) {
+                underrun_occurred = true;
+                break;
+            }
+
+            // drive the lines from the underrun on again, at the adapted clock
+            ctx->first_driven_line = ctx->frame_underrun_line;
+            ctx->lines_start = ctx->frame_underrun_line / 8 * 8;
         }
 
         ctx->current_frame++;
@@ -79,6 +299,12 @@ void lcd_do_update(RenderContext_t* ctx) {
         vTaskDelay(0);
     }
 
+    ctx->lines_start = window_start;
+
+    if (underrun_occurred) {
+        ctx->error |= EPD_DRAW_EMPTY_LINE_QUEUE;
+    }
+
     epd_lcd_line_source_cb(NULL, NULL);
     epd_lcd_frame_done_cb(NULL, NULL);
 
@@ -138,7 +364,7 @@ static void push_pixels_populate_line(RenderContext_t* ctx, int color) {
 
 void epd_push_pixels_lcd(RenderContext_t* ctx, short time, int color) {
     ctx->current_frame = 0;
-    ctx->lines_total = ctx->display_height;
+    ctx->lines_end = ctx->display_height;
     ctx->lines_consumed = 0;
     ctx->static_line_buffer = malloc(ctx->display_width / 4);
     assert(ctx->static_line_buffer != NULL);
@@ -167,9 +393,8 @@ lcd_calculate_frame(RenderContext_t* ctx, int thread_id) {
 
     // if there is an error, start the frame but don't feed data.
     if (ctx->error) {
-        memset(ctx->line_threads, 0, ctx->lines_total);
-        epd_lcd_line_source_cb((line_cb_func_t)&retrieve_line_isr, ctx);
-        epd_lcd_start_frame();
+        memset(ctx->line_threads, 0, ctx->lines_end);
+        start_frame_window(ctx);
         ESP_LOGW("epd_lcd", "draw frame draw initiated, but an error flag is set: %X", ctx->error);
         return;
     }
@@ -185,20 +410,18 @@ lcd_calculate_frame(RenderContext_t* ctx, int thread_id) {
     assert(area.width == ctx->display_width && area.x == 0 && !ctx->error);
 
     // index of the line that triggers the frame output when processed
-    int trigger_line = int_min(63, max_y - min_y);
+    int trigger_line = ctx->lines_start + int_min(63, ctx->lines_end - ctx->lines_start - 1);
 
-    while (l = atomic_fetch_add(&ctx->lines_prepared, 1), l < ctx->lines_total) {
+    while (l = atomic_fetch_add(&ctx->lines_prepared, 1), l < ctx->lines_end) {
         ctx->line_threads[l] = thread_id;
 
         // queue is sufficiently filled to fill both bounce buffers, frame
         // can begin
-        if (l - min_y == trigger_line) {
-            epd_lcd_line_source_cb((line_cb_func_t)&retrieve_line_isr, ctx);
-            epd_lcd_start_frame();
+        if (l == trigger_line) {
+            start_frame_window(ctx);
         }
 
-        if (l < min_y || l >= max_y
-            || (ctx->drawn_lines != NULL && !ctx->drawn_lines[l - area.y])) {
+        if (l < min_y || l >= max_y || line_is_skipped(ctx, l)) {
             uint8_t* buf = NULL;
             while (buf == NULL) {
                 // break in case of errors
@@ -216,9 +439,11 @@ lcd_calculate_frame(RenderContext_t* ctx, int thread_id) {
         }
 
         uint32_t* lp = (uint32_t*)input_line;
-        const uint8_t* ptr = ptr_start + bytes_per_line * (l - min_y);
+        const uint8_t* ptr = get_input_line(ctx, ptr_start, bytes_per_line, min_y, l, thread_id);
 
-        Cache_Start_DCache_Preload((uint32_t)ptr, ctx->display_width, 0);
+        if (ctx->line_source == NULL) {
+            Cache_Start_DCache_Preload((uint32_t)ptr, ctx->display_width, 0);
+        }
 
         lp = (uint32_t*)ptr;
 
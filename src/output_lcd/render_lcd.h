@@ -12,6 +12,11 @@ void epd_push_pixels_lcd(RenderContext_t* ctx, short time, int color);
  */
 void lcd_do_update(RenderContext_t* ctx);
 
+/**
+ * Enable or disable the adaptive pixel clock controller.
+ */
+void lcd_set_adaptive_pixel_clock(bool enabled);
+
 /**
  * Worker thread for output calculation.
  * In LCD mode, both threads do the same thing.
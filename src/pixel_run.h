@@ -0,0 +1,48 @@
+/**
+ * Writing runs of pixels to 4 bit per pixel framebuffer lines.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Write a run of 4 bit pixels, one per byte of `pixels`, to a framebuffer line
+ * of two pixels per byte, starting at `x`.
+ * Pixels of value `transparent` are skipped, use a negative value to write all pixels.
+ */
+static inline void write_pixel_run(
+    uint8_t* line, int x, const uint8_t* pixels, int n, int transparent
+) {
+    int i = 0;
+    if (x % 2 && n > 0) {
+        if (pixels[0] != transparent) {
+            line[x / 2] = (line[x / 2] & 0x0F) | (pixels[0] << 4);
+        }
+        i++;
+    }
+
+    uint8_t* ptr = &line[(x + i) / 2];
+    if (transparent >= 0) {
+        for (; i + 1 < n; i += 2, ptr++) {
+            bool lower = pixels[i] != transparent;
+            bool upper = pixels[i + 1] != transparent;
+            if (lower && upper) {
+                *ptr = pixels[i] | (pixels[i + 1] << 4);
+            } else if (lower) {
+                *ptr = (*ptr & 0xF0) | pixels[i];
+            } else if (upper) {
+                *ptr = (*ptr & 0x0F) | (pixels[i + 1] << 4);
+            }
+        }
+    } else {
+        for (; i + 1 < n; i += 2, ptr++) {
+            *ptr = pixels[i] | (pixels[i + 1] << 4);
+        }
+    }
+
+    if (i < n && pixels[i] != transparent) {
+        *ptr = (*ptr & 0xF0) | pixels[i];
+    }
+}
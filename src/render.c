@@ -44,7 +44,15 @@ const int clear_cycle_time = 12;
 
 static RenderContext_t render_context;
 
+/// Pixel state after the last update, valid if it was aborted.
+static EpdAbortState abort_state;
+static bool last_update_aborted = false;
+
 void epd_push_pixels(EpdRect area, short time, int color) {
+    if (!epd_poweron_wait()) {
+        ESP_LOGE("epdiy", "display power rails did not come up, not pushing pixels!");
+        return;
+    }
     render_context.area = area;
 #ifdef RENDER_METHOD_LCD
     epd_push_pixels_lcd(&render_context, time, color);
@@ -81,6 +89,128 @@ static int get_waveform_index(const EpdWaveform* waveform, enum EpdDrawMode mode
     return -1;
 }
 
+/**
+ * Get the action the waveform phases define for a transition in a given frame.
+ * 0 is a no-op, 1 darkens and 2 lightens the pixel.
+ */
+static inline uint8_t waveform_action(
+    const EpdWaveformPhases* phases, int frame, uint8_t to, uint8_t from
+) {
+    uint8_t packed = phases->luts[16 * 4 * frame + to * 4 + (from >> 2)];
+    return (packed >> (6 - 2 * (from & 3))) & 3;
+}
+
+int find_active_frames(
+    const EpdWaveformPhases* phases,
+    const EpdTransitionHistogram* transitions,
+    uint32_t* active_frames
+) {
+    uint8_t used[256];
+    int num_used = 0;
+    for (int t = 0; t < 16; t++) {
+        for (int f = 0; f < 16; f++) {
+            if (transitions->counts[t][f] > 0) {
+                used[num_used++] = (t << 4) | f;
+            }
+        }
+    }
+
+    int last_active = -1;
+    for (int frame = 0; frame < phases->phases; frame++) {
+        for (int i = 0; i < num_used; i++) {
+            if (waveform_action(phases, frame, used[i] >> 4, used[i] & 0xF)) {
+                active_frames[frame / 32] |= 1u << (frame % 32);
+                last_active = frame;
+                break;
+            }
+        }
+    }
+    return last_active + 1;
+}
+
+/**
+ * Calculate the number of frames after which the transitions of each display line are done.
+ * `line_transitions` holds line transition masks for the lines of the image at `area`.
+ */
+static void find_line_end_frames(
+    const EpdWaveformPhases* phases,
+    const uint32_t* line_transitions,
+    EpdRect area,
+    uint8_t* line_end_frames,
+    int num_lines
+) {
+    // frame after the last non-zero action of each transition
+    uint8_t transition_end[16][16] = { 0 };
+    for (int frame = 0; frame < phases->phases; frame++) {
+        for (int t = 0; t < 16; t++) {
+            for (int f = 0; f < 16; f++) {
+                if (waveform_action(phases, frame, t, f)) {
+                    transition_end[t][f] = frame + 1;
+                }
+            }
+        }
+    }
+
+    for (int l = 0; l < num_lines; l++) {
+        int row = l - area.y;
+        if (row < 0 || row >= area.height) {
+            line_end_frames[l] = UINT8_MAX;
+            continue;
+        }
+
+        uint32_t from_mask = line_transitions[row] & 0xFFFF;
+        uint32_t to_mask = line_transitions[row] >> 16;
+        uint8_t end = 0;
+        for (int t = 0; t < 16; t++) {
+            if (!(to_mask & (1 << t))) {
+                continue;
+            }
+            for (int f = 0; f < 16; f++) {
+                if ((from_mask & (1 << f)) && transition_end[t][f] > end) {
+                    end = transition_end[t][f];
+                }
+            }
+        }
+        line_end_frames[l] = end;
+    }
+}
+
+/**
+ * Determine the state of each transition after `frames_driven` frames of an update.
+ */
+static void find_abort_state(
+    const EpdWaveformPhases* phases, int frames_driven, EpdAbortState* state
+) {
+    memset(state, 0, sizeof(EpdAbortState));
+    state->frames_driven = frames_driven;
+
+    // without a waveform, the single frame was either driven completely or not at all
+    if (phases == NULL) {
+        return;
+    }
+
+    for (int t = 0; t < 16; t++) {
+        for (int f = 0; f < 16; f++) {
+            bool driven = false;
+            bool remaining = false;
+            for (int frame = 0; frame < phases->phases; frame++) {
+                if (waveform_action(phases, frame, t, f)) {
+                    if (frame < frames_driven) {
+                        driven = true;
+                    } else {
+                        remaining = true;
+                    }
+                }
+            }
+            if (driven && remaining) {
+                state->indeterminate[t] |= 1 << f;
+            } else if (driven) {
+                state->completed[t] |= 1 << f;
+            }
+        }
+    }
+}
+
 /////////////////////////////  API Procedures //////////////////////////////////
 
 /// Rounded up display height for even division into multi-line buffers.
@@ -88,10 +218,44 @@ static inline int rounded_display_height() {
     return (((epd_height() + 7) / 8) * 8);
 }
 
+/**
+ * Restrict the lines processed in each frame to the vertical extent of the update.
+ * Lines above and below the window are skipped quickly, without fetching data.
+ * Must be called after the line skip information of the context is set up.
+ */
+static void set_vertical_window(RenderContext_t* ctx) {
+    int min_y, max_y, bytes_per_line, pixels_per_byte;
+    const uint8_t* ptr_start;
+    get_buffer_params(ctx, &bytes_per_line, &ptr_start, &min_y, &max_y, &pixels_per_byte);
+
+    min_y = max(min_y, 0);
+    max_y = min(max_y, ctx->display_height);
+
+    // lines skipped in the first frame are never driven and need not be part of the window
+    assert(ctx->current_frame == 0);
+    while (min_y < max_y && line_is_skipped(ctx, min_y)) {
+        min_y++;
+    }
+    while (max_y > min_y && line_is_skipped(ctx, max_y - 1)) {
+        max_y--;
+    }
+
+    if (min_y >= max_y) {
+        ctx->lines_start = 0;
+        ctx->lines_end = 0;
+        return;
+    }
+
+    // Align to the multi-line output buffers. Also, include a no-op line after the window
+    // where possible, so that it is the last line held by the source drivers while skipping.
+    ctx->lines_start = min_y / 8 * 8;
+    ctx->lines_end = min((max_y + 8) / 8 * 8, rounded_display_height());
+}
+
 // FIXME: fix misleading naming:
 //  area -> buffer dimensions
 //  crop -> area taken out of buffer
-enum EpdDrawError IRAM_ATTR epd_draw_base(
+static enum EpdDrawError IRAM_ATTR draw(
     EpdRect area,
     const uint8_t* data,
     EpdRect crop_to,
@@ -99,7 +263,8 @@ enum EpdDrawError IRAM_ATTR epd_draw_base(
     int temperature,
     const bool* drawn_lines,
     const uint8_t* drawn_columns,
-    const EpdWaveform* waveform
+    const EpdWaveform* waveform,
+    const EpdDrawHints* hints
 ) {
     if (waveform == NULL) {
         return EPD_DRAW_NO_PHASES_AVAILABLE;
@@ -164,12 +329,50 @@ enum EpdDrawError IRAM_ATTR epd_draw_base(
     render_context.data_ptr = data;
     render_context.lut_build_func = lut_functions.build_func;
     render_context.lut_lookup_func = lut_functions.lookup_func;
+    render_context.lut_frame = -1;
 
-    render_context.lines_prepared = 0;
-    render_context.lines_consumed = 0;
-    render_context.lines_total = rounded_display_height();
     render_context.current_frame = 0;
     render_context.cycle_frames = frame_count;
+    memset(render_context.active_frames, 0xFF, sizeof(render_context.active_frames));
+    if (waveform_phases != NULL && hints != NULL && hints->transitions != NULL) {
+        memset(render_context.active_frames, 0, sizeof(render_context.active_frames));
+        render_context.cycle_frames
+            = find_active_frames(waveform_phases, hints->transitions, render_context.active_frames);
+        ESP_LOGD(
+            "epdiy",
+            "update uses %d of %d waveform frames",
+            render_context.cycle_frames,
+            frame_count
+        );
+    }
+    memset(render_context.line_end_frames, UINT8_MAX, rounded_display_height());
+    if (waveform_phases != NULL && hints != NULL && hints->line_transitions != NULL) {
+        find_line_end_frames(
+            waveform_phases,
+            hints->line_transitions,
+            area,
+            render_context.line_end_frames,
+            render_context.display_height
+        );
+    }
+
+    set_vertical_window(&render_context);
+    render_context.lines_prepared = render_context.lines_start;
+    render_context.lines_consumed = render_context.lines_start;
+    if (render_context.lines_end == 0) {
+        // nothing to draw
+        render_context.cycle_frames = 0;
+    }
+    ESP_LOGD(
+        "epdiy",
+        "drawing lines %d to %d",
+        render_context.lines_start,
+        render_context.lines_end
+    );
+
+    // an abort requested before this point, e.g. while the update was prepared, still applies
+    last_update_aborted = false;
+
     render_context.phase_times = NULL;
     if (waveform_phases != NULL && waveform_phases->phase_times != NULL) {
         render_context.phase_times = waveform_phases->phase_times;
@@ -179,22 +382,126 @@ enum EpdDrawError IRAM_ATTR epd_draw_base(
         render_context.line_mask, drawn_columns, render_context.display_width / 4
     );
 
+    // everything up to here can overlap with the power rails of `epd_poweron_async()`
+    prepare_first_frame_lut(&render_context);
+    if (!epd_poweron_wait()) {
+        ESP_LOGE("epdiy", "display power rails did not come up, skipping the update!");
+        return EPD_DRAW_POWER_FAILED;
+    }
+
 #ifdef RENDER_METHOD_I2S
     i2s_do_update(&render_context);
 #elif defined(RENDER_METHOD_LCD)
     lcd_do_update(&render_context);
 #endif
+    atomic_store(&render_context.abort_requested, false);
 
     if (render_context.error & EPD_DRAW_EMPTY_LINE_QUEUE) {
         ESP_LOGE("epdiy", "line buffer underrun occurred!");
     }
 
+    if (render_context.error & EPD_DRAW_ABORTED) {
+        find_abort_state(waveform_phases, render_context.current_frame, &abort_state);
+        last_update_aborted = true;
+        ESP_LOGI(
+            "epdiy",
+            "update aborted after %d of %d frames",
+            render_context.current_frame,
+            render_context.cycle_frames
+        );
+    }
+
     if (render_context.error != EPD_DRAW_SUCCESS) {
         return render_context.error;
     }
     return EPD_DRAW_SUCCESS;
 }
 
+enum EpdDrawError epd_draw_base(
+    EpdRect area,
+    const uint8_t* data,
+    EpdRect crop_to,
+    enum EpdDrawMode mode,
+    int temperature,
+    const bool* drawn_lines,
+    const uint8_t* drawn_columns,
+    const EpdWaveform* waveform
+) {
+    return epd_draw_base_with_hints(
+        area, data, crop_to, mode, temperature, drawn_lines, drawn_columns, waveform, NULL
+    );
+}
+
+enum EpdDrawError epd_draw_base_with_hints(
+    EpdRect area,
+    const uint8_t* data,
+    EpdRect crop_to,
+    enum EpdDrawMode mode,
+    int temperature,
+    const bool* drawn_lines,
+    const uint8_t* drawn_columns,
+    const EpdWaveform* waveform,
+    const EpdDrawHints* hints
+) {
+    render_context.line_source = NULL;
+    render_context.line_source_arg = NULL;
+    return draw(
+        area, data, crop_to, mode, temperature, drawn_lines, drawn_columns, waveform, hints
+    );
+}
+
+enum EpdDrawError epd_draw_line_source(
+    EpdRect area,
+    EpdLineSource line_source,
+    void* line_source_arg,
+    EpdRect crop_to,
+    enum EpdDrawMode mode,
+    int temperature,
+    const bool* drawn_lines,
+    const uint8_t* drawn_columns,
+    const EpdWaveform* waveform,
+    const EpdDrawHints* hints
+) {
+    assert(line_source != NULL);
+
+    int pixels_per_byte = 2;
+    if (mode & MODE_PACKING_1PPB_DIFFERENCE) {
+        pixels_per_byte = 1;
+    } else if (mode & MODE_PACKING_8PPB) {
+        pixels_per_byte = 8;
+    }
+    // skip pixels left of the display, like for input buffers in `get_buffer_params()`
+    render_context.line_source_x_offset = max(0, crop_to.x - area.x) / pixels_per_byte;
+    render_context.line_source = line_source;
+    render_context.line_source_arg = line_source_arg;
+
+    enum EpdDrawError err = draw(
+        area, NULL, crop_to, mode, temperature, drawn_lines, drawn_columns, waveform, hints
+    );
+
+    render_context.line_source = NULL;
+    render_context.line_source_arg = NULL;
+    return err;
+}
+
+void epd_abort_update() {
+    atomic_store(&render_context.abort_requested, true);
+}
+
+void epd_set_update_preemption_hook(bool (*hook)(void* arg), void* arg) {
+    render_context.preemption_hook = NULL;
+    render_context.preemption_hook_arg = arg;
+    render_context.preemption_hook = hook;
+}
+
+bool epd_get_abort_state(EpdAbortState* state) {
+    if (!last_update_aborted) {
+        return false;
+    }
+    memcpy(state, &abort_state, sizeof(EpdAbortState));
+    return true;
+}
+
 static void IRAM_ATTR render_thread(void* arg) {
     int thread_id = (int)arg;
 
@@ -301,6 +608,12 @@ void epd_renderer_init(enum EpdInitOptions options) {
         = heap_caps_aligned_alloc(16, epd_width() / 4, MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
     assert(render_context.line_mask != NULL);
 
+    render_context.line_end_frames = (uint8_t*)heap_caps_malloc(
+        rounded_display_height(), MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL
+    );
+    assert(render_context.line_end_frames != NULL);
+    memset(render_context.line_end_frames, UINT8_MAX, rounded_display_height());
+
 #ifdef RENDER_METHOD_LCD
     size_t queue_elem_size = render_context.display_width / 4;
 #elif defined(RENDER_METHOD_I2S)
@@ -328,7 +641,7 @@ void epd_renderer_init(enum EpdInitOptions options) {
 void epd_renderer_deinit() {
     const EpdBoardDefinition* epd_board = epd_current_board();
 
-    epd_board->poweroff(epd_ctrl_state());
+    epd_poweroff();
 
     for (int i = 0; i < NUM_RENDER_THREADS; i++) {
         vTaskDelete(render_context.feed_tasks[i]);
@@ -350,6 +663,7 @@ void epd_renderer_deinit() {
     heap_caps_free(render_context.conversion_lut);
     heap_caps_free(render_context.line_threads);
     heap_caps_free(render_context.line_mask);
+    heap_caps_free(render_context.line_end_frames);
     vSemaphoreDelete(render_context.frame_done);
 }
 
@@ -385,6 +699,25 @@ __attribute__((optimize("O3"))) static inline int _interlace_line_unaligned(
     return dirty;
 }
 
+/**
+ * Add the transitions of `len` pixels of an interlaced line to `counts`,
+ * a flattened `EpdTransitionHistogram`, if it is not NULL.
+ * Returns the line transition mask, see `epd_difference_image_base()`.
+ */
+__attribute__((optimize("O3"))) static uint32_t count_line_transitions(
+    const uint8_t* interlaced, uint32_t* counts, int len
+) {
+    uint32_t mask = 0;
+    for (int x = 0; x < len; x++) {
+        uint8_t transition = interlaced[x];
+        if (counts != NULL) {
+            counts[transition]++;
+        }
+        mask |= (1u << 16 << (transition >> 4)) | (1u << (transition & 0xF));
+    }
+    return mask;
+}
+
 /**
  * Interlaces the lines at `to`, `from` into `interlaced`.
  * returns `1` if there are differences, `0` otherwise.
@@ -437,7 +770,9 @@ EpdRect epd_difference_image_base(
     int fb_height,
     uint8_t* interlaced,
     bool* dirty_lines,
-    uint8_t* col_dirtyness
+    uint8_t* col_dirtyness,
+    EpdTransitionHistogram* transitions,
+    uint32_t* line_transitions
 ) {
     assert(fb_width % 8 == 0);
     assert(col_dirtyness != NULL);
@@ -450,6 +785,12 @@ EpdRect epd_difference_image_base(
 
     memset(col_dirtyness, 0, fb_width / 2);
     memset(dirty_lines, 0, sizeof(bool) * fb_height);
+    if (transitions != NULL) {
+        memset(transitions, 0, sizeof(EpdTransitionHistogram));
+    }
+    if (line_transitions != NULL) {
+        memset(line_transitions, 0, sizeof(uint32_t) * fb_height);
+    }
 
     int x_end = min(fb_width, crop_to.x + crop_to.width);
     int y_end = min(fb_height, crop_to.y + crop_to.height);
@@ -460,6 +801,15 @@ EpdRect epd_difference_image_base(
             to + offset, from + offset, interlaced + offset * 2, col_dirtyness, fb_width
         );
         dirty_lines[y] = dirty;
+
+        // unchanged pixels in changed lines may still be driven by the waveform
+        if (dirty && (transitions != NULL || line_transitions != NULL)) {
+            uint32_t* counts = transitions != NULL ? (uint32_t*)transitions->counts : NULL;
+            uint32_t mask = count_line_transitions(interlaced + offset * 2, counts, fb_width);
+            if (line_transitions != NULL) {
+                line_transitions[y] = mask;
+            }
+        }
     }
 
     int min_x, min_y, max_x, max_y;
@@ -507,7 +857,9 @@ EpdRect epd_difference_image(
         epd_height(),
         interlaced,
         dirty_lines,
-        col_dirtyness
+        col_dirtyness,
+        NULL,
+        NULL
     );
 }
 
@@ -520,7 +872,16 @@ EpdRect epd_difference_image_cropped(
     uint8_t* col_dirtyness
 ) {
     EpdRect result = epd_difference_image_base(
-        to, from, crop_to, epd_width(), epd_height(), interlaced, dirty_lines, col_dirtyness
+        to,
+        from,
+        crop_to,
+        epd_width(),
+        epd_height(),
+        interlaced,
+        dirty_lines,
+        col_dirtyness,
+        NULL,
+        NULL
     );
     return result;
 }
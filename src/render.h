@@ -10,3 +10,15 @@ void epd_renderer_init(enum EpdInitOptions options);
  * Deinitialize the EPD renderer and free up its resources.
  */
 void epd_renderer_deinit();
+
+
+/**
+ * Mark the frames that drive at least one of the transitions present in `transitions`
+ * as bits of `active_frames`, which must be cleared before.
+ * Returns the number of frames up to and including the last active frame.
+ */
+int find_active_frames(
+    const EpdWaveformPhases* phases,
+    const EpdTransitionHistogram* transitions,
+    uint32_t* active_frames
+);
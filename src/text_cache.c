@@ -0,0 +1,421 @@
+/**
+ * LRU cache of rendered strings, see `epd_write_string_cached()`.
+ *
+ * Entries are keyed by string, font, font properties and rotation, and found through
+ * a small hash table. Each entry holds a copy of its string and the rendered bitmap
+ * in the same allocation. Bitmaps are in framebuffer orientation, so drawing an entry
+ * is a single `epd_blit()`: A copy where the text covers its whole area, e.g. with a
+ * background, or a color keyed copy with a level the text does not use otherwise.
+ */
+
+#include <esp_assert.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <string.h>
+
+#include "epdiy.h"
+#include "lazy_mutex.h"
+#include "text_cache.h"
+
+/// Number of hash buckets, must be a power of two.
+#define NUM_BUCKETS 64
+
+typedef struct TextEntry {
+    const EpdFont* font;
+    EpdFontProperties properties;
+    enum EpdRotation rotation;
+    uint32_t hash;
+    /// Size of the entry, including string and bitmap.
+    size_t size;
+    /// Neighbours in the LRU list.
+    struct TextEntry* newer;
+    struct TextEntry* older;
+    /// Next entry in the same hash bucket.
+    struct TextEntry* next_in_bucket;
+
+    /// Area of the text relative to the cursor, in rotated coordinates.
+    EpdRect box;
+    int advance_x;
+    int advance_y;
+    enum EpdDrawError err;
+    /// `EPD_ROP_COPY`, or `EPD_ROP_TRANSPARENT` with `color_key` for uncovered pixels.
+    enum EpdRasterOp op;
+    uint8_t color_key;
+    EpdBitmap bitmap;
+
+    size_t length;
+    /// The string, followed by the bitmap data.
+    char string[];
+} TextEntry;
+
+typedef struct {
+    size_t budget;
+    uint32_t heap_caps;
+    size_t used;
+    TextEntry* buckets[NUM_BUCKETS];
+    TextEntry* newest;
+    TextEntry* oldest;
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+} TextCache;
+
+static TextCache cache = {
+    .budget = EPD_TEXT_CACHE_DEFAULT_BUDGET,
+    .heap_caps = MALLOC_CAP_8BIT,
+};
+
+static LazyMutex cache_mutex = LAZY_MUTEX_INITIALIZER;
+
+static void lock_cache() {
+    lazy_mutex_lock(&cache_mutex);
+}
+
+static void unlock_cache() {
+    lazy_mutex_unlock(&cache_mutex);
+}
+
+/// FNV-1a hash of the key of an entry.
+static uint32_t hash_key(
+    const EpdFont* font,
+    const char* string,
+    size_t length,
+    const EpdFontProperties* props,
+    enum EpdRotation rotation
+) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t)string[i]) * 16777619u;
+    }
+    uint32_t extra[] = {
+        (uint32_t)(uintptr_t)font,
+        props->fg_color | props->bg_color << 8 | rotation << 16,
+        props->fallback_glyph,
+        props->flags,
+    };
+    for (int i = 0; i < sizeof(extra) / sizeof(extra[0]); i++) {
+        hash = (hash ^ extra[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static bool matches(
+    const TextEntry* entry,
+    uint32_t hash,
+    const EpdFont* font,
+    const char* string,
+    size_t length,
+    const EpdFontProperties* props,
+    enum EpdRotation rotation
+) {
+    return entry->hash == hash && entry->font == font && entry->rotation == rotation
+           && entry->length == length && entry->properties.fg_color == props->fg_color
+           && entry->properties.bg_color == props->bg_color
+           && entry->properties.fallback_glyph == props->fallback_glyph
+           && entry->properties.flags == props->flags && memcmp(entry->string, string, length) == 0;
+}
+
+static inline TextEntry** bucket_of(uint32_t hash) {
+    return &cache.buckets[hash & (NUM_BUCKETS - 1)];
+}
+
+static void unlink_entry(TextEntry* entry) {
+    if (entry->newer != NULL) {
+        entry->newer->older = entry->older;
+    } else {
+        cache.newest = entry->older;
+    }
+    if (entry->older != NULL) {
+        entry->older->newer = entry->newer;
+    } else {
+        cache.oldest = entry->newer;
+    }
+}
+
+static void push_newest(TextEntry* entry) {
+    entry->newer = NULL;
+    entry->older = cache.newest;
+    if (cache.newest != NULL) {
+        cache.newest->newer = entry;
+    } else {
+        cache.oldest = entry;
+    }
+    cache.newest = entry;
+}
+
+static void remove_entry(TextEntry* entry) {
+    TextEntry** link = bucket_of(entry->hash);
+    while (*link != entry) {
+        link = &(*link)->next_in_bucket;
+    }
+    *link = entry->next_in_bucket;
+    unlink_entry(entry);
+    cache.used -= entry->size;
+    heap_caps_free(entry);
+}
+
+static void clear_locked() {
+    while (cache.oldest != NULL) {
+        remove_entry(cache.oldest);
+    }
+}
+
+/**
+ * Render the text of an entry, and choose how it is combined with the framebuffer.
+ * The text is rendered on black and on white: Pixels that differ are not covered.
+ * Returns false if the text covers only part of its area and uses all 16 levels.
+ */
+static bool render_entry(TextEntry* entry) {
+    EpdBitmap* bitmap = &entry->bitmap;
+    size_t size = bitmap->stride * bitmap->height;
+    uint8_t* on_white = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    if (on_white == NULL) {
+        return false;
+    }
+    EpdBitmap white_bitmap = *bitmap;
+    white_bitmap.data = on_white;
+    memset(bitmap->data, 0x00, size);
+    memset(on_white, 0xFF, size);
+    text_render(
+        entry->font, entry->string, &entry->properties, entry->rotation, entry->box, bitmap
+    );
+    text_render(
+        entry->font, entry->string, &entry->properties, entry->rotation, entry->box, &white_bitmap
+    );
+
+    uint16_t used_levels = 0;
+    bool covered = true;
+    for (int y = 0; y < bitmap->height; y++) {
+        const uint8_t* a = bitmap->data + y * bitmap->stride;
+        const uint8_t* b = on_white + y * bitmap->stride;
+        for (int x = 0; x < bitmap->width; x++) {
+            int shift = x % 2 * 4;
+            uint8_t level = (a[x / 2] >> shift) & 0x0F;
+            if (level == ((b[x / 2] >> shift) & 0x0F)) {
+                used_levels |= 1 << level;
+            } else {
+                covered = false;
+            }
+        }
+    }
+
+    entry->op = EPD_ROP_COPY;
+    if (!covered) {
+        int key = 0;
+        while (key < 16 && used_levels & (1 << key)) {
+            key++;
+        }
+        if (key == 16) {
+            heap_caps_free(on_white);
+            return false;
+        }
+        // mark uncovered pixels with the key
+        for (int y = 0; y < bitmap->height; y++) {
+            uint8_t* a = bitmap->data + y * bitmap->stride;
+            const uint8_t* b = on_white + y * bitmap->stride;
+            for (int x = 0; x < bitmap->width; x++) {
+                int shift = x % 2 * 4;
+                if (((a[x / 2] ^ b[x / 2]) >> shift) & 0x0F) {
+                    a[x / 2] = (a[x / 2] & ~(0x0F << shift)) | (key << shift);
+                }
+            }
+        }
+        entry->op = EPD_ROP_TRANSPARENT;
+        entry->color_key = key;
+    }
+    heap_caps_free(on_white);
+    return true;
+}
+
+/// Render a string into a new entry. Returns NULL if it cannot be cached.
+static TextEntry* add_entry(
+    uint32_t hash,
+    const EpdFont* font,
+    const char* string,
+    size_t length,
+    const EpdFontProperties* props,
+    enum EpdRotation rotation
+) {
+    EpdRect box;
+    int advance_x, advance_y;
+    enum EpdDrawError err = text_measure(font, string, props, &box, &advance_x, &advance_y);
+
+    bool portrait = rotation == EPD_ROT_PORTRAIT || rotation == EPD_ROT_INVERTED_PORTRAIT;
+    int width = portrait ? box.height : box.width;
+    int height = portrait ? box.width : box.height;
+    int stride = (width + 1) / 2;
+    // the bitmap starts at a word boundary after the string
+    size_t bitmap_offset = (sizeof(TextEntry) + length + 1 + 3) & ~3;
+    size_t entry_size = bitmap_offset + stride * height;
+    if (entry_size > cache.budget) {
+        return NULL;
+    }
+    while (cache.used + entry_size > cache.budget) {
+        remove_entry(cache.oldest);
+        cache.evictions++;
+    }
+    TextEntry* entry = heap_caps_malloc(entry_size, cache.heap_caps);
+    if (entry == NULL) {
+        return NULL;
+    }
+
+    entry->font = font;
+    entry->properties = *props;
+    entry->rotation = rotation;
+    entry->hash = hash;
+    entry->size = entry_size;
+    entry->box = box;
+    entry->advance_x = advance_x;
+    entry->advance_y = advance_y;
+    entry->err = err;
+    entry->length = length;
+    memcpy(entry->string, string, length);
+    entry->string[length] = '\0';
+    EpdBitmap bitmap = {
+        .data = (uint8_t*)entry + bitmap_offset,
+        .width = width,
+        .height = height,
+        .stride = stride,
+        .bpp = 4,
+    };
+    entry->bitmap = bitmap;
+    if (width > 0 && height > 0 && !render_entry(entry)) {
+        heap_caps_free(entry);
+        return NULL;
+    }
+
+    TextEntry** bucket = bucket_of(hash);
+    entry->next_in_bucket = *bucket;
+    *bucket = entry;
+    push_newest(entry);
+    cache.used += entry_size;
+    return entry;
+}
+
+/// Combine the bitmap of an entry with the framebuffer, and advance the cursor.
+static enum EpdDrawError draw_entry(
+    const TextEntry* entry, int* cursor_x, int* cursor_y, uint8_t* framebuffer
+) {
+    const EpdBitmap* bitmap = &entry->bitmap;
+    if (bitmap->width > 0 && bitmap->height > 0) {
+        // top left corner of the bitmap in the framebuffer
+        int x = *cursor_x + entry->box.x;
+        int y = *cursor_y + entry->box.y;
+        int fb_x = x, fb_y = y;
+        switch (entry->rotation) {
+            case EPD_ROT_PORTRAIT:
+                fb_x = epd_width() - y - entry->box.height;
+                fb_y = x;
+                break;
+            case EPD_ROT_INVERTED_LANDSCAPE:
+                fb_x = epd_width() - x - entry->box.width;
+                fb_y = epd_height() - y - entry->box.height;
+                break;
+            case EPD_ROT_INVERTED_PORTRAIT:
+                fb_x = y;
+                fb_y = epd_height() - x - entry->box.width;
+                break;
+            default:
+                break;
+        }
+        EpdBitmap fb = {
+            .data = framebuffer,
+            .width = epd_width(),
+            .height = epd_height(),
+            .stride = epd_width() / 2,
+            .bpp = 4,
+        };
+        EpdRect area = { 0, 0, bitmap->width, bitmap->height };
+        epd_blit(&fb, fb_x, fb_y, bitmap, area, entry->op, entry->color_key);
+    }
+    *cursor_x += entry->advance_x;
+    *cursor_y += entry->advance_y;
+    return entry->err;
+}
+
+enum EpdDrawError epd_write_string_cached(
+    const EpdFont* font,
+    const char* string,
+    int* cursor_x,
+    int* cursor_y,
+    uint8_t* framebuffer,
+    const EpdFontProperties* properties
+) {
+    if (string == NULL) {
+        return epd_write_string(font, string, cursor_x, cursor_y, framebuffer, properties);
+    }
+    assert(framebuffer != NULL);
+    assert(properties != NULL);
+
+    size_t length = strlen(string);
+    enum EpdRotation rotation = epd_get_rotation();
+    uint32_t hash = hash_key(font, string, length, properties, rotation);
+
+    lock_cache();
+    TextEntry* entry = *bucket_of(hash);
+    while (entry != NULL && !matches(entry, hash, font, string, length, properties, rotation)) {
+        entry = entry->next_in_bucket;
+    }
+    if (entry != NULL) {
+        if (entry != cache.newest) {
+            unlink_entry(entry);
+            push_newest(entry);
+        }
+        cache.hits++;
+    } else {
+        cache.misses++;
+        entry = add_entry(hash, font, string, length, properties, rotation);
+    }
+
+    enum EpdDrawError err;
+    if (entry != NULL) {
+        err = draw_entry(entry, cursor_x, cursor_y, framebuffer);
+    } else {
+        err = epd_write_string(font, string, cursor_x, cursor_y, framebuffer, properties);
+    }
+    unlock_cache();
+    return err;
+}
+
+void text_cache_forget(const EpdFont* font) {
+    lock_cache();
+    TextEntry* entry = cache.oldest;
+    while (entry != NULL) {
+        TextEntry* newer = entry->newer;
+        if (entry->font == font) {
+            remove_entry(entry);
+        }
+        entry = newer;
+    }
+    unlock_cache();
+}
+
+void epd_text_cache_configure(size_t budget_bytes, uint32_t heap_caps) {
+    lock_cache();
+    clear_locked();
+    cache.budget = budget_bytes;
+    cache.heap_caps = heap_caps;
+    cache.hits = 0;
+    cache.misses = 0;
+    cache.evictions = 0;
+    unlock_cache();
+}
+
+void epd_text_cache_clear() {
+    lock_cache();
+    clear_locked();
+    unlock_cache();
+}
+
+EpdTextCacheStats epd_text_cache_stats() {
+    lock_cache();
+    EpdTextCacheStats stats = {
+        .hits = cache.hits,
+        .misses = cache.misses,
+        .evictions = cache.evictions,
+        .used_bytes = cache.used,
+        .budget_bytes = cache.budget,
+    };
+    unlock_cache();
+    return stats;
+}
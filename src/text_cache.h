@@ -0,0 +1,43 @@
+/**
+ * Rendering of strings into bitmaps for the text cache, see `epd_write_string_cached()`.
+ */
+
+#pragma once
+
+#include "epdiy.h"
+
+/**
+ * Measure a string drawn by `epd_write_string()` with the cursor at (0, 0).
+ * Implemented with the font drawing functions.
+ *
+ * @param box: Set to the area of the drawn pixels, in rotated coordinates.
+ * @param advance_x: Set to the horizontal movement of the cursor.
+ * @param advance_y: Set to the vertical movement of the cursor.
+ * @returns The errors of drawing the string.
+ */
+enum EpdDrawError text_measure(
+    const EpdFont* font,
+    const char* string,
+    const EpdFontProperties* properties,
+    EpdRect* box,
+    int* advance_x,
+    int* advance_y
+);
+
+/**
+ * Draw the area `box` of a string, as measured by `text_measure()`, into a 4bpp bitmap.
+ * The bitmap is in unrotated coordinates, its size is that of `box` after the rotation.
+ */
+enum EpdDrawError text_render(
+    const EpdFont* font,
+    const char* string,
+    const EpdFontProperties* properties,
+    enum EpdRotation rotation,
+    EpdRect box,
+    const EpdBitmap* bitmap
+);
+
+/**
+ * Drop all cached text of a font, before its memory is released.
+ */
+void text_cache_forget(const EpdFont* font);
@@ -0,0 +1,122 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#include "epdiy.h"
+
+static int get_pixel(const EpdBitmap* b, int x, int y) {
+    const uint8_t* line = b->data + y * b->stride;
+    if (b->bpp == 4) {
+        return x % 2 ? line[x / 2] >> 4 : line[x / 2] & 0x0F;
+    }
+    return (line[x / 8] >> (x % 8)) & 1;
+}
+
+static void set_pixel(const EpdBitmap* b, int x, int y, int value) {
+    uint8_t* line = b->data + y * b->stride;
+    if (b->bpp == 4) {
+        int shift = x % 2 ? 4 : 0;
+        line[x / 2] = (line[x / 2] & ~(0x0F << shift)) | (value << shift);
+    } else {
+        line[x / 8] = (line[x / 8] & ~(1 << (x % 8))) | (value << (x % 8));
+    }
+}
+
+/// Per-pixel reference implementation of `epd_blit()`.
+static void reference_blit(
+    const EpdBitmap* dst,
+    int dst_x,
+    int dst_y,
+    const EpdBitmap* src,
+    EpdRect r,
+    enum EpdRasterOp op,
+    uint8_t param
+) {
+    int max_value = dst->bpp == 4 ? 15 : 1;
+    for (int y = 0; y < r.height; y++) {
+        for (int x = 0; x < r.width; x++) {
+            int sx = r.x + x, sy = r.y + y, dx = dst_x + x, dy = dst_y + y;
+            if (sx < 0 || sy < 0 || sx >= src->width || sy >= src->height || dx < 0 || dy < 0
+                || dx >= dst->width || dy >= dst->height) {
+                continue;
+            }
+            int s = get_pixel(src, sx, sy);
+            int d = get_pixel(dst, dx, dy);
+            int v = d;
+            switch (op) {
+                case EPD_ROP_COPY:
+                    v = s;
+                    break;
+                case EPD_ROP_AND:
+                    v = d & s;
+                    break;
+                case EPD_ROP_OR:
+                    v = d | s;
+                    break;
+                case EPD_ROP_XOR:
+                    v = d ^ s;
+                    break;
+                case EPD_ROP_INVERT:
+                    v = max_value - d;
+                    break;
+                case EPD_ROP_TRANSPARENT:
+                    v = s == param ? d : s;
+                    break;
+                case EPD_ROP_ALPHA:
+                    v = dst->bpp == 4 ? (s * param + d * (15 - param) + 7) / 15
+                                      : (param >= 8 ? s : d);
+                    break;
+            }
+            set_pixel(dst, dx, dy, v);
+        }
+    }
+}
+
+TEST_CASE("blit matches per-pixel reference", "[epdiy,unit]") {
+    uint8_t src_data[256];
+    uint8_t dst_data[256];
+    uint8_t expected_data[256];
+
+    srand(42);
+    for (int i = 0; i < 5000; i++) {
+        int bpp = i % 2 ? 4 : 1;
+        EpdBitmap src = { .data = src_data, .width = 61, .height = 5, .bpp = bpp };
+        src.stride = (src.width * bpp + 7) / 8;
+        EpdBitmap dst = { .data = dst_data, .width = 53, .height = 6, .bpp = bpp };
+        dst.stride = (dst.width * bpp + 7) / 8 + 1;
+        EpdBitmap expected = dst;
+        expected.data = expected_data;
+
+        for (int j = 0; j < sizeof(src_data); j++) {
+            src_data[j] = rand();
+            dst_data[j] = rand();
+        }
+        memcpy(expected_data, dst_data, sizeof(dst_data));
+
+        EpdRect r = {
+            .x = rand() % 70 - 5,
+            .y = rand() % 7 - 2,
+            .width = rand() % 64,
+            .height = 4,
+        };
+        int dst_x = rand() % 60 - 8;
+        int dst_y = rand() % 6 - 2;
+        enum EpdRasterOp op = rand() % (EPD_ROP_ALPHA + 1);
+        uint8_t param = rand() % (bpp == 4 ? 16 : 2);
+
+        TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_blit(&dst, dst_x, dst_y, &src, r, op, param));
+        reference_blit(&expected, dst_x, dst_y, &src, r, op, param);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected_data, dst_data, sizeof(dst_data));
+    }
+}
+
+TEST_CASE("blit rejects mismatching depths", "[epdiy,unit]") {
+    uint8_t data[16] = { 0 };
+    EpdBitmap src = { .data = data, .width = 8, .height = 1, .stride = 1, .bpp = 1 };
+    EpdBitmap dst = { .data = data, .width = 8, .height = 1, .stride = 4, .bpp = 4 };
+    EpdRect r = { .x = 0, .y = 0, .width = 8, .height = 1 };
+    TEST_ASSERT_EQUAL(
+        EPD_DRAW_INVALID_PACKING_MODE, epd_blit(&dst, 0, 0, &src, r, EPD_ROP_COPY, 0)
+    );
+}
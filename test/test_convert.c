@@ -0,0 +1,86 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#include "epd_convert.h"
+
+static uint8_t reference_luma(int r, int g, int b) {
+    return (r * 38 + g * 75 + b * 15) >> 7;
+}
+
+TEST_CASE("RGB565 luma matches the luma of expanded channels", "[epdiy,unit]") {
+    for (int pixel = 0; pixel < 0x10000; pixel++) {
+        int r5 = pixel >> 11, g6 = (pixel >> 5) & 0x3F, b5 = pixel & 0x1F;
+        uint8_t expected = reference_luma(r5 << 3 | r5 >> 2, g6 << 2 | g6 >> 4, b5 << 3 | b5 >> 2);
+
+        uint8_t le[2] = { pixel & 0xFF, pixel >> 8 };
+        uint8_t be[2] = { pixel >> 8, pixel & 0xFF };
+        uint8_t luma_le, luma_be;
+        epd_convert_to_gray8(le, EPD_PIXEL_RGB565, 1, NULL, &luma_le);
+        epd_convert_to_gray8(be, EPD_PIXEL_RGB565_BE, 1, NULL, &luma_be);
+        TEST_ASSERT_EQUAL(expected, luma_le);
+        TEST_ASSERT_EQUAL(luma_le, luma_be);
+    }
+}
+
+TEST_CASE("4bpp conversion matches per-pixel conversion", "[epdiy,unit]") {
+    enum { MAX_WIDTH = 150 };
+    static uint8_t input[MAX_WIDTH * 3];
+    static uint8_t gray[MAX_WIDTH];
+    static uint8_t output[MAX_WIDTH / 2 + 2];
+    uint8_t curve[256];
+    epd_tone_curve(curve, 0.7, 16, 240, true);
+
+    srand(11);
+    for (int i = 0; i < 300; i++) {
+        int width = 1 + rand() % MAX_WIDTH;
+        enum EpdPixelFormat format = rand() % 4;
+        const uint8_t* tone_curve = rand() % 2 ? curve : NULL;
+        for (int j = 0; j < sizeof(input); j++) {
+            input[j] = rand();
+        }
+
+        for (int x = 0; x < width; x++) {
+            const uint8_t* p = input + x * (format == EPD_PIXEL_RGB888 ? 3 : 2);
+            int value;
+            if (format == EPD_PIXEL_GRAY8) {
+                value = input[x];
+            } else if (format == EPD_PIXEL_RGB888) {
+                value = reference_luma(p[0], p[1], p[2]);
+            } else {
+                // the 565 path is checked against the reference above
+                epd_convert_to_gray8(p, format, 1, NULL, &gray[x]);
+                value = gray[x];
+            }
+            gray[x] = tone_curve ? tone_curve[value] : value;
+        }
+
+        memset(output, 0xA5, sizeof(output));
+        epd_convert_to_4bpp(input, format, width, tone_curve, output);
+        for (int x = 0; x < width; x++) {
+            int nibble = x % 2 ? output[x / 2] >> 4 : output[x / 2] & 0x0F;
+            TEST_ASSERT_EQUAL(gray[x] >> 4, nibble);
+        }
+        if (width % 2) {
+            TEST_ASSERT_EQUAL(0, output[width / 2] >> 4);
+        }
+        TEST_ASSERT_EQUAL(0xA5, output[(width + 1) / 2]);
+    }
+}
+
+TEST_CASE("tone curve maps levels and inverts", "[epdiy,unit]") {
+    uint8_t curve[256];
+    epd_tone_curve(curve, 1.0, 0, 255, false);
+    for (int v = 0; v < 256; v++) {
+        TEST_ASSERT_EQUAL(v, curve[v]);
+    }
+
+    epd_tone_curve(curve, 0.5, 20, 200, true);
+    TEST_ASSERT_EQUAL(255, curve[0]);
+    TEST_ASSERT_EQUAL(255, curve[20]);
+    TEST_ASSERT_EQUAL(0, curve[200]);
+    TEST_ASSERT_EQUAL(0, curve[255]);
+    // a gamma below 1 darkens the mid tones, which are lighter when inverted
+    TEST_ASSERT_TRUE(curve[110] > 255 - 128);
+}
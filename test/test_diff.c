@@ -5,7 +5,9 @@
 #include <string.h>
 #include <sys/types.h>
 #include <unity.h>
+#include "epdiy.h"
 #include "esp_timer.h"
+#include "render.h"
 
 #define DEFAULT_EXAMPLE_LEN 704
 
@@ -181,4 +183,100 @@ TEST_CASE("different 4-byte alignments work", "[epdiy,unit]") {
     }
 
     diff_test_buffers_free(&bufs);
-}
\ No newline at end of file
+}
+
+TEST_CASE("difference image collects transition histogram", "[epdiy,unit]") {
+    const int fb_width = 32;
+    const int fb_height = 2;
+    const int fb_size = fb_width / 2 * fb_height;
+    const EpdRect crop = { .x = 0, .y = 0, .width = fb_width, .height = fb_height };
+
+    uint8_t* from = heap_caps_aligned_alloc(16, fb_size, MALLOC_CAP_DEFAULT);
+    uint8_t* to = heap_caps_aligned_alloc(16, fb_size, MALLOC_CAP_DEFAULT);
+    uint8_t* interlaced = heap_caps_aligned_alloc(16, 2 * fb_size, MALLOC_CAP_DEFAULT);
+    uint8_t* col_dirtyness = heap_caps_aligned_alloc(16, fb_width / 2, MALLOC_CAP_DEFAULT);
+    EpdTransitionHistogram* transitions = malloc(sizeof(EpdTransitionHistogram));
+    bool dirty_lines[2];
+    uint32_t line_transitions[2];
+
+    // only the first two pixels of the first line change from white to black
+    memset(from, 0xFF, fb_size);
+    memset(to, 0xFF, fb_size);
+    to[0] = 0x00;
+
+    EpdRect diff = epd_difference_image_base(
+        to,
+        from,
+        crop,
+        fb_width,
+        fb_height,
+        interlaced,
+        dirty_lines,
+        col_dirtyness,
+        transitions,
+        line_transitions
+    );
+
+    TEST_ASSERT_EQUAL(2, diff.width);
+    TEST_ASSERT_EQUAL(1, diff.height);
+
+    // the unchanged line is not counted, unchanged pixels of the changed line are
+    TEST_ASSERT_EQUAL_UINT32(2, transitions->counts[0x0][0xF]);
+    TEST_ASSERT_EQUAL_UINT32(fb_width - 2, transitions->counts[0xF][0xF]);
+    uint32_t total = 0;
+    for (int i = 0; i < 256; i++) {
+        total += ((uint32_t*)transitions->counts)[i];
+    }
+    TEST_ASSERT_EQUAL_UINT32(fb_width, total);
+
+    // line masks hold "from" levels in the lower, "to" levels in the upper half
+    TEST_ASSERT_EQUAL_HEX32((1u << 15) | (1u << 16) | (1u << 31), line_transitions[0]);
+    TEST_ASSERT_EQUAL_HEX32(0, line_transitions[1]);
+
+    free(transitions);
+    heap_caps_free(from);
+    heap_caps_free(to);
+    heap_caps_free(interlaced);
+    heap_caps_free(col_dirtyness);
+}
+
+/// Set the action of a transition in a frame of packed waveform phases.
+static void set_waveform_action(uint8_t* luts, int frame, int to, int from, uint8_t action) {
+    luts[16 * 4 * frame + to * 4 + (from >> 2)] |= action << (6 - 2 * (from & 3));
+}
+
+TEST_CASE("frames without actions for the drawn transitions are skipped", "[epdiy,unit]") {
+    enum { NUM_PHASES = 40 };
+    static uint8_t luts[16 * 4 * NUM_PHASES];
+    memset(luts, 0, sizeof(luts));
+    // white to black in frames 2 and 35, black to white in frame 5, 9 to 3 in frame 10
+    set_waveform_action(luts, 2, 0x0, 0xF, 1);
+    set_waveform_action(luts, 35, 0x0, 0xF, 1);
+    set_waveform_action(luts, 5, 0xF, 0x0, 2);
+    set_waveform_action(luts, 10, 0x3, 0x9, 1);
+    const EpdWaveformPhases phases = { .phases = NUM_PHASES, .luts = luts };
+
+    EpdTransitionHistogram* transitions = calloc(1, sizeof(EpdTransitionHistogram));
+    uint32_t active_frames[2] = { 0 };
+    TEST_ASSERT_EQUAL(0, find_active_frames(&phases, transitions, active_frames));
+    TEST_ASSERT_EQUAL_HEX32(0, active_frames[0]);
+    TEST_ASSERT_EQUAL_HEX32(0, active_frames[1]);
+
+    // unchanged pixels and transitions without actions do not make frames active
+    transitions->counts[0x0][0xF] = 5;
+    transitions->counts[0xF][0x0] = 3;
+    transitions->counts[0x7][0x7] = 100;
+    transitions->counts[0x9][0x3] = 1;
+    TEST_ASSERT_EQUAL(36, find_active_frames(&phases, transitions, active_frames));
+    TEST_ASSERT_EQUAL_HEX32((1u << 2) | (1u << 5), active_frames[0]);
+    TEST_ASSERT_EQUAL_HEX32(1u << (35 - 32), active_frames[1]);
+
+    memset(active_frames, 0, sizeof(active_frames));
+    memset(transitions, 0, sizeof(EpdTransitionHistogram));
+    transitions->counts[0x3][0x9] = 1;
+    TEST_ASSERT_EQUAL(11, find_active_frames(&phases, transitions, active_frames));
+    TEST_ASSERT_EQUAL_HEX32(1u << 10, active_frames[0]);
+    TEST_ASSERT_EQUAL_HEX32(0, active_frames[1]);
+
+    free(transitions);
+}
@@ -0,0 +1,126 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#include "display_list.h"
+#include "epd_display_list.h"
+#include "epdiy.h"
+
+#define LIST_WIDTH 61
+#define LIST_HEIGHT 40
+#define LINE_BYTES ((LIST_WIDTH + 1) / 2)
+
+static int get_pixel(const uint8_t* buffer, int x, int y) {
+    uint8_t byte = buffer[y * LINE_BYTES + x / 2];
+    return x % 2 ? byte >> 4 : byte & 0x0F;
+}
+
+TEST_CASE("display list rasterizes bands like the whole list", "[epdiy,unit]") {
+    static uint8_t whole[LINE_BYTES * LIST_HEIGHT];
+    static uint8_t bands[LINE_BYTES * LIST_HEIGHT];
+    uint8_t image_data[5 * 9];
+    for (int i = 0; i < sizeof(image_data); i++) {
+        image_data[i] = (uint8_t)(i * 37 + 11);
+    }
+    EpdBitmap image = { .data = image_data, .width = 9, .height = 9, .stride = 5, .bpp = 4 };
+
+    EpdDisplayList* list = epd_dl_create(LIST_WIDTH, LIST_HEIGHT, 0xF0);
+    TEST_ASSERT_NOT_NULL(list);
+    EpdRect rect = { .x = 3, .y = 2, .width = 20, .height = 30 };
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_dl_fill_rect(list, rect, 0x30));
+    EpdRect outline = { .x = -4, .y = 17, .width = 70, .height = 10 };
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_dl_draw_rect(list, outline, 0x00));
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_dl_draw_vline(list, 60, -5, 100, 0x80));
+    TEST_ASSERT_EQUAL(
+        EPD_DRAW_SUCCESS, epd_dl_draw_image(list, &image, 18, 33, EPD_ROP_TRANSPARENT, 0xB)
+    );
+
+    epd_dl_rasterize(list, 0, LIST_HEIGHT, whole);
+    for (int y = 0; y < LIST_HEIGHT; y += 7) {
+        int height = LIST_HEIGHT - y < 7 ? LIST_HEIGHT - y : 7;
+        epd_dl_rasterize(list, y, height, bands + y * LINE_BYTES);
+    }
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(whole, bands, sizeof(whole));
+
+    TEST_ASSERT_EQUAL(0xF, get_pixel(whole, 0, 0));
+    TEST_ASSERT_EQUAL(0x3, get_pixel(whole, 3, 2));
+    TEST_ASSERT_EQUAL(0x3, get_pixel(whole, 22, 31));
+    TEST_ASSERT_EQUAL(0xF, get_pixel(whole, 23, 31));
+    TEST_ASSERT_EQUAL(0x0, get_pixel(whole, 0, 17));
+    TEST_ASSERT_EQUAL(0x0, get_pixel(whole, 10, 26));
+    TEST_ASSERT_EQUAL(0x8, get_pixel(whole, 60, 39));
+    for (int y = 0; y < 7; y++) {
+        for (int x = 0; x < 9; x++) {
+            int value = (image_data[y * 5 + x / 2] >> (x % 2 * 4)) & 0xF;
+            int expected = value == 0xB ? get_pixel(whole, 0, 0) : value;
+            TEST_ASSERT_EQUAL(expected, get_pixel(whole, 18 + x, 33 + y));
+        }
+    }
+
+    epd_dl_clear(list);
+    epd_dl_rasterize(list, 0, LIST_HEIGHT, whole);
+    memset(bands, 0xFF, sizeof(bands));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(bands, whole, sizeof(whole));
+    epd_dl_free(list);
+}
+
+TEST_CASE("band line source provides the rasterized rows to both threads", "[epdiy,unit]") {
+    enum { HEIGHT = 90 };
+    static uint8_t whole[LINE_BYTES * HEIGHT];
+    static uint8_t glyph_bitmap[3 * 6];
+    for (int i = 0; i < sizeof(glyph_bitmap); i++) {
+        glyph_bitmap[i] = (uint8_t)(i * 53 + 7);
+    }
+    static const EpdGlyph glyph = {
+        .width = 5, .height = 6, .advance_x = 6, .left = 0, .top = 6, .data_offset = 0
+    };
+    static const EpdUnicodeInterval interval = { 'A', 'A', 0 };
+    EpdFont font = {
+        .bitmap = glyph_bitmap,
+        .glyph = &glyph,
+        .intervals = &interval,
+        .interval_count = 1,
+        .advance_y = 8,
+        .ascender = 6,
+        .descender = 2,
+    };
+
+    EpdDisplayList* list = epd_dl_create(LIST_WIDTH, HEIGHT, 0xF0);
+    TEST_ASSERT_NOT_NULL(list);
+    EpdRect rect = { .x = 5, .y = 10, .width = 30, .height = 70 };
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_dl_fill_rect(list, rect, 0x50));
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_dl_draw_hline(list, 0, 47, LIST_WIDTH, 0x00));
+    // a string crossing the border between the third and fourth band
+    int x = 20, y = 50;
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_dl_write_string(list, &font, "AAAA", &x, &y, NULL));
+    epd_dl_rasterize(list, 0, HEIGHT, whole);
+
+    BandRenderer* renderer = band_renderer_create(list);
+    TEST_ASSERT_NOT_NULL(renderer);
+
+    // The second thread falls behind in the first frame and reads replaced bands.
+    // Both threads are driven from this task, so neither may wait for the other:
+    // the second thread stops before the bands still held, which are replaced next,
+    // and with six bands, a new frame does not replace the last band of the previous one.
+    for (int row = 0; row < HEIGHT; row++) {
+        const uint8_t* line = band_line_source(row, 0, 0, renderer);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(whole + row * LINE_BYTES, line, LINE_BYTES);
+    }
+    for (int row = 0; row < 48; row++) {
+        const uint8_t* line = band_line_source(row, 0, 1, renderer);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(whole + row * LINE_BYTES, line, LINE_BYTES);
+    }
+
+    // later frames, which may skip frame numbers, alternate the rows between the threads
+    const int frames[] = { 1, 2, 5 };
+    for (int f = 0; f < sizeof(frames) / sizeof(frames[0]); f++) {
+        for (int row = 0; row < HEIGHT; row++) {
+            const uint8_t* line = band_line_source(row, frames[f], row % 2, renderer);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(whole + row * LINE_BYTES, line, LINE_BYTES);
+        }
+    }
+
+    band_renderer_free(renderer);
+    epd_dl_free(list);
+}
@@ -0,0 +1,88 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#include "epd_dither.h"
+
+static int get_level(const uint8_t* row, int bpp, int x) {
+    if (bpp == 4) {
+        return x % 2 ? row[x / 2] >> 4 : row[x / 2] & 0x0F;
+    }
+    return (row[x / 8] >> (x % 8)) & 1;
+}
+
+TEST_CASE("dithering without a method rounds to the closest level", "[epdiy,unit]") {
+    uint8_t gray[41];
+    uint8_t output[22];
+
+    srand(7);
+    for (int bpp = 1; bpp <= 4; bpp += 3) {
+        int levels = bpp == 4 ? 15 : 1;
+        for (int width = 1; width <= 41; width++) {
+            EpdDither* dither = epd_dither_create(width, bpp, EPD_DITHER_NONE);
+            TEST_ASSERT_NOT_NULL(dither);
+            for (int i = 0; i < width; i++) {
+                gray[i] = rand();
+            }
+            memset(output, 0xA5, sizeof(output));
+            epd_dither_row(dither, gray, output);
+
+            for (int x = 0; x < width; x++) {
+                TEST_ASSERT_EQUAL((gray[x] * levels + 127) / 255, get_level(output, bpp, x));
+            }
+            // padding bits are cleared, the rest of the buffer is untouched
+            int used_bits = width * bpp;
+            if (used_bits % 8) {
+                TEST_ASSERT_EQUAL(0, output[used_bits / 8] >> (used_bits % 8));
+            }
+            TEST_ASSERT_EQUAL(0xA5, output[(used_bits + 7) / 8]);
+            epd_dither_free(dither);
+        }
+    }
+}
+
+TEST_CASE("dithering preserves the mean gray value", "[epdiy,unit]") {
+    enum { SIZE = 64 };
+    uint8_t gray[SIZE];
+    uint8_t output[SIZE / 2];
+    const enum EpdDitherMethod methods[] = {
+        EPD_DITHER_BAYER,
+        EPD_DITHER_BLUE_NOISE,
+        EPD_DITHER_FLOYD_STEINBERG,
+        EPD_DITHER_ATKINSON,
+    };
+
+    for (int m = 0; m < sizeof(methods) / sizeof(methods[0]); m++) {
+        for (int bpp = 1; bpp <= 4; bpp += 3) {
+            int levels = bpp == 4 ? 15 : 1;
+            EpdDither* dither = epd_dither_create(SIZE, bpp, methods[m]);
+            TEST_ASSERT_NOT_NULL(dither);
+            for (int value = 0; value < 256; value += 17) {
+                memset(gray, value, sizeof(gray));
+                epd_dither_reset(dither);
+
+                int sum = 0;
+                for (int y = 0; y < SIZE; y++) {
+                    epd_dither_row(dither, gray, output);
+                    for (int x = 0; x < SIZE; x++) {
+                        int level = get_level(output, bpp, x);
+                        sum += level * 255 / levels;
+                        // dithering only chooses between the two closest levels
+                        TEST_ASSERT_INT_WITHIN(1, value * levels / 255, level);
+                    }
+                }
+                int mean = sum / (SIZE * SIZE);
+                // Atkinson only diffuses 3/4 of the error, clipping shadows and highlights
+                int tolerance = methods[m] == EPD_DITHER_ATKINSON && bpp == 1 ? 32 : 3;
+                TEST_ASSERT_INT_WITHIN(tolerance, value, mean);
+            }
+            epd_dither_free(dither);
+        }
+    }
+}
+
+TEST_CASE("dithering rejects invalid depths", "[epdiy,unit]") {
+    TEST_ASSERT_NULL(epd_dither_create(16, 2, EPD_DITHER_BAYER));
+    TEST_ASSERT_NULL(epd_dither_create(0, 4, EPD_DITHER_BAYER));
+}
@@ -0,0 +1,227 @@
+#include <esp_heap_caps.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#include "epd_board.h"
+#include "epd_display.h"
+#include "epdiy.h"
+
+// choose the default demo board depending on the architecture
+#ifdef CONFIG_IDF_TARGET_ESP32
+#define TEST_BOARD epd_board_v6
+#elif defined(CONFIG_IDF_TARGET_ESP32S3)
+#define TEST_BOARD epd_board_v7
+#endif
+
+TEST_CASE("span drawing matches per-pixel drawing", "[epdiy,e2e]") {
+    epd_init(&TEST_BOARD, &ED097TC2, EPD_OPTIONS_DEFAULT);
+
+    int fb_size = epd_width() / 2 * epd_height();
+    uint8_t* spans = heap_caps_malloc(fb_size, MALLOC_CAP_SPIRAM);
+    uint8_t* pixels = heap_caps_malloc(fb_size, MALLOC_CAP_SPIRAM);
+    TEST_ASSERT_NOT_NULL(spans);
+    TEST_ASSERT_NOT_NULL(pixels);
+
+    const EpdRect rects[] = {
+        { .x = 0, .y = 0, .width = 1, .height = 1 },
+        { .x = 3, .y = 5, .width = 100, .height = 1 },
+        { .x = 4, .y = 7, .width = 1, .height = 55 },
+        { .x = 17, .y = 20, .width = 33, .height = 12 },
+        { .x = -10, .y = -3, .width = 20, .height = 9 },
+        { .x = epd_width() - 7, .y = epd_height() - 5, .width = 30, .height = 30 },
+    };
+
+    for (int rotation = 0; rotation < 4; rotation++) {
+        epd_set_rotation(rotation);
+        for (int i = 0; i < sizeof(rects) / sizeof(EpdRect); i++) {
+            EpdRect r = rects[i];
+            memset(spans, 0xA5, fb_size);
+            memset(pixels, 0xA5, fb_size);
+
+            epd_fill_rect(r, 0x30, spans);
+            epd_draw_hline(r.x, r.y + r.height, r.width, 0xC0, spans);
+            epd_draw_vline(r.x + r.width, r.y, r.height, 0xF0, spans);
+
+            for (int y = r.y; y < r.y + r.height; y++) {
+                for (int x = r.x; x < r.x + r.width; x++) {
+                    epd_draw_pixel(x, y, 0x30, pixels);
+                }
+            }
+            for (int x = r.x; x < r.x + r.width; x++) {
+                epd_draw_pixel(x, r.y + r.height, 0xC0, pixels);
+            }
+            for (int y = r.y; y < r.y + r.height; y++) {
+                epd_draw_pixel(r.x + r.width, y, 0xF0, pixels);
+            }
+
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(pixels, spans, fb_size);
+        }
+    }
+
+    epd_set_rotation(EPD_ROT_LANDSCAPE);
+    heap_caps_free(spans);
+    heap_caps_free(pixels);
+    epd_deinit();
+}
+
+TEST_CASE("rotated image drawing matches per-pixel drawing", "[epdiy,e2e]") {
+    epd_init(&TEST_BOARD, &ED097TC2, EPD_OPTIONS_DEFAULT);
+
+    int fb_size = epd_width() / 2 * epd_height();
+    uint8_t* blitted = heap_caps_malloc(fb_size, MALLOC_CAP_SPIRAM);
+    uint8_t* pixels = heap_caps_malloc(fb_size, MALLOC_CAP_SPIRAM);
+    TEST_ASSERT_NOT_NULL(blitted);
+    TEST_ASSERT_NOT_NULL(pixels);
+
+    // odd dimensions to exercise partial tiles and nibble alignment
+    EpdRect area = { .x = 13, .y = -5, .width = 37, .height = 23 };
+    int image_size = (area.width / 2 + 1) * area.height;
+    uint8_t* image = malloc(image_size);
+    TEST_ASSERT_NOT_NULL(image);
+    for (int i = 0; i < image_size; i++) {
+        image[i] = (uint8_t)(i * 37 + 11);
+    }
+
+    for (int rotation = 0; rotation < 4; rotation++) {
+        epd_set_rotation(rotation);
+        memset(blitted, 0xA5, fb_size);
+        memset(pixels, 0xA5, fb_size);
+
+        epd_draw_rotated_transparent_image(area, image, blitted, 0xB0);
+        for (int y = 0; y < area.height; y++) {
+            for (int x = 0; x < area.width; x++) {
+                uint8_t color = epd_get_pixel(x, y, area.width, area.height, image);
+                if (color != 0xB0) {
+                    epd_draw_pixel(area.x + x, area.y + y, color, pixels);
+                }
+            }
+        }
+
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(pixels, blitted, fb_size);
+    }
+
+    epd_set_rotation(EPD_ROT_LANDSCAPE);
+    free(image);
+    heap_caps_free(blitted);
+    heap_caps_free(pixels);
+    epd_deinit();
+}
+
+/// Rows requested from a line source, per render thread.
+typedef struct {
+    int calls;
+    int min_row;
+    int max_row;
+    int last_frame;
+} StreamStats;
+
+/// A white row, returned for all rows of the streamed area.
+static uint8_t* stream_row;
+
+static const uint8_t* stream_line(int row, int frame, int thread_id, void* arg) {
+    StreamStats* stats = &((StreamStats*)arg)[thread_id];
+    stats->calls++;
+    stats->min_row = row < stats->min_row ? row : stats->min_row;
+    stats->max_row = row > stats->max_row ? row : stats->max_row;
+    stats->last_frame = frame > stats->last_frame ? frame : stats->last_frame;
+    return stream_row;
+}
+
+TEST_CASE("streamed drawing requests the drawn rows", "[epdiy,e2e]") {
+    epd_init(&TEST_BOARD, &ED097TC2, EPD_OPTIONS_DEFAULT);
+
+    stream_row = heap_caps_malloc(epd_width() / 2, MALLOC_CAP_INTERNAL);
+    TEST_ASSERT_NOT_NULL(stream_row);
+    memset(stream_row, 0xFF, epd_width() / 2);
+
+    StreamStats stats[EPD_NUM_RENDER_THREADS];
+    for (int t = 0; t < EPD_NUM_RENDER_THREADS; t++) {
+        stats[t] = (StreamStats){ .min_row = INT_MAX, .max_row = -1, .last_frame = -1 };
+    }
+    // like the highlevel API, draw an area at the top of the display cropped to itself
+    EpdRect area = { .x = 0, .y = 0, .width = epd_width(), .height = 50 };
+
+    epd_poweron();
+    enum EpdDrawError err = epd_draw_line_source(
+        area,
+        stream_line,
+        stats,
+        area,
+        MODE_DU | MODE_PACKING_2PPB | PREVIOUSLY_WHITE,
+        25,
+        NULL,
+        NULL,
+        EPD_BUILTIN_WAVEFORM,
+        NULL
+    );
+    epd_poweroff();
+
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, err);
+    int calls = 0, min_row = INT_MAX, max_row = -1, frames = 0;
+    for (int t = 0; t < EPD_NUM_RENDER_THREADS; t++) {
+        calls += stats[t].calls;
+        min_row = stats[t].min_row < min_row ? stats[t].min_row : min_row;
+        max_row = stats[t].max_row > max_row ? stats[t].max_row : max_row;
+        frames = stats[t].last_frame + 1 > frames ? stats[t].last_frame + 1 : frames;
+    }
+    TEST_ASSERT_EQUAL(0, min_row);
+    TEST_ASSERT_EQUAL(area.height - 1, max_row);
+    // without hints, every row is requested once per frame
+    TEST_ASSERT_EQUAL(frames * area.height, calls);
+
+    heap_caps_free(stream_row);
+    epd_deinit();
+}
+
+TEST_CASE("monochrome drawing matches thresholded grayscale drawing", "[epdiy,e2e]") {
+    epd_init(&TEST_BOARD, &ED097TC2, EPD_OPTIONS_DEFAULT);
+
+    int fb_size = epd_width() / 2 * epd_height();
+    int mono_stride = (epd_width() + 7) / 8;
+    uint8_t* gray = heap_caps_malloc(fb_size, MALLOC_CAP_SPIRAM);
+    uint8_t* mono = heap_caps_malloc(mono_stride * epd_height(), MALLOC_CAP_SPIRAM);
+    TEST_ASSERT_NOT_NULL(gray);
+    TEST_ASSERT_NOT_NULL(mono);
+
+    const EpdRect rects[] = {
+        { .x = 0, .y = 0, .width = 1, .height = 1 },
+        { .x = 3, .y = 5, .width = 100, .height = 1 },
+        { .x = 17, .y = 20, .width = 33, .height = 12 },
+        { .x = -10, .y = -3, .width = 20, .height = 9 },
+        { .x = epd_width() - 7, .y = epd_height() - 5, .width = 30, .height = 30 },
+    };
+
+    for (int rotation = 0; rotation < 4; rotation++) {
+        epd_set_rotation(rotation);
+        memset(gray, 0xFF, fb_size);
+        memset(mono, 0xFF, mono_stride * epd_height());
+
+        for (int i = 0; i < sizeof(rects) / sizeof(EpdRect); i++) {
+            EpdRect r = rects[i];
+            epd_fill_rect(r, 0x30, gray);
+            epd_fill_rect_mono(r, 0x30, mono);
+            epd_draw_rect(r, 0xF0, gray);
+            epd_draw_rect_mono(r, 0xF0, mono);
+            epd_draw_line(r.x, r.y, r.x + r.width, r.y + r.height, 0x00, gray);
+            epd_draw_line_mono(r.x, r.y, r.x + r.width, r.y + r.height, 0x00, mono);
+            epd_draw_pixel(r.x + 1, r.y, 0x00, gray);
+            epd_draw_pixel_mono(r.x + 1, r.y, 0x00, mono);
+        }
+
+        for (int y = 0; y < epd_height(); y++) {
+            for (int x = 0; x < epd_width(); x++) {
+                uint8_t g = gray[y * epd_width() / 2 + x / 2];
+                bool gray_white = (x % 2 ? g >> 4 : g & 0x0F) >= 8;
+                bool mono_white = (mono[y * mono_stride + x / 8] >> (x % 8)) & 1;
+                TEST_ASSERT_EQUAL(gray_white, mono_white);
+            }
+        }
+    }
+
+    epd_set_rotation(EPD_ROT_LANDSCAPE);
+    heap_caps_free(gray);
+    heap_caps_free(mono);
+    epd_deinit();
+}
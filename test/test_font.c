@@ -0,0 +1,757 @@
+#include <esp_heap_caps.h>
+#include <stdint.h>
+#include <string.h>
+#include <unity.h>
+
+#include "epd_board.h"
+#include "epd_display_list.h"
+#include "epd_font_file.h"
+#include "epdiy.h"
+
+// choose the default demo board depending on the architecture
+#ifdef CONFIG_IDF_TARGET_ESP32
+#define TEST_BOARD epd_board_v6
+#elif defined(CONFIG_IDF_TARGET_ESP32S3)
+#define TEST_BOARD epd_board_v7
+#endif
+
+static const EpdUnicodeInterval intervals[] = {
+    { 0x20, 0x7E, 0x0 },
+    { 0xA0, 0xFF, 0x5F },
+    { 0x100, 0x17F, 0xBF },
+    { 0x2010, 0x2015, 0x13F },
+    { 0x4E00, 0x4E10, 0x145 },
+};
+static EpdGlyph glyphs[0x156];
+
+/// Linear scan over the intervals, as a reference.
+static const EpdGlyph* reference_glyph(uint32_t code_point) {
+    for (int i = 0; i < sizeof(intervals) / sizeof(intervals[0]); i++) {
+        if (code_point >= intervals[i].first && code_point <= intervals[i].last) {
+            return &glyphs[intervals[i].offset + code_point - intervals[i].first];
+        }
+    }
+    return NULL;
+}
+
+TEST_CASE("glyph lookup matches a linear interval scan", "[epdiy,unit]") {
+    static uint16_t direct_index[256];
+    for (int cp = 0; cp < 256; cp++) {
+        const EpdGlyph* glyph = reference_glyph(cp);
+        direct_index[cp] = glyph ? glyph - glyphs : EPD_NO_GLYPH;
+    }
+
+    EpdFont font = {
+        .glyph = glyphs,
+        .intervals = intervals,
+        .interval_count = sizeof(intervals) / sizeof(intervals[0]),
+    };
+    for (int with_index = 0; with_index < 2; with_index++) {
+        font.direct_index = with_index ? direct_index : NULL;
+        for (uint32_t cp = 0; cp < 0x5000; cp++) {
+            TEST_ASSERT_EQUAL_PTR(reference_glyph(cp), epd_get_glyph(&font, cp));
+        }
+        TEST_ASSERT_NULL(epd_get_glyph(&font, 0x10FFFF));
+    }
+}
+
+enum { GLYPH_WIDTH = 7, GLYPH_HEIGHT = 9, GLYPH_BYTES = (GLYPH_WIDTH + 1) / 2 * GLYPH_HEIGHT };
+/// A zlib stream holding a single uncompressed block: header, block header, data, checksum.
+enum { STORED_SIZE = 2 + 5 + GLYPH_BYTES + 4 };
+
+/// Wrap a bitmap in a zlib stream without compression.
+static void zlib_store(const uint8_t* data, uint8_t* stream) {
+    uint32_t a = 1, b = 0;
+    for (int i = 0; i < GLYPH_BYTES; i++) {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    const uint8_t header[] = {
+        0x78, 0x01, 0x01, GLYPH_BYTES, 0x00, (uint8_t)~GLYPH_BYTES, 0xFF,
+    };
+    memcpy(stream, header, sizeof(header));
+    memcpy(stream + sizeof(header), data, GLYPH_BYTES);
+    uint32_t adler = (b << 16) | a;
+    for (int i = 0; i < 4; i++) {
+        stream[sizeof(header) + GLYPH_BYTES + i] = adler >> (24 - 8 * i);
+    }
+}
+
+enum { NUM_TEST_GLYPHS = 4 };
+static const EpdUnicodeInterval test_intervals[] = {
+    { ' ', ' ', NUM_TEST_GLYPHS },
+    { 'A', 'D', 0 },
+};
+static EpdGlyph raw_glyphs[NUM_TEST_GLYPHS + 1], compressed_glyphs[NUM_TEST_GLYPHS + 1];
+static uint8_t raw_bitmaps[NUM_TEST_GLYPHS * GLYPH_BYTES];
+static uint8_t compressed_bitmaps[NUM_TEST_GLYPHS * STORED_SIZE];
+
+/**
+ * Build a font of the glyphs 'A' to 'D' with pseudo random bitmaps and an empty space,
+ * and its compressed variant.
+ */
+static void make_test_fonts(EpdFont* raw_font, EpdFont* compressed_font) {
+    for (int i = 0; i < sizeof(raw_bitmaps); i++) {
+        raw_bitmaps[i] = i * 37 + 11;
+    }
+    for (int g = 0; g < NUM_TEST_GLYPHS; g++) {
+        EpdGlyph glyph = {
+            .width = GLYPH_WIDTH,
+            .height = GLYPH_HEIGHT,
+            .advance_x = GLYPH_WIDTH + 1,
+            .left = g - 1,
+            .top = GLYPH_HEIGHT - g,
+        };
+        raw_glyphs[g] = glyph;
+        raw_glyphs[g].data_offset = g * GLYPH_BYTES;
+        compressed_glyphs[g] = glyph;
+        compressed_glyphs[g].data_offset = g * STORED_SIZE;
+        compressed_glyphs[g].compressed_size = STORED_SIZE;
+        zlib_store(raw_bitmaps + g * GLYPH_BYTES, compressed_bitmaps + g * STORED_SIZE);
+    }
+    EpdGlyph space = { .advance_x = GLYPH_WIDTH / 2 };
+    raw_glyphs[NUM_TEST_GLYPHS] = space;
+    compressed_glyphs[NUM_TEST_GLYPHS] = space;
+    EpdFont font = {
+        .bitmap = raw_bitmaps,
+        .glyph = raw_glyphs,
+        .intervals = test_intervals,
+        .interval_count = sizeof(test_intervals) / sizeof(test_intervals[0]),
+        .advance_y = GLYPH_HEIGHT + 2,
+        .ascender = GLYPH_HEIGHT,
+    };
+    *raw_font = font;
+    *compressed_font = font;
+    compressed_font->bitmap = compressed_bitmaps;
+    compressed_font->glyph = compressed_glyphs;
+    compressed_font->compressed = true;
+}
+
+TEST_CASE("glyph cache serves repeated glyphs within its budget", "[epdiy,e2e]") {
+    EpdFont raw_font, compressed_font;
+    make_test_fonts(&raw_font, &compressed_font);
+
+    epd_init(&TEST_BOARD, &ED097TC2, EPD_OPTIONS_DEFAULT);
+    int fb_size = epd_width() / 2 * epd_height();
+    uint8_t* expected = heap_caps_calloc(1, fb_size, MALLOC_CAP_SPIRAM);
+    uint8_t* actual = heap_caps_calloc(1, fb_size, MALLOC_CAP_SPIRAM);
+    TEST_ASSERT_NOT_NULL(expected);
+    TEST_ASSERT_NOT_NULL(actual);
+
+    const char* text = "ABCABCDDA";
+    int x = 10, y = 20;
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_write_default(&raw_font, text, &x, &y, expected));
+
+    // measure the cost of one glyph, then allow a budget of two
+    epd_glyph_cache_configure(EPD_GLYPH_CACHE_DEFAULT_BUDGET, MALLOC_CAP_8BIT);
+    x = 10, y = 20;
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_write_default(&compressed_font, "A", &x, &y, actual));
+    size_t glyph_cost = epd_glyph_cache_stats().used_bytes;
+    TEST_ASSERT_TRUE(glyph_cost >= GLYPH_BYTES);
+
+    const size_t budgets[] = { EPD_GLYPH_CACHE_DEFAULT_BUDGET, 2 * glyph_cost, 0 };
+    const uint32_t expected_misses[] = { 4, 8, 9 };
+    for (int i = 0; i < sizeof(budgets) / sizeof(budgets[0]); i++) {
+        epd_glyph_cache_configure(budgets[i], MALLOC_CAP_8BIT);
+        memset(actual, 0, fb_size);
+        x = 10, y = 20;
+        TEST_ASSERT_EQUAL(
+            EPD_DRAW_SUCCESS, epd_write_default(&compressed_font, text, &x, &y, actual)
+        );
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, actual, fb_size);
+
+        EpdGlyphCacheStats stats = epd_glyph_cache_stats();
+        TEST_ASSERT_EQUAL(strlen(text), stats.hits + stats.misses);
+        TEST_ASSERT_EQUAL(expected_misses[i], stats.misses);
+        TEST_ASSERT_TRUE(stats.used_bytes <= budgets[i]);
+    }
+
+    epd_glyph_cache_configure(EPD_GLYPH_CACHE_DEFAULT_BUDGET, MALLOC_CAP_8BIT);
+    heap_caps_free(expected);
+    heap_caps_free(actual);
+    epd_deinit();
+}
+
+TEST_CASE("text drawing matches per-pixel glyph drawing", "[epdiy,e2e]") {
+    EpdFont font, compressed_font;
+    make_test_fonts(&font, &compressed_font);
+
+    epd_init(&TEST_BOARD, &ED097TC2, EPD_OPTIONS_DEFAULT);
+    int fb_size = epd_width() / 2 * epd_height();
+    int mono_stride = (epd_width() + 7) / 8;
+    uint8_t* expected = heap_caps_malloc(fb_size, MALLOC_CAP_SPIRAM);
+    uint8_t* actual = heap_caps_malloc(fb_size, MALLOC_CAP_SPIRAM);
+    uint8_t* mono = heap_caps_malloc(mono_stride * epd_height(), MALLOC_CAP_SPIRAM);
+    TEST_ASSERT_NOT_NULL(expected);
+    TEST_ASSERT_NOT_NULL(actual);
+    TEST_ASSERT_NOT_NULL(mono);
+
+    const char* text = "ABCDDCBA";
+    EpdFontProperties props = epd_font_properties_default();
+    props.fg_color = 2;
+    props.bg_color = 13;
+
+    for (int rotation = 0; rotation < 4; rotation++) {
+        epd_set_rotation(rotation);
+        // partially clipped at the top left and bottom right corners, and fully visible
+        const int positions[][2] = {
+            { -5, 3 },
+            { 20, 30 },
+            { epd_rotated_display_width() - 40, epd_rotated_display_height() + 2 },
+        };
+        for (int background = 0; background < 2; background++) {
+            props.flags = background ? EPD_DRAW_BACKGROUND : 0;
+            for (int p = 0; p < sizeof(positions) / sizeof(positions[0]); p++) {
+                memset(expected, 0xFF, fb_size);
+                memset(actual, 0xFF, fb_size);
+                memset(mono, 0x55, mono_stride * epd_height());
+
+                int x = positions[p][0], y = positions[p][1];
+                if (background) {
+                    int x1, y1, w, h;
+                    epd_get_text_bounds(&font, text, &x, &y, &x1, &y1, &w, &h, &props);
+                    for (int l = y - font.ascender; l < y - font.descender; l++) {
+                        epd_draw_hline(x, l, w, props.bg_color << 4, expected);
+                    }
+                }
+                int cursor_x = x;
+                for (const char* c = text; *c; c++) {
+                    const EpdGlyph* glyph = epd_get_glyph(&font, *c);
+                    const uint8_t* bitmap = font.bitmap + glyph->data_offset;
+                    for (int gy = 0; gy < glyph->height; gy++) {
+                        for (int gx = 0; gx < glyph->width; gx++) {
+                            uint8_t b = bitmap[gy * ((glyph->width + 1) / 2) + gx / 2];
+                            int coverage = gx % 2 ? b >> 4 : b & 0x0F;
+                            int level = props.bg_color
+                                        + coverage * (props.fg_color - props.bg_color) / 15;
+                            if (coverage || background) {
+                                int px = cursor_x + glyph->left + gx;
+                                epd_draw_pixel(px, y - glyph->top + gy, level << 4, expected);
+                            }
+                        }
+                    }
+                    cursor_x += glyph->advance_x;
+                }
+
+                int cx = x, cy = y;
+                TEST_ASSERT_EQUAL(
+                    EPD_DRAW_SUCCESS,
+                    epd_write_string(&compressed_font, text, &cx, &cy, actual, &props)
+                );
+                TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, actual, fb_size);
+
+                cx = x, cy = y;
+                TEST_ASSERT_EQUAL(
+                    EPD_DRAW_SUCCESS, epd_write_string_mono(&font, text, &cx, &cy, mono, &props)
+                );
+                for (int fy = 0; fy < epd_height(); fy++) {
+                    for (int fx = 0; fx < epd_width(); fx++) {
+                        uint8_t g = expected[fy * epd_width() / 2 + fx / 2];
+                        int level = fx % 2 ? g >> 4 : g & 0x0F;
+                        int bit = (mono[fy * mono_stride + fx / 8] >> (fx % 8)) & 1;
+                        // untouched pixels keep the initial pattern
+                        int expected_bit = level == 15 ? (fx % 2 == 0) : level >= 8;
+                        TEST_ASSERT_EQUAL(expected_bit, bit);
+                    }
+                }
+            }
+        }
+    }
+
+    epd_set_rotation(EPD_ROT_LANDSCAPE);
+    heap_caps_free(expected);
+    heap_caps_free(actual);
+    heap_caps_free(mono);
+    epd_deinit();
+}
+
+TEST_CASE("wrapped text breaks lines at spaces and within long words", "[epdiy,e2e]") {
+    EpdFont font, compressed_font;
+    make_test_fonts(&font, &compressed_font);
+
+    epd_init(&TEST_BOARD, &ED097TC2, EPD_OPTIONS_DEFAULT);
+    int fb_size = epd_width() / 2 * epd_height();
+    uint8_t* expected = heap_caps_calloc(1, fb_size, MALLOC_CAP_SPIRAM);
+    uint8_t* actual = heap_caps_calloc(1, fb_size, MALLOC_CAP_SPIRAM);
+    TEST_ASSERT_NOT_NULL(expected);
+    TEST_ASSERT_NOT_NULL(actual);
+
+    // glyphs advance by 8 pixels, spaces by 3
+    const char* text = "ABC AB ABCDABCD A\nBB";
+    const char* lines[] = { "ABC", "AB", "ABC", "DAB", "CD", "A", "BB" };
+    int num_lines = sizeof(lines) / sizeof(lines[0]);
+
+    EpdFontProperties props = epd_font_properties_default();
+    props.flags = EPD_DRAW_ALIGN_CENTER;
+    int x = 100, y = 12;
+    for (int i = 0; i < num_lines; i++) {
+        int cx = x, cy = y + i * font.advance_y;
+        TEST_ASSERT_EQUAL(
+            EPD_DRAW_SUCCESS, epd_write_string(&font, lines[i], &cx, &cy, expected, &props)
+        );
+    }
+
+    int cx = x, cy = y;
+    TEST_ASSERT_EQUAL(
+        EPD_DRAW_SUCCESS,
+        epd_write_string_wrapped(&compressed_font, text, &cx, &cy, 3 * 8, actual, &props)
+    );
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, actual, fb_size);
+    TEST_ASSERT_EQUAL(y + num_lines * font.advance_y, cy);
+
+    heap_caps_free(expected);
+    heap_caps_free(actual);
+    epd_deinit();
+}
+
+TEST_CASE("cached text draws like uncached text", "[epdiy,e2e]") {
+    EpdFont font, compressed_font;
+    make_test_fonts(&font, &compressed_font);
+
+    epd_init(&TEST_BOARD, &ED097TC2, EPD_OPTIONS_DEFAULT);
+    epd_text_cache_configure(EPD_TEXT_CACHE_DEFAULT_BUDGET, MALLOC_CAP_8BIT);
+    int fb_size = epd_width() / 2 * epd_height();
+    uint8_t* expected = heap_caps_malloc(fb_size, MALLOC_CAP_SPIRAM);
+    uint8_t* actual = heap_caps_malloc(fb_size, MALLOC_CAP_SPIRAM);
+    TEST_ASSERT_NOT_NULL(expected);
+    TEST_ASSERT_NOT_NULL(actual);
+
+    const char* texts[] = { "ABCDDCBA", "AB C\nDA", "" };
+    EpdFontProperties props = epd_font_properties_default();
+    props.fg_color = 2;
+    props.bg_color = 13;
+
+    for (int rotation = 0; rotation < 4; rotation++) {
+        epd_set_rotation(rotation);
+        // clipped at the top left and bottom right corners, and at an odd x
+        const int positions[][2] = {
+            { -5, 3 },
+            { 21, 30 },
+            { epd_rotated_display_width() - 40, epd_rotated_display_height() + 2 },
+        };
+        for (int flags = 0; flags < 2; flags++) {
+            props.flags = flags ? EPD_DRAW_BACKGROUND | EPD_DRAW_ALIGN_CENTER : 0;
+            for (int t = 0; t < sizeof(texts) / sizeof(texts[0]); t++) {
+                for (int p = 0; p < sizeof(positions) / sizeof(positions[0]); p++) {
+                    // text without background must keep what is below it
+                    for (int i = 0; i < fb_size; i++) {
+                        expected[i] = i * 7;
+                    }
+                    memcpy(actual, expected, fb_size);
+
+                    int x = positions[p][0], y = positions[p][1];
+                    int ex = x, ey = y, ax = x, ay = y;
+                    enum EpdDrawError err
+                        = epd_write_string(&font, texts[t], &ex, &ey, expected, &props);
+                    TEST_ASSERT_EQUAL(
+                        err,
+                        epd_write_string_cached(
+                            &compressed_font, texts[t], &ax, &ay, actual, &props
+                        )
+                    );
+                    TEST_ASSERT_EQUAL(ex, ax);
+                    TEST_ASSERT_EQUAL(ey, ay);
+                    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, actual, fb_size);
+                }
+            }
+        }
+    }
+
+    // the same strings again are served from the cache
+    EpdTextCacheStats before = epd_text_cache_stats();
+    int x = 21, y = 30;
+    epd_write_string_cached(&compressed_font, texts[1], &x, &y, actual, &props);
+    EpdTextCacheStats after = epd_text_cache_stats();
+    TEST_ASSERT_EQUAL(before.hits + 1, after.hits);
+    TEST_ASSERT_EQUAL(before.misses, after.misses);
+    TEST_ASSERT_LESS_OR_EQUAL(after.budget_bytes, after.used_bytes);
+
+    epd_text_cache_clear();
+    TEST_ASSERT_EQUAL(0, epd_text_cache_stats().used_bytes);
+    epd_set_rotation(EPD_ROT_LANDSCAPE);
+    heap_caps_free(expected);
+    heap_caps_free(actual);
+    epd_deinit();
+}
+
+/**
+ * Build a font with `bpp` bits per pixel from the pixels of the raw test font,
+ * and a 4 bpp font with the same coverage of each pixel.
+ */
+static void make_depth_fonts(
+    int bpp, const EpdFont* raw_font, EpdFont* depth_font, EpdFont* expanded_font
+) {
+    static EpdGlyph depth_glyphs[NUM_TEST_GLYPHS + 1];
+    static uint8_t depth_bitmaps[NUM_TEST_GLYPHS * GLYPH_BYTES];
+    static uint8_t expanded_bitmaps[NUM_TEST_GLYPHS * GLYPH_BYTES];
+    int max_value = (1 << bpp) - 1;
+    int byte_width = (GLYPH_WIDTH * bpp + 7) / 8;
+    memset(depth_bitmaps, 0, sizeof(depth_bitmaps));
+    memset(expanded_bitmaps, 0, sizeof(expanded_bitmaps));
+    memcpy(depth_glyphs, raw_glyphs, sizeof(depth_glyphs));
+    for (int g = 0; g < NUM_TEST_GLYPHS; g++) {
+        depth_glyphs[g].data_offset = g * byte_width * GLYPH_HEIGHT;
+        for (int y = 0; y < GLYPH_HEIGHT; y++) {
+            for (int x = 0; x < GLYPH_WIDTH; x++) {
+                int i = g * GLYPH_BYTES + y * (GLYPH_WIDTH + 1) / 2 + x / 2;
+                int value = ((x % 2 ? raw_bitmaps[i] >> 4 : raw_bitmaps[i]) & 0x0F) >> (4 - bpp);
+                int bit = x * bpp;
+                depth_bitmaps[depth_glyphs[g].data_offset + y * byte_width + bit / 8]
+                    |= value << (bit % 8);
+                expanded_bitmaps[i] |= (value * 15 / max_value) << (x % 2 * 4);
+            }
+        }
+    }
+    *depth_font = *raw_font;
+    depth_font->bitmap = depth_bitmaps;
+    depth_font->glyph = depth_glyphs;
+    depth_font->bits_per_pixel = bpp;
+    *expanded_font = *raw_font;
+    expanded_font->bitmap = expanded_bitmaps;
+}
+
+/// Whether a run of uncovered or covered pixels starts at `values[i]`.
+static bool starts_run(const uint8_t* values, int i, int n, uint8_t max_value) {
+    return i + 1 < n && values[i] == values[i + 1] && (values[i] == 0 || values[i] == max_value);
+}
+
+/// Run-length encode `n` glyph pixels, see `EPD_COMPRESSION_RLE`. Returns the encoded size.
+static size_t rle_encode(const uint8_t* values, int n, int bpp, uint8_t* out) {
+    uint8_t max_value = (1 << bpp) - 1;
+    size_t size = 0;
+    for (int i = 0; i < n;) {
+        int count = 1;
+        if (starts_run(values, i, n, max_value)) {
+            while (i + count < n && count < 64 && values[i + count] == values[i]) {
+                count++;
+            }
+            out[size++] = (values[i] ? 0x40 : 0x00) | (count - 1);
+        } else {
+            while (i + count < n && count < 64 && !starts_run(values, i + count, n, max_value)) {
+                count++;
+            }
+            out[size++] = 0x80 | (count - 1);
+            memset(out + size, 0, (count * bpp + 7) / 8);
+            for (int k = 0; k < count; k++) {
+                out[size + k * bpp / 8] |= values[i + k] << (k * bpp % 8);
+            }
+            size += (count * bpp + 7) / 8;
+        }
+        i += count;
+    }
+    return size;
+}
+
+TEST_CASE("run-length encoded glyphs decode to their bitmaps", "[epdiy,unit]") {
+    // wide enough for runs across rows and runs longer than one token
+    enum { WIDTH = 45, HEIGHT = 6, MAX_PIXELS = 48 * HEIGHT };
+    static uint8_t values[MAX_PIXELS], bitmap[MAX_PIXELS];
+    static uint8_t encoded[2 * MAX_PIXELS], decoded[MAX_PIXELS];
+    for (int bpp = 1; bpp <= 4; bpp *= 2) {
+        uint8_t max_value = (1 << bpp) - 1;
+        int byte_width = (WIDTH * bpp + 7) / 8;
+        // pixels are encoded with the padding of each row
+        int padded_width = byte_width * 8 / bpp;
+        memset(values, 0, sizeof(values));
+        memset(bitmap, 0, sizeof(bitmap));
+        for (int y = 0; y < HEIGHT; y++) {
+            for (int x = 0; x < WIDTH; x++) {
+                uint8_t* value = &values[y * padded_width + x];
+                if (y == 1 || (x + y) % 11 < 4) {
+                    *value = 0;
+                } else if (y == 4 || x > 30) {
+                    *value = max_value;
+                } else {
+                    *value = (x * 7 + y) & max_value;
+                }
+                bitmap[y * byte_width + x * bpp / 8] |= *value << (x * bpp % 8);
+            }
+        }
+
+        EpdGlyph glyph = {
+            .width = WIDTH,
+            .height = HEIGHT,
+            .compressed_size = rle_encode(values, padded_width * HEIGHT, bpp, encoded),
+        };
+        EpdFont font = {
+            .bitmap = encoded,
+            .glyph = &glyph,
+            .compressed = EPD_COMPRESSION_RLE,
+            .bits_per_pixel = bpp,
+        };
+        memset(decoded, 0xAA, sizeof(decoded));
+        TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_decompress_glyph(&font, &glyph, decoded));
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(bitmap, decoded, byte_width * HEIGHT);
+
+        // truncated and overlong streams are rejected
+        glyph.compressed_size -= 1;
+        TEST_ASSERT_EQUAL(EPD_DRAW_FAILED_ALLOC, epd_decompress_glyph(&font, &glyph, decoded));
+        glyph.compressed_size += 2;
+        TEST_ASSERT_EQUAL(EPD_DRAW_FAILED_ALLOC, epd_decompress_glyph(&font, &glyph, decoded));
+    }
+}
+
+TEST_CASE("glyphs with fewer bits per pixel draw like their 4 bpp expansion", "[epdiy,e2e]") {
+    EpdFont raw_font, compressed_font, depth_font, expanded_font;
+    make_test_fonts(&raw_font, &compressed_font);
+
+    epd_init(&TEST_BOARD, &ED097TC2, EPD_OPTIONS_DEFAULT);
+    int fb_size = epd_width() / 2 * epd_height();
+    uint8_t* expected = heap_caps_malloc(fb_size, MALLOC_CAP_SPIRAM);
+    uint8_t* actual = heap_caps_malloc(fb_size, MALLOC_CAP_SPIRAM);
+    TEST_ASSERT_NOT_NULL(expected);
+    TEST_ASSERT_NOT_NULL(actual);
+
+    const char* text = "ABCD DCBA";
+    EpdFontProperties props = epd_font_properties_default();
+    props.fg_color = 1;
+    props.bg_color = 14;
+    for (int bpp = 1; bpp <= 2; bpp++) {
+        make_depth_fonts(bpp, &raw_font, &depth_font, &expanded_font);
+        for (int rotation = 0; rotation < 4; rotation++) {
+            epd_set_rotation(rotation);
+            for (int background = 0; background < 2; background++) {
+                props.flags = background ? EPD_DRAW_BACKGROUND : 0;
+                memset(expected, 0x77, fb_size);
+                memset(actual, 0x77, fb_size);
+                int x = -3, y = 10;
+                TEST_ASSERT_EQUAL(
+                    EPD_DRAW_SUCCESS,
+                    epd_write_string(&expanded_font, text, &x, &y, expected, &props)
+                );
+                x = -3, y = 10;
+                TEST_ASSERT_EQUAL(
+                    EPD_DRAW_SUCCESS, epd_write_string(&depth_font, text, &x, &y, actual, &props)
+                );
+                TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, actual, fb_size);
+            }
+        }
+        epd_set_rotation(EPD_ROT_LANDSCAPE);
+
+        EpdDisplayList* lists[2] = {
+            epd_dl_create(epd_width(), epd_height(), 0xF0),
+            epd_dl_create(epd_width(), epd_height(), 0xF0),
+        };
+        const EpdFont* fonts[2] = { &expanded_font, &depth_font };
+        uint8_t* buffers[2] = { expected, actual };
+        for (int i = 0; i < 2; i++) {
+            TEST_ASSERT_NOT_NULL(lists[i]);
+            int x = 5, y = 20;
+            TEST_ASSERT_EQUAL(
+                EPD_DRAW_SUCCESS, epd_dl_write_string(lists[i], fonts[i], text, &x, &y, &props)
+            );
+            epd_dl_rasterize(lists[i], 0, epd_height(), buffers[i]);
+            epd_dl_free(lists[i]);
+        }
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, actual, fb_size);
+    }
+
+    heap_caps_free(expected);
+    heap_caps_free(actual);
+    epd_deinit();
+}
+
+TEST_CASE("font stacks take each glyph from the first font that has it", "[epdiy,unit]") {
+    EpdFont raw_font, compressed_font;
+    make_test_fonts(&raw_font, &compressed_font);
+
+    // overlapping with the test fonts, and with non-consecutive glyphs
+    const EpdUnicodeInterval second_intervals[] = {
+        { 'C', 'F', 0 },
+        { 0x3B1, 0x3B3, 1 },
+    };
+    const EpdUnicodeInterval third_intervals[] = {
+        { ' ', ' ', 2 },
+        { 0x3B0, 0x3B4, 0 },
+    };
+    EpdFont second = raw_font, third = raw_font;
+    second.intervals = second_intervals;
+    second.interval_count = 2;
+    second.advance_y = 30;
+    second.descender = -4;
+    third.intervals = third_intervals;
+    third.interval_count = 2;
+    third.ascender = 20;
+
+    const EpdFont* fonts[] = { &compressed_font, &second, &third };
+    const EpdFont* stack = epd_font_stack_create(fonts, 3);
+    TEST_ASSERT_NOT_NULL(stack);
+    TEST_ASSERT_EQUAL(30, stack->advance_y);
+    TEST_ASSERT_EQUAL(20, stack->ascender);
+    TEST_ASSERT_EQUAL(-4, stack->descender);
+
+    for (uint32_t code_point = 0; code_point < 0x400; code_point++) {
+        const EpdGlyph* expected = NULL;
+        const EpdFont* expected_font = NULL;
+        for (int f = 0; f < 3 && expected == NULL; f++) {
+            expected = epd_get_glyph(fonts[f], code_point);
+            expected_font = fonts[f];
+        }
+        const EpdFont* glyph_font;
+        const EpdGlyph* glyph = epd_resolve_glyph(stack, code_point, &glyph_font);
+        TEST_ASSERT_EQUAL_PTR(expected, glyph);
+        TEST_ASSERT_EQUAL_PTR(expected, epd_get_glyph(stack, code_point));
+        if (expected != NULL) {
+            TEST_ASSERT_EQUAL_PTR(expected_font, glyph_font);
+        }
+    }
+
+    // stacks cannot be nested
+    const EpdFont* nested[] = { &raw_font, stack };
+    TEST_ASSERT_NULL(epd_font_stack_create(nested, 2));
+    epd_font_stack_free(stack);
+}
+
+TEST_CASE("font stacks draw glyphs like their fonts", "[epdiy,e2e]") {
+    EpdFont raw_font, compressed_font, depth_font, expanded_font;
+    make_test_fonts(&raw_font, &compressed_font);
+    make_depth_fonts(2, &raw_font, &depth_font, &expanded_font);
+    // the 2 bpp glyphs of 'A' to 'C' as 'E' to 'G' and U+03B1 to U+03B3
+    const EpdUnicodeInterval depth_intervals[] = {
+        { 'E', 'G', 0 },
+        { 0x3B1, 0x3B3, 0 },
+    };
+    depth_font.intervals = depth_intervals;
+    depth_font.interval_count = 2;
+    const EpdFont* fonts[] = { &compressed_font, &depth_font };
+    const EpdFont* stack = epd_font_stack_create(fonts, 2);
+    TEST_ASSERT_NOT_NULL(stack);
+
+    epd_init(&TEST_BOARD, &ED097TC2, EPD_OPTIONS_DEFAULT);
+    int fb_size = epd_width() / 2 * epd_height();
+    uint8_t* expected = heap_caps_malloc(fb_size, MALLOC_CAP_SPIRAM);
+    uint8_t* actual = heap_caps_malloc(fb_size, MALLOC_CAP_SPIRAM);
+    TEST_ASSERT_NOT_NULL(expected);
+    TEST_ASSERT_NOT_NULL(actual);
+
+    // "AB", "E\u03B2", "D" alternating between the fonts
+    const char* pieces[] = { "AB", "E\xCE\xB2", "D" };
+    const EpdFont* piece_fonts[] = { &raw_font, &depth_font, &raw_font };
+    const char* text = "ABE\xCE\xB2" "D";
+    EpdFontProperties props = epd_font_properties_default();
+    props.fg_color = 3;
+    props.bg_color = 12;
+    for (int rotation = 0; rotation < 4; rotation++) {
+        epd_set_rotation(rotation);
+        memset(expected, 0x99, fb_size);
+        memset(actual, 0x99, fb_size);
+        int x = 7;
+        for (int i = 0; i < 3; i++) {
+            int y = 15;
+            TEST_ASSERT_EQUAL(
+                EPD_DRAW_SUCCESS,
+                epd_write_string(piece_fonts[i], pieces[i], &x, &y, expected, &props)
+            );
+        }
+        int cx = 7, cy = 15;
+        TEST_ASSERT_EQUAL(
+            EPD_DRAW_SUCCESS, epd_write_string(stack, text, &cx, &cy, actual, &props)
+        );
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, actual, fb_size);
+        TEST_ASSERT_EQUAL(x, cx);
+        TEST_ASSERT_EQUAL(15 + stack->advance_y, cy);
+    }
+    epd_set_rotation(EPD_ROT_LANDSCAPE);
+
+    // display lists look glyphs up the same way
+    memset(actual, 0x99, fb_size);
+    int x = 7, y = 15;
+    epd_write_string(stack, text, &x, &y, actual, &props);
+    EpdDisplayList* list = epd_dl_create(epd_width(), epd_height(), 0x99);
+    TEST_ASSERT_NOT_NULL(list);
+    x = 7, y = 15;
+    TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_dl_write_string(list, stack, text, &x, &y, &props));
+    epd_dl_rasterize(list, 0, epd_height(), expected);
+    epd_dl_free(list);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, actual, fb_size);
+
+    epd_font_stack_free(stack);
+    heap_caps_free(expected);
+    heap_caps_free(actual);
+    epd_deinit();
+}
+
+/// Write a font in the binary font file format, without a direct index.
+static size_t write_font_file(const EpdFont* font, size_t bitmap_size, uint8_t* out) {
+    enum { HEADER_SIZE = 44 };
+    size_t intervals_size = font->interval_count * sizeof(EpdUnicodeInterval);
+    size_t glyphs_size = (NUM_TEST_GLYPHS + 1) * sizeof(EpdGlyph);
+    uint32_t header[HEADER_SIZE / 4] = {
+        [4] = font->interval_count,
+        [5] = NUM_TEST_GLYPHS + 1,
+        [6] = HEADER_SIZE,
+        [7] = HEADER_SIZE + intervals_size,
+        [9] = HEADER_SIZE + intervals_size + glyphs_size,
+        [10] = bitmap_size,
+    };
+    memcpy(header, "EPDF", 4);
+    uint16_t fields[] = { 1, font->compressed, font->advance_y, font->ascender, font->descender };
+    memcpy((uint8_t*)header + 4, fields, sizeof(fields));
+
+    memcpy(out, header, HEADER_SIZE);
+    memcpy(out + header[6], font->intervals, intervals_size);
+    memcpy(out + header[7], font->glyph, glyphs_size);
+    memcpy(out + header[9], font->bitmap, bitmap_size);
+    return header[9] + bitmap_size;
+}
+
+TEST_CASE("binary fonts in memory are used in place", "[epdiy,unit]") {
+    static uint32_t file[1024];
+    uint8_t* data = (uint8_t*)file;
+    EpdFont raw_font, compressed_font;
+    make_test_fonts(&raw_font, &compressed_font);
+    size_t size = write_font_file(&compressed_font, sizeof(compressed_bitmaps), data);
+
+    const EpdFont* font = epd_font_from_memory(data, size);
+    TEST_ASSERT_NOT_NULL(font);
+    TEST_ASSERT_TRUE(font->compressed);
+    TEST_ASSERT_EQUAL(compressed_font.interval_count, font->interval_count);
+    TEST_ASSERT_EQUAL(compressed_font.advance_y, font->advance_y);
+    TEST_ASSERT_EQUAL(compressed_font.ascender, font->ascender);
+    TEST_ASSERT_NULL(epd_get_glyph(font, 'E'));
+    TEST_ASSERT_EQUAL(GLYPH_WIDTH / 2, epd_get_glyph(font, ' ')->advance_x);
+    for (int g = 0; g < NUM_TEST_GLYPHS; g++) {
+        const EpdGlyph* glyph = epd_get_glyph(font, 'A' + g);
+        TEST_ASSERT_EQUAL_MEMORY(&compressed_glyphs[g], glyph, sizeof(EpdGlyph));
+        uint8_t bitmap[GLYPH_BYTES];
+        TEST_ASSERT_EQUAL(EPD_DRAW_SUCCESS, epd_decompress_glyph(font, glyph, bitmap));
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(raw_bitmaps + g * GLYPH_BYTES, bitmap, GLYPH_BYTES);
+    }
+    epd_font_close(font);
+
+    // a direct index is used, unless its entries are beyond the glyphs
+    uint32_t* header = file;
+    size_t index_offset = (size + 3) / 4 * 4;
+    uint16_t* direct_index = (uint16_t*)(data + index_offset);
+    for (int cp = 0; cp < 256; cp++) {
+        const EpdGlyph* glyph = epd_get_glyph(&compressed_font, cp);
+        direct_index[cp] = glyph ? glyph - compressed_font.glyph : EPD_NO_GLYPH;
+    }
+    header[8] = index_offset;
+    size_t indexed_size = index_offset + 256 * sizeof(uint16_t);
+    font = epd_font_from_memory(data, indexed_size);
+    TEST_ASSERT_NOT_NULL(font);
+    TEST_ASSERT_NOT_NULL(font->direct_index);
+    TEST_ASSERT_EQUAL_MEMORY(&compressed_glyphs[1], epd_get_glyph(font, 'B'), sizeof(EpdGlyph));
+    epd_font_close(font);
+    direct_index['E'] = NUM_TEST_GLYPHS + 1;
+    TEST_ASSERT_NULL(epd_font_from_memory(data, indexed_size));
+    header[8] = 0;
+
+    // glyph data beyond the bitmaps is rejected
+    EpdGlyph* glyphs = (EpdGlyph*)(data + header[7]);
+    glyphs[NUM_TEST_GLYPHS - 1].compressed_size++;
+    TEST_ASSERT_NULL(epd_font_from_memory(data, size));
+    glyphs[NUM_TEST_GLYPHS - 1].compressed_size--;
+    TEST_ASSERT_NOT_NULL(font = epd_font_from_memory(data, size));
+    epd_font_close(font);
+
+    // truncated files, unaligned data and intervals beyond the glyphs are rejected
+    TEST_ASSERT_NULL(epd_font_from_memory(data, size - 1));
+    TEST_ASSERT_NULL(epd_font_from_memory(data + 1, size - 1));
+    EpdUnicodeInterval* intervals = (EpdUnicodeInterval*)(data + 44);
+    intervals[1].last = 'F';
+    TEST_ASSERT_NULL(epd_font_from_memory(data, size));
+    data[0] = 'X';
+    TEST_ASSERT_NULL(epd_font_from_memory(data, size));
+}
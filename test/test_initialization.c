@@ -43,4 +43,67 @@ TEST_CASE("re-initialization works", "[epdiy,e2e]") {
     epd_deinit();
     int after_init = esp_get_free_internal_heap_size();
     TEST_ASSERT_EQUAL(after_init, before_init);
-}
\ No newline at end of file
+}
+
+TEST_CASE("ambient temperature is cached up to its maximum age", "[epdiy,e2e]") {
+    epd_init(&TEST_BOARD, &ED097TC2, EPD_OPTIONS_DEFAULT);
+    epd_poweron();
+
+    epd_set_temperature_max_age(0);
+    float temperature = epd_ambient_temperature();
+    EpdTemperatureReading first = epd_temperature_reading();
+    TEST_ASSERT_TRUE(first.timestamp_us != 0);
+    TEST_ASSERT_EQUAL_FLOAT(temperature, first.temperature);
+
+    epd_set_temperature_max_age(EPD_TEMPERATURE_DEFAULT_MAX_AGE_MS);
+    epd_ambient_temperature();
+    TEST_ASSERT_TRUE(epd_temperature_reading().timestamp_us == first.timestamp_us);
+
+    epd_set_temperature_max_age(0);
+    vTaskDelay(1);
+    epd_ambient_temperature();
+    TEST_ASSERT_TRUE(epd_temperature_reading().timestamp_us > first.timestamp_us);
+
+    epd_poweroff();
+    epd_deinit();
+
+    // a new initialization forgets the reading and the maximum age
+    epd_init(&TEST_BOARD, &ED097TC2, EPD_OPTIONS_DEFAULT);
+    TEST_ASSERT_TRUE(epd_temperature_reading().timestamp_us == 0);
+    epd_poweron();
+    epd_ambient_temperature();
+    first = epd_temperature_reading();
+    epd_ambient_temperature();
+    TEST_ASSERT_TRUE(epd_temperature_reading().timestamp_us == first.timestamp_us);
+    epd_poweroff();
+    epd_deinit();
+}
+
+TEST_CASE("power requests keep the display powered between updates", "[epdiy,e2e]") {
+    epd_init(&TEST_BOARD, &ED097TC2, EPD_OPTIONS_DEFAULT);
+    epd_set_power_idle_timeout(100);
+
+    for (int i = 0; i < 3; i++) {
+        epd_power_acquire();
+        TEST_ASSERT_TRUE(epd_poweron_wait());
+        epd_power_release();
+    }
+    EpdPowerStats stats = epd_power_stats();
+    TEST_ASSERT_EQUAL(1, stats.power_cycles);
+    TEST_ASSERT_EQUAL(3, stats.requests);
+    TEST_ASSERT_EQUAL(2, stats.requests_powered);
+
+    // powered off after the idle timeout
+    vTaskDelay(pdMS_TO_TICKS(300));
+    int64_t rails_up_us = epd_power_stats().rails_up_us;
+    TEST_ASSERT_TRUE(rails_up_us >= 100 * 1000);
+    vTaskDelay(pdMS_TO_TICKS(50));
+    TEST_ASSERT_TRUE(epd_power_stats().rails_up_us == rails_up_us);
+
+    epd_power_acquire();
+    epd_power_release();
+    TEST_ASSERT_EQUAL(2, epd_power_stats().power_cycles);
+
+    epd_set_power_idle_timeout(EPD_POWER_DEFAULT_IDLE_TIMEOUT_MS);
+    epd_deinit();
+}